@@ -0,0 +1,491 @@
+#ifndef MTCL_BENCH_HPP
+#define MTCL_BENCH_HPP
+
+/*
+ * Helpers shared by the MTCL benchmarks: message size sweeps, sample
+ * statistics, latency histograms, hardware and software counters and the
+ * output of the results as a table, CSV or JSON.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+static inline double elapsed_us(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// parses sizes like 64, 8K, 4M, 1G
+static inline size_t parse_size(const char* s) {
+	char* end;
+	size_t v = std::strtoull(s, &end, 10);
+	switch(*end) {
+	case 'k': case 'K': v <<= 10; break;
+	case 'm': case 'M': v <<= 20; break;
+	case 'g': case 'G': v <<= 30; break;
+	}
+	return v;
+}
+
+// message sizes from min to max (included) multiplying by factor
+static inline std::vector<size_t> size_sweep(size_t min, size_t max, size_t factor) {
+	std::vector<size_t> sizes;
+	if (factor < 2) factor = 2;
+	for(size_t s = min; s <= max; s = (s ? s*factor : 1)) {
+		sizes.push_back(s);
+		if (s > max / factor) break;
+	}
+	return sizes;
+}
+
+/**
+ * @brief Summary of a set of samples.
+ *
+ * For latencies p99 is the 99th percentile. For rates (higher is better) it
+ * is the value exceeded by 99% of the samples, i.e., the 1st percentile, so
+ * that it always describes the tail.
+ */
+struct Stats {
+	size_t count = 0;
+	double avg = 0, median = 0, p99 = 0, min = 0, max = 0;
+};
+
+// nearest-rank percentile of sorted samples, p in [0,100]
+static inline double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) return 0;
+	size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+	return sorted[rank ? rank - 1 : 0];
+}
+
+static inline Stats summarize(std::vector<double> samples, bool higherIsBetter = false) {
+	Stats s;
+	if (samples.empty()) return s;
+	std::sort(samples.begin(), samples.end());
+	double sum = 0;
+	for(auto v : samples) sum += v;
+	s.count  = samples.size();
+	s.avg    = sum / samples.size();
+	s.median = percentile(samples, 50);
+	s.p99    = percentile(samples, higherIsBetter ? 1 : 99);
+	s.min    = samples.front();
+	s.max    = samples.back();
+	return s;
+}
+
+/**
+ * @brief Log-linear histogram of non-negative integer values (HDR style).
+ *
+ * Values below 128 have their own bucket, above that every power of two is
+ * split in 64 linear sub-buckets, thus the relative error of a recorded
+ * value is below 1/64 on the whole 64-bit range with a fixed footprint
+ * (less than 4K counters) and O(1) recording.
+ */
+class Histogram {
+	static constexpr int SUB_BITS = 7;
+	static constexpr uint64_t SUB_COUNT = 1 << SUB_BITS;
+	static constexpr uint64_t HALF = SUB_COUNT / 2;
+
+	std::vector<uint64_t> counts;
+	uint64_t total = 0, maxv = 0, minv = UINT64_MAX;
+	double sum = 0;
+
+	static size_t index(uint64_t v) {
+		if (v < SUB_COUNT) return v;
+		int exp = (63 - __builtin_clzll(v)) - (SUB_BITS - 1);
+		return exp * HALF + (v >> exp);
+	}
+	// largest value falling in the bucket
+	static uint64_t highest(size_t idx) {
+		if (idx < SUB_COUNT) return idx;
+		int exp = idx / HALF - 1;
+		uint64_t sub = idx - exp * HALF;
+		return ((sub + 1) << exp) - 1;
+	}
+
+public:
+	Histogram() : counts(index(UINT64_MAX) + 1, 0) {}
+
+	void record(uint64_t v, uint64_t n = 1) {
+		counts[index(v)] += n;
+		total += n;
+		sum   += (double)v * n;
+		maxv   = std::max(maxv, v);
+		minv   = std::min(minv, v);
+	}
+
+	void merge(const Histogram& o) {
+		for(size_t i = 0; i < counts.size(); ++i) counts[i] += o.counts[i];
+		total += o.total;
+		sum   += o.sum;
+		maxv   = std::max(maxv, o.maxv);
+		minv   = std::min(minv, o.minv);
+	}
+
+	void reset() {
+		std::fill(counts.begin(), counts.end(), 0);
+		total = maxv = 0;
+		minv = UINT64_MAX;
+		sum = 0;
+	}
+
+	uint64_t count() const { return total; }
+	uint64_t max()   const { return maxv; }
+	uint64_t min()   const { return total ? minv : 0; }
+	double   mean()  const { return total ? sum / total : 0; }
+
+	// value below or equal to which p percent of the values fall, p in [0,100]
+	uint64_t percentile(double p) const {
+		if (!total) return 0;
+		uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p / 100.0 * total));
+		uint64_t seen = 0;
+		for(size_t i = 0; i < counts.size(); ++i) {
+			seen += counts[i];
+			if (seen >= rank) return std::min(highest(i), maxv);
+		}
+		return maxv;
+	}
+};
+
+/**
+ * @brief Counters of the whole process (all its threads, the IO thread
+ * included) read with perf_event_open.
+ *
+ * Each counter is optional: in containers and VMs the hardware counters or
+ * the syscall tracepoint are often not available, or only user-space events
+ * can be counted (perf_event_paranoid). The counters that cannot be opened
+ * are reported as not valid. open must be called after Manager::init, the
+ * threads started later by the threads already running are counted as well.
+ */
+class PerfCounters {
+public:
+	enum { CYCLES, INSTRUCTIONS, CACHE_MISSES, CONTEXT_SWITCHES, SYSCALLS, NEVENTS };
+
+	struct Sample {
+		double v[NEVENTS] = {};
+		bool valid[NEVENTS] = {};
+
+		Sample& operator+=(const Sample& o) {
+			for(int i = 0; i < NEVENTS; ++i) {
+				v[i] += o.v[i];
+				valid[i] = valid[i] && o.valid[i];
+			}
+			return *this;
+		}
+	};
+
+	static const char* name(int i) {
+		static const char* names[NEVENTS] = {"cycles", "instr", "cache-miss", "ctx-sw", "syscalls"};
+		return names[i];
+	}
+
+private:
+	std::vector<int> fds[NEVENTS];   // one per thread
+	bool userOnly = false;
+
+	static int perfOpen(perf_event_attr& attr, pid_t tid) {
+		return syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	}
+
+	// id of the raw_syscalls:sys_enter tracepoint, -1 if tracefs is not readable
+	static long syscallTracepoint() {
+		for(auto dir : {"/sys/kernel/tracing", "/sys/kernel/debug/tracing"}) {
+			std::ifstream f(std::string(dir) + "/events/raw_syscalls/sys_enter/id");
+			long id;
+			if (f >> id) return id;
+		}
+		return -1;
+	}
+
+	static std::vector<pid_t> threads() {
+		std::vector<pid_t> tids;
+		if (DIR* d = opendir("/proc/self/task")) {
+			while(dirent* e = readdir(d))
+				if (e->d_name[0] != '.') tids.push_back(std::atoi(e->d_name));
+			closedir(d);
+		}
+		return tids;
+	}
+
+	void ioctlAll(unsigned long req) {
+		for(auto& v : fds)
+			for(int fd : v) ioctl(fd, req, 0);
+	}
+
+public:
+	PerfCounters() = default;
+	PerfCounters(const PerfCounters&) = delete;
+	~PerfCounters() {
+		for(auto& v : fds)
+			for(int fd : v) close(fd);
+	}
+
+	/**
+	 * @brief Opens the counters, returns false if none is available. The
+	 * missing ones are listed on stderr.
+	 */
+	bool open() {
+		static const std::pair<uint32_t, uint64_t> events[NEVENTS] = {
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+			{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+			{PERF_TYPE_TRACEPOINT, 0},
+		};
+		long tp = syscallTracepoint();
+		auto tids = threads();
+		std::string missing;
+		bool any = false;
+		for(int i = 0; i < NEVENTS; ++i) {
+			if (events[i].first == PERF_TYPE_TRACEPOINT && tp < 0) {
+				missing += std::string(" ") + name(i);
+				continue;
+			}
+			perf_event_attr attr{};
+			attr.size        = sizeof(attr);
+			attr.type        = events[i].first;
+			attr.config      = events[i].first == PERF_TYPE_TRACEPOINT ? tp : events[i].second;
+			attr.disabled    = 1;
+			attr.inherit     = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			for(pid_t tid : tids) {
+				attr.exclude_kernel = attr.exclude_hv = userOnly;
+				int fd = perfOpen(attr, tid);
+				if (fd < 0 && (errno == EACCES || errno == EPERM) && !userOnly) {
+					// not allowed to count the kernel, from now on only user space
+					userOnly = true;
+					attr.exclude_kernel = attr.exclude_hv = 1;
+					fd = perfOpen(attr, tid);
+				}
+				if (fd < 0) {
+					for(int f : fds[i]) close(f);
+					fds[i].clear();
+					break;
+				}
+				fds[i].push_back(fd);
+			}
+			if (fds[i].empty()) missing += std::string(" ") + name(i);
+			else any = true;
+		}
+		if (!missing.empty())
+			std::fprintf(stderr, "[bench]: perf counters not available:%s\n", missing.c_str());
+		if (any && userOnly)
+			std::fprintf(stderr, "[bench]: perf counters limited to user space (perf_event_paranoid)\n");
+		return any;
+	}
+
+	// resets the counters and starts counting
+	void start() {
+		ioctlAll(PERF_EVENT_IOC_RESET);
+		ioctlAll(PERF_EVENT_IOC_ENABLE);
+	}
+	// stops and resumes counting, without resetting the counters
+	void pause()  { ioctlAll(PERF_EVENT_IOC_DISABLE); }
+	void resume() { ioctlAll(PERF_EVENT_IOC_ENABLE); }
+
+	// stops counting, the values are scaled if the counters were multiplexed
+	Sample stop() {
+		pause();
+		Sample s;
+		for(int i = 0; i < NEVENTS; ++i) {
+			s.valid[i] = !fds[i].empty();
+			for(int fd : fds[i]) {
+				uint64_t r[3];  // value, time enabled, time running
+				if (read(fd, r, sizeof(r)) != sizeof(r)) { s.valid[i] = false; break; }
+				s.v[i] += r[2] ? (double)r[0] * r[1] / r[2] : 0;
+			}
+		}
+		return s;
+	}
+};
+
+enum class Format { TABLE, CSV, JSON };
+
+static inline bool parse_format(const std::string& s, Format& f) {
+	if (s == "table") f = Format::TABLE;
+	else if (s == "csv") f = Format::CSV;
+	else if (s == "json") f = Format::JSON;
+	else return false;
+	return true;
+}
+
+/**
+ * @brief Prints one row per measurement, all rows with the same columns.
+ *
+ * Each row has a set of labels (e.g., test, transport) followed by the
+ * message size, the number of samples, the statistics and the optional
+ * extra columns (e.g., the perf counters). An extra value "-" is printed as
+ * null in JSON.
+ */
+class Reporter {
+	Format fmt;
+	FILE* out;
+	std::vector<std::string> labels, extra;
+	bool first = true;
+
+public:
+	Reporter(Format fmt, std::vector<std::string> labels, FILE* out = stdout,
+			 std::vector<std::string> extra = {}) :
+		fmt(fmt), out(out), labels(std::move(labels)), extra(std::move(extra)) {}
+
+	void begin() {
+		switch(fmt) {
+		case Format::TABLE:
+			for(auto& l : labels) std::fprintf(out, "%-12s ", l.c_str());
+			std::fprintf(out, "%10s %8s %6s %12s %12s %12s %12s %12s",
+						 "size", "samples", "unit", "avg", "median", "p99", "min", "max");
+			for(auto& e : extra) std::fprintf(out, " %12s", e.c_str());
+			std::fprintf(out, "\n");
+			break;
+		case Format::CSV:
+			for(auto& l : labels) std::fprintf(out, "%s,", l.c_str());
+			std::fprintf(out, "size,samples,unit,avg,median,p99,min,max");
+			for(auto& e : extra) std::fprintf(out, ",%s", e.c_str());
+			std::fprintf(out, "\n");
+			break;
+		case Format::JSON:
+			std::fprintf(out, "[\n");
+			break;
+		}
+	}
+
+	void row(const std::vector<std::string>& values, size_t size, const std::string& unit, const Stats& s,
+			 const std::vector<std::string>& extraValues = {}) {
+		switch(fmt) {
+		case Format::TABLE:
+			for(auto& v : values) std::fprintf(out, "%-12s ", v.c_str());
+			std::fprintf(out, "%10zu %8zu %6s %12.3f %12.3f %12.3f %12.3f %12.3f",
+						 size, s.count, unit.c_str(), s.avg, s.median, s.p99, s.min, s.max);
+			for(size_t i = 0; i < extra.size(); ++i)
+				std::fprintf(out, " %12s", i < extraValues.size() ? extraValues[i].c_str() : "-");
+			std::fprintf(out, "\n");
+			break;
+		case Format::CSV:
+			for(auto& v : values) std::fprintf(out, "%s,", v.c_str());
+			std::fprintf(out, "%zu,%zu,%s,%.3f,%.3f,%.3f,%.3f,%.3f",
+						 size, s.count, unit.c_str(), s.avg, s.median, s.p99, s.min, s.max);
+			for(size_t i = 0; i < extra.size(); ++i)
+				std::fprintf(out, ",%s", i < extraValues.size() ? extraValues[i].c_str() : "-");
+			std::fprintf(out, "\n");
+			break;
+		case Format::JSON:
+			std::fprintf(out, "%s  {", first ? "" : ",\n");
+			for(size_t i = 0; i < labels.size() && i < values.size(); ++i)
+				std::fprintf(out, "\"%s\": \"%s\", ", labels[i].c_str(), values[i].c_str());
+			std::fprintf(out, "\"size\": %zu, \"samples\": %zu, \"unit\": \"%s\", "
+						 "\"avg\": %.3f, \"median\": %.3f, \"p99\": %.3f, \"min\": %.3f, \"max\": %.3f",
+						 size, s.count, unit.c_str(), s.avg, s.median, s.p99, s.min, s.max);
+			for(size_t i = 0; i < extra.size(); ++i) {
+				const char* v = i < extraValues.size() ? extraValues[i].c_str() : "-";
+				std::fprintf(out, ", \"%s\": %s", extra[i].c_str(), std::strcmp(v, "-") ? v : "null");
+			}
+			std::fprintf(out, "}");
+			break;
+		}
+		first = false;
+		std::fflush(out);
+	}
+
+	void end() {
+		if (fmt == Format::JSON) std::fprintf(out, "%s]\n", first ? "" : "\n");
+		std::fflush(out);
+	}
+};
+
+/**
+ * @brief Prints rows with arbitrary columns, for the results that do not fit
+ * the statistics of the Reporter. Values that are numbers are not quoted in
+ * JSON.
+ */
+class Table {
+	Format fmt;
+	FILE* out;
+	std::vector<std::string> columns;
+	bool first = true;
+
+	static bool isNumber(const std::string& v) {
+		if (v.empty()) return false;
+		char* end;
+		std::strtod(v.c_str(), &end);
+		return *end == '\0';
+	}
+
+public:
+	Table(Format fmt, std::vector<std::string> columns, FILE* out = stdout) :
+		fmt(fmt), out(out), columns(std::move(columns)) {}
+
+	void begin() {
+		for(size_t i = 0; i < columns.size(); ++i) {
+			const char* c = columns[i].c_str();
+			switch(fmt) {
+			case Format::TABLE: std::fprintf(out, "%12s%s", c, i + 1 < columns.size() ? " " : "\n"); break;
+			case Format::CSV:   std::fprintf(out, "%s%s", c, i + 1 < columns.size() ? "," : "\n"); break;
+			case Format::JSON:  if (i == 0) std::fprintf(out, "[\n"); break;
+			}
+		}
+	}
+
+	void row(const std::vector<std::string>& values) {
+		if (fmt == Format::JSON) std::fprintf(out, "%s  {", first ? "" : ",\n");
+		for(size_t i = 0; i < columns.size() && i < values.size(); ++i) {
+			bool last = i + 1 == columns.size() || i + 1 == values.size();
+			const char* v = values[i].c_str();
+			switch(fmt) {
+			case Format::TABLE: std::fprintf(out, "%12s%s", v, last ? "\n" : " "); break;
+			case Format::CSV:   std::fprintf(out, "%s%s", v, last ? "\n" : ","); break;
+			case Format::JSON:
+				std::fprintf(out, isNumber(values[i]) ? "\"%s\": %s%s" : "\"%s\": \"%s\"%s",
+							 columns[i].c_str(), v, last ? "}" : ", ");
+				break;
+			}
+		}
+		first = false;
+		std::fflush(out);
+	}
+
+	void end() {
+		if (fmt == Format::JSON) std::fprintf(out, "%s]\n", first ? "" : "\n");
+		std::fflush(out);
+	}
+};
+
+// fixed-point formatting of a value for the Table
+static inline std::string num(double v, int decimals = 2) {
+	char buff[64];
+	std::snprintf(buff, sizeof(buff), "%.*f", decimals, v);
+	return buff;
+}
+
+// column names of the perf counters, e.g., "cycles/msg"
+static inline std::vector<std::string> perf_columns(const std::string& per) {
+	std::vector<std::string> c;
+	for(int i = 0; i < PerfCounters::NEVENTS; ++i)
+		c.push_back(std::string(PerfCounters::name(i)) + "/" + per);
+	return c;
+}
+
+// counters divided by n, "-" for the ones not available
+static inline std::vector<std::string> perf_values(const PerfCounters::Sample& s, double n) {
+	std::vector<std::string> v;
+	for(int i = 0; i < PerfCounters::NEVENTS; ++i)
+		v.push_back(s.valid[i] && n > 0 ? num(s.v[i] / n) : "-");
+	return v;
+}
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,591 @@
+/*
+ * Collective benchmark (OSU-collective style) covering every team type:
+ * broadcast, scatter, gather, allgather, alltoall, fan-in and fan-out.
+ *
+ * N processes (rank0 ... rankN-1) run on one host. For each collective and
+ * each team size n (the first n ranks, rank0 is always the root) the message
+ * size is swept; every measured iteration is preceded by a barrier among all
+ * the processes and timed by every member of the team. The size is the
+ * amount of data of each rank, e.g., scatter sends size*n bytes from the root.
+ *
+ * The implementation (GENERIC, MPI or UCC) is the one selected by the
+ * Manager from the protocol of the components: TCP and SHM use the GENERIC
+ * one, MPI the MPI one and UCX the UCC one (fan-in and fan-out are always
+ * GENERIC). Running the benchmark with different protocols compares them.
+ *
+ * Times are taken with the steady clock, which is system-wide on Linux, thus
+ * the timestamps of different processes on the same host are comparable.
+ * rank0 collects them and reports, in microseconds:
+ *
+ *   avg/min/max   average, min and max over the ranks of the mean latency
+ *                 of each rank (per-rank rows: mean, min and max over the
+ *                 iterations of the rank)
+ *   p99           99th percentile of the latency of the collective, from
+ *                 the first rank entering to the last one leaving it (per-rank
+ *                 rows: of the latencies of the rank)
+ *   arrival       skew of the arrival at the collective: latest minus earliest
+ *                 start of each iteration, median and max (per-rank rows:
+ *                 delay of the rank with respect to the earliest one)
+ *   completion    same for the exit from the collective, median
+ *
+ * With -P every member of the team also counts, with perf_event_open, the
+ * cycles, instructions, cache misses, context switches and system calls of
+ * its process during the measured collectives, reported per operation
+ * (average over the ranks, per-rank rows: of the rank). The counters not
+ * available (e.g., in containers) are printed as "-".
+ *
+ * === Compilation ===
+ *
+ *  $> RAPIDJSON_HOME=<rapidjson_path> make mtcl-coll-bench
+ *  $> TPROTOCOL=MPI RAPIDJSON_HOME=<rapidjson_path> make mtcl-coll-bench
+ *  $> TPROTOCOL=UCX UCX_HOME=<ucx_path> UCC_HOME=<ucc_path> RAPIDJSON_HOME=<rapidjson_path> make mtcl-coll-bench
+ *
+ * === Execution ===
+ *
+ *  $> ./mtcl-coll-bench all|<rank> <nranks> [options]
+ *
+ * With "all" the benchmark forks the nranks processes on the local host,
+ * otherwise each process is started with its own rank, e.g., with MPI:
+ *
+ *  $> ./mtcl-coll-bench all 8 -p SHM -c bcast,alltoall -n 2,4,8
+ *  $> mpirun -n 1 ./mtcl-coll-bench 0 2 -p MPI : -n 1 ./mtcl-coll-bench 1 2 -p MPI
+ *
+ * Options:
+ *   -p proto   protocol of the generated configuration: TCP, SHM, MPI or UCX
+ *              (default TCP)
+ *   -C file    configuration file to use instead of the generated one, the
+ *              components must be named rank0 ... rankN-1 and rank0 must have
+ *              a listening endpoint
+ *   -c list    collectives: bcast,scatter,gather,allgather,alltoall,fanin,fanout
+ *              (default all)
+ *   -n list    team sizes (default powers of two up to nranks, and nranks)
+ *   -m size    smallest message size (default 1), suffixes K, M, G are accepted
+ *   -M size    largest message size (default 1M)
+ *   -f factor  size multiplier of the sweep (default 2)
+ *   -w n       warm-up iterations for each size, not measured (default 10)
+ *   -i n       measured iterations (default 100, 1/10 of them for messages
+ *              larger than 64KB)
+ *   -v         also print one row per rank
+ *   -P         also report the perf counters per operation
+ *   -o fmt     output format: table, csv or json (default table)
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "mtcl.hpp"
+#include "bench.hpp"
+
+const size_t LARGE_MSG_SIZE = 64*1024;
+
+struct Collective {
+	const char* name;
+	HandleType  type;
+};
+static const Collective collectives[] = {
+	{"bcast", MTCL_BROADCAST}, {"scatter", MTCL_SCATTER}, {"gather", MTCL_GATHER},
+	{"allgather", MTCL_ALLGATHER}, {"alltoall", MTCL_ALLTOALL},
+	{"fanin", MTCL_FANIN}, {"fanout", MTCL_FANOUT}
+};
+
+struct Options {
+	std::string protocol{"TCP"};
+	std::string config;
+	std::vector<Collective> colls{std::begin(collectives), std::end(collectives)};
+	std::vector<int> teams;
+	size_t minsize = 1, maxsize = 1<<20, factor = 2;
+	int warmup = 10, iters = 100;
+	bool perRank = false;
+	bool perf = false;
+	bench::Format fmt = bench::Format::TABLE;
+};
+
+static inline int64_t now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		bench::Clock::now().time_since_epoch()).count();
+}
+
+static std::vector<std::string> split(const std::string& s) {
+	std::vector<std::string> v;
+	std::istringstream is(s);
+	std::string item;
+	while(std::getline(is, item, ','))
+		if (!item.empty()) v.push_back(item);
+	return v;
+}
+
+static std::string rankName(int r) { return "rank" + std::to_string(r); }
+
+static std::string participants(int n) {
+	std::string s{rankName(0)};
+	for(int r = 1; r < n; ++r) s += ":" + rankName(r);
+	return s;
+}
+
+/**
+ * @brief Writes a configuration with nranks components on the local host,
+ * rank0 listens on the given protocol.
+ */
+static bool generateConfig(const std::string& file, const std::string& protocol, int nranks) {
+	std::string endpoint;
+	if (protocol == "TCP") endpoint = "TCP:0.0.0.0:42000";
+	else if (protocol == "SHM") endpoint = "SHM:/mtcl-coll-bench";
+	else if (protocol == "MPI") endpoint = "MPI:0:10";
+	else if (protocol == "UCX") endpoint = "UCX:0.0.0.0:42000";
+	else {
+		MTCL_ERROR("[mtcl-coll-bench]:\t", "unknown protocol %s\n", protocol.c_str());
+		return false;
+	}
+	std::ofstream ofs(file);
+	ofs << "{\n    \"components\":[\n";
+	for(int r = 0; r < nranks; ++r) {
+		ofs << "        {\"name\":\"" << rankName(r) << "\", \"host\":\"localhost\", "
+			<< "\"protocols\":[\"" << protocol << "\"]";
+		if (r == 0) ofs << ", \"listen-endpoints\":[\"" << endpoint << "\"]";
+		ofs << "}" << (r < nranks - 1 ? "," : "") << "\n";
+	}
+	ofs << "    ]\n}\n";
+	return ofs.good();
+}
+
+/**
+ * @brief P2P star between rank0 and the other ranks used for the barriers
+ * and to collect the timestamps, it is never used while timing.
+ */
+class Control {
+	int rank, nranks;
+	std::vector<HandleUser> peers;   // rank0, indexed by rank
+	HandleUser root;                 // the other ranks
+
+	static bool sendMsg(HandleUser& h, const void* buff, size_t size) {
+		return h.send(buff, size) == (ssize_t)size;
+	}
+	static bool recvMsg(HandleUser& h, void* buff, size_t size) {
+		return h.receive(buff, size) == (ssize_t)size;
+	}
+
+public:
+	Control(int rank, int nranks) : rank(rank), nranks(nranks), peers(nranks) {}
+
+	bool open() {
+		if (rank == 0) {
+			for(int connected = 0; connected < nranks - 1; ) {
+				auto h = Manager::getNext();
+				if (!h.isNewConnection()) continue;
+				int32_t r;
+				if (!recvMsg(h, &r, sizeof(r)) || r <= 0 || r >= nranks) return false;
+				peers[r] = std::move(h);
+				++connected;
+			}
+			return true;
+		}
+		root = Manager::connect(rankName(0), 100, 200);
+		int32_t r = rank;
+		return root.isValid() && sendMsg(root, &r, sizeof(r));
+	}
+
+	// all the ranks wait for each other, returns false if any rank is not ok
+	bool barrier(bool ok) {
+		int32_t token = ok;
+		if (rank == 0) {
+			for(int r = 1; r < nranks; ++r) {
+				int32_t t;
+				if (!recvMsg(peers[r], &t, sizeof(t))) return false;
+				token &= t;
+			}
+			for(int r = 1; r < nranks; ++r)
+				if (!sendMsg(peers[r], &token, sizeof(token))) return false;
+		} else {
+			if (!sendMsg(root, &token, sizeof(token)) || !recvMsg(root, &token, sizeof(token)))
+				return false;
+		}
+		return token;
+	}
+
+	// the first n ranks send their timestamps to rank0
+	bool gather(const std::vector<int64_t>& mine, int n, std::vector<std::vector<int64_t>>& all) {
+		size_t bytes = mine.size() * sizeof(int64_t);
+		if (rank == 0) {
+			all.assign(n, mine);
+			for(int r = 1; r < n; ++r)
+				if (!recvMsg(peers[r], all[r].data(), bytes)) return false;
+			return true;
+		}
+		return rank >= n || sendMsg(root, mine.data(), bytes);
+	}
+
+	void close() {
+		char c;
+		if (rank == 0) {
+			for(int r = 1; r < nranks; ++r) {
+				peers[r].receive(&c, 1);  // EOS
+				peers[r].close();
+			}
+		} else root.close();
+	}
+};
+
+/* ------------------------------- results --------------------------------- */
+
+struct Row {
+	double avg, min, max, p99, arrival50, arrivalMax, completion50;
+	bench::PerfCounters::Sample perf;   // per operation
+};
+
+class Printer {
+	bench::Format fmt;
+	bool perf;
+	bool first = true;
+
+	void perfColumns(const Row& r) {
+		if (!perf) return;
+		auto cols = bench::perf_columns("op");
+		auto vals = bench::perf_values(r.perf, 1);
+		for(size_t i = 0; i < vals.size(); ++i)
+			switch(fmt) {
+			case bench::Format::TABLE: std::printf(" %12s", vals[i].c_str()); break;
+			case bench::Format::CSV:   std::printf(",%s", vals[i].c_str()); break;
+			case bench::Format::JSON:
+				std::printf(", \"%s\": %s", cols[i].c_str(), vals[i] == "-" ? "null" : vals[i].c_str());
+				break;
+			}
+	}
+public:
+	Printer(bench::Format fmt, bool perf) : fmt(fmt), perf(perf) {}
+
+	void begin() {
+		switch(fmt) {
+		case bench::Format::TABLE:
+			std::printf("%-10s %-8s %-6s %5s %9s %5s %6s %10s %10s %10s %10s %10s %10s %10s",
+						"coll", "impl", "proto", "ranks", "size", "rank", "iters",
+						"avg", "min", "max", "p99", "arr-p50", "arr-max", "cmp-p50");
+			if (perf) for(auto& c : bench::perf_columns("op")) std::printf(" %12s", c.c_str());
+			std::printf("\n");
+			break;
+		case bench::Format::CSV:
+			std::printf("coll,impl,proto,ranks,size,rank,iters,avg,min,max,p99,"
+						"arrival_p50,arrival_max,completion_p50");
+			if (perf) for(auto& c : bench::perf_columns("op")) std::printf(",%s", c.c_str());
+			std::printf("\n");
+			break;
+		case bench::Format::JSON:
+			std::printf("[\n");
+			break;
+		}
+	}
+
+	void row(const char* coll, const char* impl, const std::string& proto, int n, size_t size,
+			 const std::string& rank, int iters, const Row& r) {
+		switch(fmt) {
+		case bench::Format::TABLE:
+			std::printf("%-10s %-8s %-6s %5d %9zu %5s %6d %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f",
+						coll, impl, proto.c_str(), n, size, rank.c_str(), iters,
+						r.avg, r.min, r.max, r.p99, r.arrival50, r.arrivalMax, r.completion50);
+			perfColumns(r);
+			std::printf("\n");
+			break;
+		case bench::Format::CSV:
+			std::printf("%s,%s,%s,%d,%zu,%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f",
+						coll, impl, proto.c_str(), n, size, rank.c_str(), iters,
+						r.avg, r.min, r.max, r.p99, r.arrival50, r.arrivalMax, r.completion50);
+			perfColumns(r);
+			std::printf("\n");
+			break;
+		case bench::Format::JSON:
+			std::printf("%s  {\"coll\": \"%s\", \"impl\": \"%s\", \"proto\": \"%s\", \"ranks\": %d, "
+						"\"size\": %zu, \"rank\": \"%s\", \"iters\": %d, \"unit\": \"us\", \"avg\": %.3f, "
+						"\"min\": %.3f, \"max\": %.3f, \"p99\": %.3f, \"arrival_p50\": %.3f, "
+						"\"arrival_max\": %.3f, \"completion_p50\": %.3f",
+						first ? "" : ",\n", coll, impl, proto.c_str(), n, size, rank.c_str(), iters,
+						r.avg, r.min, r.max, r.p99, r.arrival50, r.arrivalMax, r.completion50);
+			perfColumns(r);
+			std::printf("}");
+			break;
+		}
+		first = false;
+		std::fflush(stdout);
+	}
+
+	void end() {
+		if (fmt == bench::Format::JSON) std::printf("%s]\n", first ? "" : "\n");
+		std::fflush(stdout);
+	}
+};
+
+static double mean(const std::vector<double>& v) {
+	double s = 0;
+	for(auto x : v) s += x;
+	return v.empty() ? 0 : s / v.size();
+}
+
+static std::vector<double> sorted(std::vector<double> v) {
+	std::sort(v.begin(), v.end());
+	return v;
+}
+
+/*
+ * t[r] holds the start and end timestamps of each iteration of rank r,
+ * followed by its perf counters if o.perf (-1 if not available), computes
+ * the team row and, if perRank, one row per rank.
+ */
+static void report(Printer& out, const Collective& c, const char* impl, const Options& o, int n,
+				   size_t size, int iters, const std::vector<std::vector<int64_t>>& t) {
+	std::vector<double> collLat(iters), arrival(iters), completion(iters);
+	std::vector<int64_t> firstStart(iters), firstEnd(iters);
+	for(int i = 0; i < iters; ++i) {
+		int64_t smin = INT64_MAX, smax = INT64_MIN, emin = INT64_MAX, emax = INT64_MIN;
+		for(int r = 0; r < n; ++r) {
+			smin = std::min(smin, t[r][2*i]);   smax = std::max(smax, t[r][2*i]);
+			emin = std::min(emin, t[r][2*i+1]); emax = std::max(emax, t[r][2*i+1]);
+		}
+		collLat[i]    = (emax - smin) / 1e3;
+		arrival[i]    = (smax - smin) / 1e3;
+		completion[i] = (emax - emin) / 1e3;
+		firstStart[i] = smin;
+		firstEnd[i]   = emin;
+	}
+
+	std::vector<Row> ranks(n);
+	for(int r = 0; r < n; ++r) {
+		std::vector<double> lat(iters), arr(iters), cmp(iters);
+		for(int i = 0; i < iters; ++i) {
+			lat[i] = (t[r][2*i+1] - t[r][2*i]) / 1e3;
+			arr[i] = (t[r][2*i] - firstStart[i]) / 1e3;
+			cmp[i] = (t[r][2*i+1] - firstEnd[i]) / 1e3;
+		}
+		auto l = sorted(lat), a = sorted(arr), e = sorted(cmp);
+		ranks[r] = {mean(lat), l.front(), l.back(), bench::percentile(l, 99),
+					bench::percentile(a, 50), a.back(), bench::percentile(e, 50), {}};
+		for(int k = 0; o.perf && k < bench::PerfCounters::NEVENTS; ++k) {
+			int64_t v = t[r][2*iters + k];
+			ranks[r].perf.valid[k] = v >= 0;
+			ranks[r].perf.v[k]     = v >= 0 ? (double)v / iters : 0;
+		}
+	}
+
+	Row team;
+	team.avg = team.max = 0;
+	team.min = ranks[0].avg;
+	std::fill(std::begin(team.perf.valid), std::end(team.perf.valid), true);
+	for(auto& r : ranks) {
+		team.avg += r.avg / n;
+		team.min  = std::min(team.min, r.avg);
+		team.max  = std::max(team.max, r.avg);
+		bench::PerfCounters::Sample p = r.perf;
+		for(auto& v : p.v) v /= n;
+		team.perf += p;
+	}
+	auto a = sorted(arrival);
+	team.p99          = bench::percentile(sorted(collLat), 99);
+	team.arrival50    = bench::percentile(a, 50);
+	team.arrivalMax   = a.back();
+	team.completion50 = bench::percentile(sorted(completion), 50);
+
+	out.row(c.name, impl, o.protocol, n, size, "all", iters, team);
+	if (o.perRank)
+		for(int r = 0; r < n; ++r)
+			out.row(c.name, impl, o.protocol, n, size, std::to_string(r), iters, ranks[r]);
+}
+
+/* ------------------------------ benchmark -------------------------------- */
+
+// one collective operation, size is the amount of data of each rank
+static bool collective(HandleUser& hg, HandleType type, bool root, int n, size_t size,
+					   char* sbuff, char* rbuff) {
+	switch(type) {
+	case MTCL_BROADCAST:
+		return hg.sendrecv(sbuff, size, rbuff, size) > 0;
+	case MTCL_SCATTER:
+		return hg.sendrecv(sbuff, size * n, rbuff, size) > 0;
+	case MTCL_GATHER:
+	case MTCL_ALLGATHER:
+		return hg.sendrecv(sbuff, size, rbuff, size * n) > 0;
+	case MTCL_ALLTOALL:
+		return hg.sendrecv(sbuff, size * n, rbuff, size * n) > 0;
+	case MTCL_FANIN:
+		if (!root) return hg.send(sbuff, size) == (ssize_t)size;
+		for(int i = 0; i < n - 1; ++i)
+			if (hg.receive(rbuff, size) != (ssize_t)size) return false;
+		return true;
+	case MTCL_FANOUT:
+		if (!root) return hg.receive(rbuff, size) == (ssize_t)size;
+		for(int i = 0; i < n - 1; ++i)
+			if (hg.send(sbuff, size) != (ssize_t)size) return false;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool runTeam(Control& ctl, Printer* out, const Collective& c, const Options& o,
+					int rank, int n, bench::PerfCounters* pc) {
+	const char* impl = "GENERIC";
+	if (c.type != MTCL_FANIN && c.type != MTCL_FANOUT) {
+		if (o.protocol == "MPI") impl = "MPI";
+		else if (o.protocol == "UCX") impl = "UCC";
+	}
+	bool member = rank < n;
+	HandleUser hg;
+	if (member) {
+		hg = Manager::createTeam(participants(n), rankName(0), c.type);
+		if (!hg.isValid())
+			MTCL_ERROR("[mtcl-coll-bench]:\t", "%s, cannot create the %s team of %d ranks\n",
+					   rankName(rank).c_str(), c.name, n);
+	}
+	bool ok = ctl.barrier(!member || hg.isValid());
+
+	std::vector<char> sbuff(o.maxsize * n, 'a'), rbuff(o.maxsize * n);
+	for(auto size : bench::size_sweep(o.minsize, o.maxsize, o.factor)) {
+		if (!ok) break;
+		int iters = size > LARGE_MSG_SIZE ? std::max(1, o.iters/10) : o.iters;
+		std::vector<int64_t> t(2 * iters + (pc ? bench::PerfCounters::NEVENTS : 0), 0);
+		bool done = true;
+		for(int i = 0; i < o.warmup && member && done; ++i)
+			done = collective(hg, c.type, rank == 0, n, size, sbuff.data(), rbuff.data());
+		// the barriers are not counted
+		if (pc && member) { pc->start(); pc->pause(); }
+		for(int i = 0; i < iters && (ok = ctl.barrier(done)); ++i) {
+			if (!member) continue;
+			if (pc) pc->resume();
+			t[2*i]   = now_ns();
+			done     = collective(hg, c.type, rank == 0, n, size, sbuff.data(), rbuff.data());
+			t[2*i+1] = now_ns();
+			if (pc) pc->pause();
+		}
+		if (pc && member) {
+			auto s = pc->stop();
+			for(int k = 0; k < bench::PerfCounters::NEVENTS; ++k)
+				t[2*iters + k] = s.valid[k] ? std::llround(s.v[k]) : -1;
+		}
+		if (!ok || !(ok = ctl.barrier(done))) break;
+		std::vector<std::vector<int64_t>> all;
+		if (!(ok = ctl.gather(t, n, all))) break;
+		if (out) report(*out, c, impl, o, n, size, iters, all);
+	}
+	if (!ok && rank == 0)
+		MTCL_ERROR("[mtcl-coll-bench]:\t", "%s with %d ranks failed\n", c.name, n);
+	if (member && hg.isValid()) hg.close();
+	return ok;
+}
+
+static int runRank(int rank, int nranks, const Options& o) {
+	std::string config = o.config;
+	if (config.empty()) {
+		config = "coll_bench_auto_" + std::to_string(rank) + ".json";
+		if (!generateConfig(config, o.protocol, nranks)) return -1;
+	}
+	if (Manager::init(rankName(rank), config) < 0) {
+		MTCL_ERROR("[mtcl-coll-bench]:\t", "Manager::init ERROR\n");
+		return -1;
+	}
+	Control ctl(rank, nranks);
+	int r = 0;
+	if (!ctl.open()) {
+		MTCL_ERROR("[mtcl-coll-bench]:\t", "%s cannot open the control connections\n", rankName(rank).c_str());
+		r = -1;
+	} else {
+		bench::PerfCounters pc;
+		if (o.perf) pc.open();
+		Printer out(o.fmt, o.perf);
+		if (rank == 0) out.begin();
+		for(auto& c : o.colls) {
+			for(auto n : o.teams)
+				if (!runTeam(ctl, rank == 0 ? &out : nullptr, c, o, rank, n, o.perf ? &pc : nullptr)) r = -1;
+			if (r) break;
+		}
+		if (rank == 0) out.end();
+		ctl.close();
+	}
+	Manager::finalize(true);
+	return r;
+}
+
+static void usage(const char* name) {
+	std::cerr << "Usage: " << name << " all|<rank> <nranks> [-p TCP|SHM|MPI|UCX] [-C config]\n"
+			  << "        [-c bcast,scatter,gather,allgather,alltoall,fanin,fanout] [-n team sizes]\n"
+			  << "        [-m minsize] [-M maxsize] [-f factor] [-w warmup] [-i iterations] [-v] [-P]\n"
+			  << "        [-o table|csv|json]\n";
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		usage(argv[0]);
+		return -1;
+	}
+	std::string who{argv[1]};
+	int nranks = std::stoi(argv[2]);
+	int rank = who == "all" ? -1 : std::stoi(who);
+	Options o;
+
+	optind = 3;
+	int opt;
+	while((opt = getopt(argc, argv, "p:C:c:n:m:M:f:w:i:vPo:")) != -1) {
+		switch(opt) {
+		case 'p': o.protocol = optarg; break;
+		case 'C': o.config   = optarg; break;
+		case 'c':
+			o.colls.clear();
+			for(auto& name : split(optarg)) {
+				auto c = std::find_if(std::begin(collectives), std::end(collectives),
+									  [&](const Collective& c) { return name == c.name; });
+				if (c == std::end(collectives)) {
+					usage(argv[0]);
+					return -1;
+				}
+				o.colls.push_back(*c);
+			}
+			break;
+		case 'n':
+			o.teams.clear();
+			for(auto& s : split(optarg)) o.teams.push_back(std::stoi(s));
+			break;
+		case 'm': o.minsize = bench::parse_size(optarg); break;
+		case 'M': o.maxsize = bench::parse_size(optarg); break;
+		case 'f': o.factor  = std::stoul(optarg); break;
+		case 'w': o.warmup  = std::stoi(optarg); break;
+		case 'i': o.iters   = std::stoi(optarg); break;
+		case 'v': o.perRank = true; break;
+		case 'P': o.perf    = true; break;
+		case 'o':
+			if (bench::parse_format(optarg, o.fmt)) break;
+			[[fallthrough]];
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (o.teams.empty()) {
+		for(int n = 2; n < nranks; n *= 2) o.teams.push_back(n);
+		o.teams.push_back(nranks);
+	}
+	// a zero-size message is an EOS for the library
+	if (o.minsize == 0) o.minsize = 1;
+	if (nranks < 2 || rank >= nranks || o.maxsize < o.minsize || o.iters < 1 || o.warmup < 0 ||
+		std::any_of(o.teams.begin(), o.teams.end(), [&](int n) { return n < 2 || n > nranks; })) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	if (rank >= 0) return runRank(rank, nranks, o);
+
+	if (o.protocol == "MPI") {
+		MTCL_ERROR("[mtcl-coll-bench]:\t", "with MPI the ranks must be started by mpirun\n");
+		return -1;
+	}
+	for(int r = 0; r < nranks; ++r) {
+		pid_t pid = fork();
+		if (pid == -1) {
+			MTCL_ERROR("[mtcl-coll-bench]:\t", "fork failed, errno=%d (%s)\n", errno, strerror(errno));
+			return -1;
+		}
+		if (pid == 0) return runRank(r, nranks, o);
+	}
+	int status, r = 0;
+	while(wait(&status) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) r = -1;
+	return r;
+}
@@ -0,0 +1,324 @@
+/*
+ * Microbenchmarks of the library components, based on Google Benchmark.
+ *
+ *   BM_ShmPutGet          shmBuffer::put followed by shmBuffer::get of one
+ *                         message on the same segment (no peer involved)
+ *   BM_ShmTrygetsize      shmBuffer::trygetsize on an empty and on a full buffer
+ *   BM_HandleReady        Manager ready queue: a handle pushed by the transport
+ *                         (addinQ) and popped by Manager::getNext, with 1 to 8
+ *                         threads contending for the queue
+ *   BM_HandleUserRecv     probe and receive through HandleUser on an in-memory
+ *                         handle, to be compared with BM_HandleRecv which calls
+ *                         the handle directly (HandleUser bookkeeping overhead)
+ *   BM_TypedHandleRecv    the same through TypedHandle<ConnBench>
+ *   BM_FrameHeader        encoding and decoding of the TCP frame header
+ *   BM_TcpFrame           HandleTCP send, probe and receive over a socketpair
+ *   BM_TcpUser            the same through HandleUser (virtual calls) and
+ *                         TypedHandle<ConnTcp> (statically dispatched)
+ *   BM_InternalConnect    internal_connect to a local TCP listener, plus accept
+ *                         and close of both ends
+ *   BM_PrintPrefix        print_prefix on /dev/null (enabled MTCL_PRINT cost)
+ *   BM_MtclPrintDisabled  MTCL_PRINT below the verbosity level
+ *
+ * === Compilation ===
+ *
+ *  $> make
+ *  $> make SINGLE_IO_THREAD=1 cleanall all
+ *  $> BENCHMARK_HOME=/opt/benchmark make
+ *
+ * === Execution ===
+ *
+ *  $> ./mtcl-micro [--benchmark_filter=regex] [--benchmark_min_time=0.1]
+ *                  [--benchmark_format=console|csv|json]
+ *
+ * All the Google Benchmark options are accepted. MTCL_VERBOSE must not be
+ * set, otherwise the library prints are measured as well.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <benchmark/benchmark.h>
+#include "mtcl.hpp"
+
+/* ------------------------- in-memory transport ---------------------------- */
+
+// a handle that always has a message of the given size ready
+class HandleBench : public Handle {
+	size_t msgsize;
+public:
+	HandleBench(ConnType* parent, size_t size) : Handle(parent), msgsize(size) {}
+	ssize_t sendEOS() { return sizeof(size_t); }
+	ssize_t send(const void*, size_t size) { return size; }
+	ssize_t probe(size_t& size, const bool) {
+		size = msgsize;
+		return sizeof(size_t);
+	}
+	ssize_t receive(void* buff, size_t size) {
+		std::memset(buff, 0, size);
+		return size;
+	}
+	bool peek() { return true; }
+};
+
+// transport registered in the Manager, handles are pushed explicitly
+class ConnBench : public ConnType {
+public:
+	using handle_type = HandleBench;
+	inline static ConnBench* instance = nullptr;
+
+	int init(std::string) {
+		instance = this;
+		return 0;
+	}
+	int listen(std::string) { return -1; }
+	Handle* connect(const std::string&, int, unsigned) { return nullptr; }
+	void update() {}
+	void notify_yield(Handle*) {}
+	void notify_close(Handle*, bool, bool) {}
+	void end(bool) {}
+
+	void push(Handle* h) { addinQ(false, h); }
+};
+
+/* ----------------------------- shared memory ------------------------------ */
+
+static std::string segment(const char* tag) {
+	return "/mtcl-micro-" + std::string(tag) + "-" + std::to_string(getpid());
+}
+
+static void BM_ShmPutGet(benchmark::State& state) {
+	size_t size = state.range(0);
+	shmBuffer buffer;
+	if (buffer.create(segment("putget"), true) == -1) {
+		state.SkipWithError("shmBuffer::create failed");
+		return;
+	}
+	std::vector<char> sbuff(size, 'a'), rbuff(size);
+	for (auto _ : state) {
+		buffer.put(sbuff.data(), size);
+		buffer.get(rbuff.data(), size);
+	}
+	buffer.close(true);
+	state.SetBytesProcessed(state.iterations() * size);
+}
+// one slot of SHM_SMALL_MSG_SIZE bytes, larger messages need a concurrent reader
+BENCHMARK(BM_ShmPutGet)->Arg(8)->Arg(512)->Arg(64<<10)->Arg(1<<20);
+
+static void BM_ShmTrygetsize(benchmark::State& state) {
+	shmBuffer buffer;
+	if (buffer.create(segment("trygetsize"), true) == -1) {
+		state.SkipWithError("shmBuffer::create failed");
+		return;
+	}
+	char c = 'a';
+	if (state.range(0)) buffer.put(&c, 1);
+	for (auto _ : state)
+		benchmark::DoNotOptimize(buffer.trygetsize());
+	buffer.close(true);
+	state.SetLabel(state.range(0) ? "full" : "empty");
+}
+BENCHMARK(BM_ShmTrygetsize)->Arg(0)->Arg(1);
+
+/* ------------------------------ ready queue ------------------------------- */
+
+static void BM_HandleReady(benchmark::State& state) {
+	// never closed, thus never deleted by the reference counting
+	HandleBench h(ConnBench::instance, 1);
+	for (auto _ : state) {
+		ConnBench::instance->push(&h);
+		// the handle popped may have been pushed by another thread
+		auto next = Manager::getNext();
+		benchmark::DoNotOptimize(next.getID());
+	}
+}
+#if defined(SINGLE_IO_THREAD)
+// the ready queue is not thread-safe in this mode
+BENCHMARK(BM_HandleReady);
+#else
+BENCHMARK(BM_HandleReady)->ThreadRange(1, 8)->UseRealTime();
+#endif
+
+/* ------------------------------- handles ---------------------------------- */
+
+static void BM_HandleRecv(benchmark::State& state) {
+	size_t size = state.range(0);
+	ConnBench conn;
+	HandleBench h(&conn, size);
+	std::vector<char> buff(size);
+	for (auto _ : state) {
+		size_t sz = 0;
+		h.probe(sz, true);
+		benchmark::DoNotOptimize(h.receive(buff.data(), sz));
+	}
+}
+BENCHMARK(BM_HandleRecv)->Arg(8)->Arg(4096);
+
+static void BM_HandleUserRecv(benchmark::State& state) {
+	size_t size = state.range(0);
+	ConnBench conn;
+	HandleBench h(&conn, size);
+	HandleUser hu(&h, true, false);
+	std::vector<char> buff(size);
+	for (auto _ : state) {
+		size_t sz = 0;
+		hu.probe(sz);
+		benchmark::DoNotOptimize(hu.receive(buff.data(), sz));
+	}
+}
+BENCHMARK(BM_HandleUserRecv)->Arg(8)->Arg(4096);
+
+static void BM_TypedHandleRecv(benchmark::State& state) {
+	size_t size = state.range(0);
+	ConnBench conn;
+	HandleBench h(&conn, size);
+	TypedHandle<ConnBench> th(HandleUser(&h, true, false));
+	std::vector<char> buff(size);
+	for (auto _ : state) {
+		size_t sz = 0;
+		th.probe(sz);
+		benchmark::DoNotOptimize(th.receive(buff.data(), sz));
+	}
+}
+BENCHMARK(BM_TypedHandleRecv)->Arg(8)->Arg(4096);
+
+/* ---------------------------------- TCP ----------------------------------- */
+
+// the header and the iovec built by HandleTCP::send, the size read by probe
+static void BM_FrameHeader(benchmark::State& state) {
+	char data[8];
+	size_t size = 0;
+	for (auto _ : state) {
+		size_t sz = htobe64(++size);
+		struct iovec iov[2];
+		iov[0].iov_base = &sz;
+		iov[0].iov_len  = sizeof(sz);
+		iov[1].iov_base = data;
+		iov[1].iov_len  = size;
+		benchmark::DoNotOptimize(iov);
+		benchmark::DoNotOptimize(be64toh(*(size_t*)iov[0].iov_base));
+	}
+}
+BENCHMARK(BM_FrameHeader);
+
+static void BM_TcpFrame(benchmark::State& state) {
+	size_t size = state.range(0);
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		state.SkipWithError("socketpair failed");
+		return;
+	}
+	// the handles are never closed, the parent is not used
+	HandleTCP sender(nullptr, sv[0]), receiver(nullptr, sv[1]);
+	std::vector<char> sbuff(size, 'a'), rbuff(size);
+	for (auto _ : state) {
+		size_t sz = 0;
+		sender.send(sbuff.data(), size);
+		receiver.probe(sz, true);
+		receiver.receive(rbuff.data(), sz);
+	}
+	::close(sv[0]);
+	::close(sv[1]);
+	state.SetBytesProcessed(state.iterations() * size);
+}
+// within the socket buffer, sender and receiver are the same thread
+BENCHMARK(BM_TcpFrame)->Arg(8)->Arg(512)->Arg(4096)->Arg(32<<10);
+
+template<typename U>
+static void BM_TcpUser(benchmark::State& state) {
+	size_t size = state.range(0);
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		state.SkipWithError("socketpair failed");
+		return;
+	}
+	// the handles are never closed, yield and close are not propagated
+	ConnBench conn;
+	HandleTCP sender(&conn, sv[0]), receiver(&conn, sv[1]);
+	{
+		U su(HandleUser(&sender, false, false)), ru(HandleUser(&receiver, true, false));
+		std::vector<char> sbuff(size, 'a'), rbuff(size);
+		for (auto _ : state) {
+			size_t sz = 0;
+			su.send(sbuff.data(), size);
+			ru.probe(sz);
+			ru.receive(rbuff.data(), sz);
+		}
+	}
+	::close(sv[0]);
+	::close(sv[1]);
+	state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK_TEMPLATE(BM_TcpUser, HandleUser)->Arg(8)->Arg(512);
+BENCHMARK_TEMPLATE(BM_TcpUser, TypedHandle<ConnTcp>)->Arg(8)->Arg(512);
+
+static void BM_InternalConnect(benchmark::State& state) {
+	int lfd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr{};
+	socklen_t len = sizeof(addr);
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port        = 0;
+	if (lfd == -1 || bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+		::listen(lfd, TCP_BACKLOG) == -1 || getsockname(lfd, (struct sockaddr*)&addr, &len) == -1) {
+		state.SkipWithError("cannot create the listener");
+		if (lfd != -1) ::close(lfd);
+		return;
+	}
+	std::string address = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+	// reset instead of a graceful close, the ephemeral ports are not left in TIME_WAIT
+	struct linger lg{1, 0};
+	for (auto _ : state) {
+		int fd = internal_connect(address, 1, 0);
+		if (fd == -1) {
+			state.SkipWithError("internal_connect failed");
+			break;
+		}
+		int afd = accept(lfd, nullptr, nullptr);
+		setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+		::close(fd);
+		::close(afd);
+	}
+	::close(lfd);
+}
+BENCHMARK(BM_InternalConnect)->UseRealTime();
+
+/* -------------------------------- logging --------------------------------- */
+
+static void BM_PrintPrefix(benchmark::State& state) {
+	FILE* out = std::fopen("/dev/null", "w");
+	if (!out) {
+		state.SkipWithError("cannot open /dev/null");
+		return;
+	}
+	int i = 0;
+	for (auto _ : state)
+		print_prefix(out, "message %d from %s\n", "[MTCL]:\t", ++i, "bench");
+	std::fclose(out);
+}
+BENCHMARK(BM_PrintPrefix);
+
+static void BM_MtclPrintDisabled(benchmark::State& state) {
+	int i = 0;
+	for (auto _ : state) {
+		MTCL_PRINT(100, "[MTCL]:\t", "message %d from %s\n", ++i, "bench");
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK(BM_MtclPrintDisabled);
+
+int main(int argc, char** argv) {
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) return -1;
+
+	Manager::registerType<ConnBench>("BENCH");
+	if (Manager::init("mtcl-micro") == -1) return -1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	Manager::finalize(true);
+	return 0;
+}
@@ -0,0 +1,306 @@
+/*
+ * Point-to-point benchmarks over any transport compiled in the library.
+ *
+ *   lat   ping-pong latency (one-way, half of the round trip time)
+ *   bw    unidirectional bandwidth, windows of messages acknowledged by the receiver
+ *   bibw  bidirectional bandwidth, both peers stream windows of messages
+ *   mr    message rate, as bw but reported in messages per second
+ *
+ * The server only needs the transport URI, all the parameters are sent by
+ * the client when it connects. Results are printed by the client.
+ *
+ * === Compilation ===
+ *
+ *  $> TPROTOCOL="MPI UCX" make SINGLE_IO_THREAD=1 cleanall mtcl-bench
+ *
+ * === Execution ===
+ *
+ *  $> ./mtcl-bench server <URI>
+ *  $> ./mtcl-bench lat|bw|bibw|mr <URI> [options]
+ *
+ *  e.g.
+ *  $> ./mtcl-bench server TCP:0.0.0.0:13000 &
+ *  $> ./mtcl-bench lat TCP:localhost:13000 -m 1 -M 1M -o csv
+ *
+ *  $> mpirun -n 1 ./mtcl-bench server MPI:0:10 : -n 1 ./mtcl-bench bw MPI:0:10
+ *
+ * Options (client side):
+ *   -m size    smallest message size (default 1), suffixes K, M, G are accepted
+ *   -M size    largest message size (default 4M)
+ *   -f factor  size multiplier of the sweep (default 2)
+ *   -w n       warm-up iterations for each size, not measured (default 10)
+ *   -i n       iterations of each repetition (default 1000, 1/10 of them
+ *              for messages larger than 64KB)
+ *   -r n       repetitions, peers synchronize before each one (default 5)
+ *   -W n       window size for bw, bibw and mr (default 64)
+ *   -P         also report cycles, instructions, cache misses, context
+ *              switches and system calls per message (perf_event_open)
+ *   -o fmt     output format: table, csv or json (default table)
+ *
+ * Every iteration (latency) or window (bandwidth, message rate) is a sample;
+ * the samples of all the repetitions are summarized together.
+ *
+ * With -P both peers count the events of their whole process during the
+ * measured repetitions (for bibw also the warm-up), the server sends its
+ * counters to the client which reports their sum divided by the messages
+ * exchanged: 2 per latency iteration, one per message of a window (two for
+ * bibw). The counters not available (e.g., in containers) are printed as "-".
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include "mtcl.hpp"
+#include "bench.hpp"
+
+enum Test : int32_t { LAT, BW, BIBW, MR };
+static const char* testNames[] = {"lat", "bw", "bibw", "mr"};
+
+const size_t LARGE_MSG_SIZE = 64*1024;
+
+// sent by the client to the server at connection time
+struct Params {
+	int32_t  test;
+	int32_t  window;
+	int32_t  warmup;
+	int32_t  iters;
+	int32_t  reps;
+	int32_t  perf;      // both peers read the perf counters
+	uint64_t minsize;
+	uint64_t maxsize;
+	uint64_t factor;
+};
+
+static int iterations(const Params& p, size_t size) {
+	return size > LARGE_MSG_SIZE ? std::max(1, p.iters/10) : p.iters;
+}
+
+static bool sendMsg(HandleUser& h, const char* buff, size_t size) {
+	if (h.send(buff, size) != (ssize_t)size) {
+		MTCL_ERROR("[mtcl-bench]:\t", "send error, errno=%d (%s)\n", errno, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static bool recvMsg(HandleUser& h, char* buff, size_t size) {
+	if (h.receive(buff, size) != (ssize_t)size) {
+		MTCL_ERROR("[mtcl-bench]:\t", "receive error, errno=%d (%s)\n", errno, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// both peers wait for each other
+static bool barrier(HandleUser& h, bool client) {
+	int32_t token = 0;
+	if (client) return sendMsg(h, (char*)&token, sizeof(token)) && recvMsg(h, (char*)&token, sizeof(token));
+	return recvMsg(h, (char*)&token, sizeof(token)) && sendMsg(h, (char*)&token, sizeof(token));
+}
+
+/*
+ * Runs count iterations (LAT) or windows (BW, MR) of one size, the client
+ * stores a sample for each of them if samples is not null.
+ */
+static bool run(HandleUser& h, const Params& p, bool client, size_t size, int count,
+				char* sbuff, char* rbuff, std::vector<double>* samples) {
+	int32_t ack = 0;
+	for(int i = 0; i < count; ++i) {
+		auto start = bench::Clock::now();
+		if (p.test == LAT) {
+			if (client) {
+				if (!sendMsg(h, sbuff, size) || !recvMsg(h, rbuff, size)) return false;
+			} else {
+				if (!recvMsg(h, rbuff, size) || !sendMsg(h, sbuff, size)) return false;
+			}
+		} else {
+			if (client) {
+				for(int j = 0; j < p.window; ++j)
+					if (!sendMsg(h, sbuff, size)) return false;
+				if (!recvMsg(h, (char*)&ack, sizeof(ack))) return false;
+			} else {
+				for(int j = 0; j < p.window; ++j)
+					if (!recvMsg(h, rbuff, size)) return false;
+				if (!sendMsg(h, (char*)&ack, sizeof(ack))) return false;
+			}
+		}
+		if (!samples) continue;
+		double us = bench::elapsed_us(start, bench::Clock::now());
+		switch(p.test) {
+		case LAT: samples->push_back(us / 2); break;
+		case BW:  samples->push_back(p.window * size / us); break;     // MB/s
+		case MR:  samples->push_back(p.window * 1e6 / us); break;      // msg/s
+		}
+	}
+	return true;
+}
+
+/*
+ * Bidirectional bandwidth: a thread streams all the windows to the peer
+ * while the calling thread receives the windows streamed by the peer. The
+ * client samples the receive time of each window after the warm-up.
+ */
+static bool runBidirectional(HandleUser& h, const Params& p, size_t size, int count,
+							 char* sbuff, char* rbuff, std::vector<double>* samples) {
+	int warmup = p.warmup;
+	bool sendok = true;
+	std::thread sender([&]() {
+		for(long i = 0; i < (long)(warmup + count) * p.window && sendok; ++i)
+			sendok = sendMsg(h, sbuff, size);
+	});
+	bool recvok = true;
+	for(int i = 0; i < warmup + count && recvok; ++i) {
+		auto start = bench::Clock::now();
+		for(int j = 0; j < p.window && recvok; ++j)
+			recvok = recvMsg(h, rbuff, size);
+		if (samples && i >= warmup)
+			samples->push_back(2.0 * p.window * size / bench::elapsed_us(start, bench::Clock::now()));
+	}
+	sender.join();
+	return sendok && recvok;
+}
+
+static bool sweep(HandleUser& h, const Params& p, bool client, bench::Reporter* rep,
+				  const std::string& transport, bench::PerfCounters* pc) {
+	std::vector<char> sbuff(p.maxsize, 'a'), rbuff(p.maxsize);
+	for(auto size : bench::size_sweep(p.minsize, p.maxsize, p.factor)) {
+		int n = iterations(p, size);
+		std::vector<double> samples;
+		auto* s = client ? &samples : nullptr;
+		double msgs;
+		if (p.test == BIBW) {
+			if (!barrier(h, client)) return false;
+			if (pc) pc->start();
+			if (!runBidirectional(h, p, size, n * p.reps, sbuff.data(), rbuff.data(), s))
+				return false;
+			msgs = 2.0 * p.window * (p.warmup + n * p.reps);
+		} else {
+			if (!run(h, p, client, size, p.warmup, sbuff.data(), rbuff.data(), nullptr))
+				return false;
+			if (pc) pc->start();
+			for(int r = 0; r < p.reps; ++r)
+				if (!barrier(h, client) ||
+					!run(h, p, client, size, n, sbuff.data(), rbuff.data(), s))
+					return false;
+			msgs = (p.test == LAT ? 2.0 : p.window) * n * p.reps;
+		}
+		bench::PerfCounters::Sample perf;
+		if (pc) {
+			perf = pc->stop();
+			bench::PerfCounters::Sample peer;
+			if (!client) {
+				if (!sendMsg(h, (const char*)&perf, sizeof(perf))) return false;
+			} else {
+				if (!recvMsg(h, (char*)&peer, sizeof(peer))) return false;
+				perf += peer;
+			}
+		}
+		if (rep) {
+			const char* unit = p.test == LAT ? "us" : (p.test == MR ? "msg/s" : "MB/s");
+			rep->row({testNames[p.test], transport}, size, unit, bench::summarize(samples, p.test != LAT),
+					 pc ? bench::perf_values(perf, msgs) : std::vector<std::string>{});
+		}
+	}
+	return true;
+}
+
+static int server(const std::string& uri) {
+	if (Manager::listen(uri) == -1) {
+		MTCL_ERROR("[mtcl-bench]:\t", "listen on %s failed, errno=%d (%s)\n", uri.c_str(), errno, strerror(errno));
+		return -1;
+	}
+	auto h = Manager::getNext();
+	Params p;
+	if (!recvMsg(h, (char*)&p, sizeof(p))) return -1;
+	bench::PerfCounters pc;
+	if (p.perf) pc.open();
+	if (!sweep(h, p, false, nullptr, "", p.perf ? &pc : nullptr)) return -1;
+
+	// waiting for the client to close
+	char c;
+	h.receive(&c, 1);
+	h.close();
+	return 0;
+}
+
+static int client(const std::string& uri, const Params& p, bench::Format fmt) {
+	HandleUser h;
+	for(int i = 0; i < 50 && !h.isValid(); ++i) {
+		h = Manager::connect(uri);
+		if (!h.isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+	if (!h.isValid()) {
+		MTCL_ERROR("[mtcl-bench]:\t", "cannot connect to %s\n", uri.c_str());
+		return -1;
+	}
+	if (!sendMsg(h, (const char*)&p, sizeof(p))) return -1;
+
+	bench::PerfCounters pc;
+	if (p.perf) pc.open();
+	bench::Reporter rep(fmt, {"test", "transport"}, stdout,
+						p.perf ? bench::perf_columns("msg") : std::vector<std::string>{});
+	rep.begin();
+	bool ok = sweep(h, p, true, &rep, uri.substr(0, uri.find(':')), p.perf ? &pc : nullptr);
+	rep.end();
+	h.close();
+	return ok ? 0 : -1;
+}
+
+static void usage(const char* name) {
+	std::cerr << "Usage:\n"
+			  << "  " << name << " server <URI>\n"
+			  << "  " << name << " lat|bw|bibw|mr <URI> [-m minsize] [-M maxsize] [-f factor]\n"
+			  << "        [-w warmup] [-i iterations] [-r repetitions] [-W window] [-P] [-o table|csv|json]\n";
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		usage(argv[0]);
+		return -1;
+	}
+	std::string cmd{argv[1]}, uri{argv[2]};
+	Params p{LAT, 64, 10, 1000, 5, 0, 1, 4<<20, 2};
+	bench::Format fmt = bench::Format::TABLE;
+
+	if (cmd != "server") {
+		auto t = std::find(std::begin(testNames), std::end(testNames), cmd);
+		if (t == std::end(testNames)) {
+			usage(argv[0]);
+			return -1;
+		}
+		p.test = t - std::begin(testNames);
+		optind = 3;
+		int opt;
+		while((opt = getopt(argc, argv, "m:M:f:w:i:r:W:Po:")) != -1) {
+			switch(opt) {
+			case 'm': p.minsize = bench::parse_size(optarg); break;
+			case 'M': p.maxsize = bench::parse_size(optarg); break;
+			case 'f': p.factor  = std::stoul(optarg); break;
+			case 'w': p.warmup  = std::stoi(optarg); break;
+			case 'i': p.iters   = std::stoi(optarg); break;
+			case 'r': p.reps    = std::stoi(optarg); break;
+			case 'W': p.window  = std::stoi(optarg); break;
+			case 'P': p.perf    = 1; break;
+			case 'o':
+				if (bench::parse_format(optarg, fmt)) break;
+				[[fallthrough]];
+			default:
+				usage(argv[0]);
+				return -1;
+			}
+		}
+		// a zero-size message is an EOS for the library
+		if (p.minsize == 0) p.minsize = 1;
+		if (p.maxsize < p.minsize || p.iters < 1 || p.reps < 1 || p.window < 1 || p.warmup < 0) {
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	Manager::init(cmd == "server" ? "mtcl-bench-server" : "mtcl-bench-client");
+	int r = cmd == "server" ? server(uri) : client(uri, p, fmt);
+	Manager::finalize(true);
+	return r;
+}
@@ -0,0 +1,324 @@
+/*
+ * Connection scalability: cost of many idle connections and rate of
+ * connection setup and teardown.
+ *
+ * For each connection count C the client opens C data connections to the
+ * server (connect plus MTCL handshake) and leaves them idle. The server gets
+ * them from Manager::getNext and gives them back to the Manager, thus every
+ * update() of the transport has to check all of them (select over all the
+ * sockets for TCP, a check of every buffer for SHM). Then:
+ *
+ *   connect/s   connections opened per second by the client
+ *   accept/s    connections accepted per second by the server, from the
+ *               first to the last one seen by Manager::getNext
+ *   lat-p50/p99 ping-pong latency (half round trip, us) on the control
+ *               connection, which goes through getNext like the idle ones
+ *   idle-cpu    CPU used by the server process while nothing happens,
+ *               percentage of one core: the IO thread, or the polling in
+ *               Manager::getNext with SINGLE_IO_THREAD
+ *   close/s     connections closed per second, from the first to the last
+ *               EOS handled by the server
+ *
+ * The TCP transport uses select, thus the counts are limited to FD_SETSIZE
+ * descriptors per process.
+ *
+ * === Compilation ===
+ *
+ *  $> make mtcl-conn-scale
+ *  $> make SINGLE_IO_THREAD=1 mtcl-conn-scale
+ *
+ * === Execution ===
+ *
+ *  $> ./mtcl-conn-scale server <URI>
+ *  $> ./mtcl-conn-scale client <URI> [-n counts] [-i iterations] [-s size] [-T ms] [-o fmt]
+ *
+ *  e.g.
+ *  $> ./mtcl-conn-scale server TCP:0.0.0.0:13000 &
+ *  $> ./mtcl-conn-scale client TCP:localhost:13000 -n 1,10,100,1000
+ *
+ * Client options:
+ *   -n list   connection counts (default 1,10,100,1000)
+ *   -i n      ping-pong iterations for each count (default 1000)
+ *   -s size   ping-pong message size, at least 16 bytes (default 16)
+ *   -T ms     idle time measured on the server for each count (default 1000)
+ *   -o fmt    output format: table, csv or json (default table)
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include "mtcl.hpp"
+#include "bench.hpp"
+
+// commands sent by the client on the control connection
+enum Command : int32_t {
+	PING,         // echo the message
+	RESET,        // start a new count, reply when done
+	WAIT_ACCEPT,  // reply when arg connections have been accepted
+	WAIT_CLOSE,   // reply when arg connections have been closed
+	IDLE          // measure the CPU used in arg milliseconds, reply
+};
+
+struct Cmd {
+	int32_t  type;
+	int32_t  pad;
+	uint64_t arg;
+};
+
+struct Reply {
+	uint64_t count;
+	int64_t  first;   // ns, time of the first event
+	int64_t  last;    // ns, time of the last event
+	double   cpu;     // seconds
+};
+
+static inline int64_t now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		bench::Clock::now().time_since_epoch()).count();
+}
+
+static double cpu_seconds() {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static bool sendMsg(HandleUser& h, const void* buff, size_t size) {
+	if (h.send(buff, size) != (ssize_t)size) {
+		MTCL_ERROR("[mtcl-conn-scale]:\t", "send error, errno=%d (%s)\n", errno, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static bool recvMsg(HandleUser& h, void* buff, size_t size) {
+	if (h.receive(buff, size) != (ssize_t)size) {
+		MTCL_ERROR("[mtcl-conn-scale]:\t", "receive error, errno=%d (%s)\n", errno, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+/* ------------------------------- server ---------------------------------- */
+
+struct Events {
+	uint64_t count = 0;
+	int64_t first = 0, last = 0;
+	void add() {
+		last = now_ns();
+		if (count++ == 0) first = last;
+	}
+	Reply reply() const { return {count, first, last, 0}; }
+};
+
+static int server(const std::string& uri) {
+	if (Manager::listen(uri) == -1) {
+		MTCL_ERROR("[mtcl-conn-scale]:\t", "listen on %s failed, errno=%d (%s)\n", uri.c_str(), errno, strerror(errno));
+		return -1;
+	}
+	Events accepted, closed;
+	size_t control = 0;                  // ID of the control connection
+	std::optional<HandleUser> pending;   // control connection waiting for a reply
+	Cmd wait{};
+	std::vector<char> buff(sizeof(Cmd));
+
+	while(true) {
+		auto h = Manager::getNext();
+		if (h.isNewConnection()) {
+			// given back to the Manager, it stays idle in the transport
+			accepted.add();
+		} else {
+			size_t sz;
+			if (h.probe(sz) <= 0 || sz == 0) {
+				h.close();
+				if (h.getID() == control) break;
+				closed.add();
+			} else {
+				if (buff.size() < sz) buff.resize(sz);
+				if (!recvMsg(h, buff.data(), sz)) break;
+				control = h.getID();
+				Cmd cmd;
+				std::memcpy(&cmd, buff.data(), sizeof(cmd));
+				switch(cmd.type) {
+				case PING:
+					if (!sendMsg(h, buff.data(), sz)) return -1;
+					break;
+				case RESET: {
+					accepted = closed = Events();
+					Reply r{};
+					if (!sendMsg(h, &r, sizeof(r))) return -1;
+				} break;
+				case WAIT_ACCEPT:
+				case WAIT_CLOSE:
+					wait = cmd;
+					pending.emplace(std::move(h));
+					break;
+				case IDLE: {
+					auto deadline = bench::Clock::now() + std::chrono::milliseconds(cmd.arg);
+					double cpu = cpu_seconds();
+					// nothing should arrive, in SINGLE_IO_THREAD mode this is the polling loop
+					while(bench::Clock::now() < deadline)
+						Manager::getNext(std::chrono::duration_cast<std::chrono::microseconds>(
+											 deadline - bench::Clock::now()));
+					Reply r{0, 0, 0, cpu_seconds() - cpu};
+					if (!sendMsg(h, &r, sizeof(r))) return -1;
+				} break;
+				}
+			}
+		}
+		if (pending) {
+			const Events& e = wait.type == WAIT_ACCEPT ? accepted : closed;
+			if (e.count >= wait.arg) {
+				Reply r = e.reply();
+				if (!sendMsg(*pending, &r, sizeof(r))) return -1;
+				pending.reset();
+			}
+		}
+	}
+	return 0;
+}
+
+/* ------------------------------- client ---------------------------------- */
+
+static bool command(HandleUser& h, int32_t type, uint64_t arg, Reply& r) {
+	Cmd cmd{type, 0, arg};
+	return sendMsg(h, &cmd, sizeof(cmd)) && recvMsg(h, &r, sizeof(r));
+}
+
+static int client(const std::string& uri, std::vector<int> counts, int iters, size_t size,
+				  int idle, bench::Format fmt) {
+	std::string transport = uri.substr(0, uri.find(':'));
+	if (transport == "TCP") {
+		// control connection, listening socket and a few more descriptors
+		int max = FD_SETSIZE - 64;
+		auto n = counts.size();
+		counts.erase(std::remove_if(counts.begin(), counts.end(), [&](int c) { return c > max; }), counts.end());
+		if (counts.size() < n)
+			MTCL_ERROR("[mtcl-conn-scale]:\t", "TCP uses select, skipping the counts above %d\n", max);
+	}
+
+	HandleUser ctl;
+	for(int i = 0; i < 50 && !ctl.isValid(); ++i) {
+		ctl = Manager::connect(uri);
+		if (!ctl.isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+	if (!ctl.isValid()) {
+		MTCL_ERROR("[mtcl-conn-scale]:\t", "cannot connect to %s\n", uri.c_str());
+		return -1;
+	}
+
+	bench::Table out(fmt, {"transport", "conns", "connect/s", "accept/s", "lat-p50", "lat-p99",
+						   "idle-cpu%", "close/s"});
+	out.begin();
+	std::vector<char> sbuff(size, 0), rbuff(size);
+	Cmd ping{PING, 0, 0};
+	std::memcpy(sbuff.data(), &ping, sizeof(ping));
+	bool ok = true;
+	for(auto count : counts) {
+		Reply acc, cls, cpu, r;
+		if (!(ok = command(ctl, RESET, 0, r))) break;
+
+		std::vector<HandleUser> conns;
+		conns.reserve(count);
+		auto start = bench::Clock::now();
+		for(int i = 0; i < count; ++i) {
+			// the retries cover a full accept backlog
+			conns.push_back(Manager::connect(uri, 10, 100));
+			if (!conns.back().isValid()) {
+				MTCL_ERROR("[mtcl-conn-scale]:\t", "connection %d of %d failed, errno=%d (%s)\n",
+						   i + 1, count, errno, strerror(errno));
+				ok = false;
+				break;
+			}
+		}
+		double connectRate = count * 1e6 / bench::elapsed_us(start, bench::Clock::now());
+		if (!ok || !(ok = command(ctl, WAIT_ACCEPT, count, acc))) break;
+
+		std::vector<double> lat;
+		for(int i = 0; i < iters && ok; ++i) {
+			auto t = bench::Clock::now();
+			ok = sendMsg(ctl, sbuff.data(), size) && recvMsg(ctl, rbuff.data(), size);
+			lat.push_back(bench::elapsed_us(t, bench::Clock::now()) / 2);
+		}
+		if (!ok || !(ok = command(ctl, IDLE, idle, cpu))) break;
+
+		for(auto& h : conns) h.close();
+		if (!(ok = command(ctl, WAIT_CLOSE, count, cls))) break;
+		conns.clear();
+
+		auto rate = [](const Reply& r) {
+			return r.last > r.first ? (r.count - 1) * 1e9 / (r.last - r.first) : 0.0;
+		};
+		std::sort(lat.begin(), lat.end());
+		out.row({transport, std::to_string(count), bench::num(connectRate, 0), bench::num(rate(acc), 0),
+				 bench::num(bench::percentile(lat, 50)), bench::num(bench::percentile(lat, 99)),
+				 bench::num(100 * cpu.cpu * 1e3 / idle, 1), bench::num(rate(cls), 0)});
+	}
+	out.end();
+	ctl.close();
+	return ok ? 0 : -1;
+}
+
+static std::vector<int> parse_list(const std::string& s) {
+	std::vector<int> v;
+	std::istringstream is(s);
+	std::string item;
+	while(std::getline(is, item, ','))
+		if (!item.empty()) v.push_back(std::stoi(item));
+	return v;
+}
+
+static void usage(const char* name) {
+	std::cerr << "Usage:\n"
+			  << "  " << name << " server <URI>\n"
+			  << "  " << name << " client <URI> [-n counts] [-i iterations] [-s size] [-T ms]"
+			  << " [-o table|csv|json]\n";
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		usage(argv[0]);
+		return -1;
+	}
+	std::string cmd{argv[1]}, uri{argv[2]};
+	if (cmd != "server" && cmd != "client") {
+		usage(argv[0]);
+		return -1;
+	}
+	std::vector<int> counts{1, 10, 100, 1000};
+	int iters = 1000, idle = 1000;
+	size_t size = sizeof(Cmd);
+	bench::Format fmt = bench::Format::TABLE;
+
+	optind = 3;
+	int opt;
+	while((opt = getopt(argc, argv, "n:i:s:T:o:")) != -1) {
+		switch(opt) {
+		case 'n': counts = parse_list(optarg); break;
+		case 'i': iters  = std::stoi(optarg); break;
+		case 's': size   = bench::parse_size(optarg); break;
+		case 'T': idle   = std::stoi(optarg); break;
+		case 'o':
+			if (bench::parse_format(optarg, fmt)) break;
+			[[fallthrough]];
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (size < sizeof(Cmd) || iters < 1 || idle < 1 || counts.empty() ||
+		std::any_of(counts.begin(), counts.end(), [](int c) { return c < 1; })) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	Manager::init(cmd == "server" ? "mtcl-conn-scale-server" : "mtcl-conn-scale-client");
+	int r = cmd == "server" ? server(uri) : client(uri, counts, iters, size, idle, fmt);
+	Manager::finalize(true);
+	return r;
+}
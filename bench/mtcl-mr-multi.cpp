@@ -0,0 +1,416 @@
+/*
+ * Aggregate message rate with many concurrent pairs and threads
+ * (osu_mbw_mr style).
+ *
+ * Each client process opens K data connections (pairs) to the server and
+ * drives them with T threads, every thread sends windows of W messages on
+ * its pairs and waits for the acknowledgement of each window. The server
+ * receives the windows either through Manager::getNext with one or more
+ * receiver threads (default, it goes through the IO thread and the ready
+ * queue of the Manager) or with threads each owning a subset of the pairs
+ * and receiving directly from them (-d).
+ *
+ * The client sweeps the number of pairs and threads and reports messages per
+ * second and the scaling efficiency, i.e., the rate divided by the rate of
+ * the first configuration scaled by the number of pairs. With more than one
+ * client process (-c on the server) all the clients start each run together
+ * and the server also reports the aggregate rate (warm-up included).
+ *
+ * === Compilation ===
+ *
+ *  $> make mtcl-mr-multi                      # IO thread
+ *  $> make SINGLE_IO_THREAD=1 mtcl-mr-multi   # no IO thread
+ *
+ * === Execution ===
+ *
+ *  $> ./mtcl-mr-multi server <URI> [-t receivers] [-d] [-c clients]
+ *  $> ./mtcl-mr-multi client <URI> [-p 1,2,4,8] [-t 1,2,4] [-W window] [-s size]
+ *                                  [-w warmup] [-i iterations] [-r repetitions] [-o fmt]
+ *
+ *  e.g.
+ *  $> ./mtcl-mr-multi server TCP:0.0.0.0:13000 -t 4 &
+ *  $> ./mtcl-mr-multi client TCP:localhost:13000 -p 1,2,4,8,16 -t 1,2,4
+ *
+ * Client options:
+ *   -p list   numbers of pairs (default 1,2,4,8)
+ *   -t list   numbers of sender threads, runs with more threads than pairs
+ *             are skipped (default 1,2,4)
+ *   -W n      window size (default 64)
+ *   -s size   message size in bytes (default 8)
+ *   -w n      warm-up windows per pair, not measured (default 10)
+ *   -i n      measured windows per pair (default 1000)
+ *   -r n      repetitions of each run (default 3)
+ *   -o fmt    output format: table, csv or json (default table)
+ *
+ * With SINGLE_IO_THREAD Manager::getNext cannot be called concurrently,
+ * thus the server uses a single receiver thread unless -d is given.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include "mtcl.hpp"
+#include "bench.hpp"
+
+// run description sent by each client on its control connection
+struct Run {
+	int32_t  pairs;
+	int32_t  window;
+	int32_t  warmup;
+	int32_t  iters;
+	uint64_t size;
+};
+
+static bool sendMsg(HandleUser& h, const void* buff, size_t size) {
+	if (h.send(buff, size) != (ssize_t)size) {
+		MTCL_ERROR("[mtcl-mr-multi]:\t", "send error, errno=%d (%s)\n", errno, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static bool recvMsg(HandleUser& h, void* buff, size_t size) {
+	if (h.receive(buff, size) != (ssize_t)size) {
+		MTCL_ERROR("[mtcl-mr-multi]:\t", "receive error, errno=%d (%s)\n", errno, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static std::vector<int> parse_list(const std::string& s) {
+	std::vector<int> v;
+	std::istringstream is(s);
+	std::string item;
+	while(std::getline(is, item, ','))
+		if (!item.empty()) v.push_back(std::stoi(item));
+	return v;
+}
+
+// simple reusable barrier for a fixed number of threads
+class Barrier {
+	std::mutex mtx;
+	std::condition_variable cv;
+	int n, waiting = 0, generation = 0;
+public:
+	Barrier(int n) : n(n) {}
+	void wait() {
+		std::unique_lock lk(mtx);
+		int gen = generation;
+		if (++waiting == n) {
+			waiting = 0;
+			++generation;
+			cv.notify_all();
+		} else cv.wait(lk, [&]{ return gen != generation; });
+	}
+};
+
+// receives one window and sends the acknowledgement
+static bool serveWindow(HandleUser& h, const Run& run, char* buff) {
+	int32_t ack = 0;
+	for(int i = 0; i < run.window; ++i)
+		if (!recvMsg(h, buff, run.size)) return false;
+	return sendMsg(h, &ack, sizeof(ack));
+}
+
+/* ------------------------------- server ---------------------------------- */
+
+struct ServerState {
+	std::mutex mtx;
+	std::condition_variable cv;
+	Run run;
+	std::atomic<long> connected{0};  // data connections of the current run
+	std::atomic<long> open{0};       // data connections not closed yet
+	long served = 0;                 // windows served in the current run
+	long expected = 0;               // windows expected in the current run
+	std::atomic<bool> stop{false};
+};
+
+// receiver thread using Manager::getNext
+static void getNextReceiver(ServerState& st) {
+	std::vector<char> buff;
+	while(!st.stop) {
+		auto h = Manager::getNext(std::chrono::milliseconds(10));
+		if (!h.isValid()) continue;
+		if (h.isNewConnection()) {
+			// the data are sent only when all the pairs are connected
+			st.connected++;
+			st.open++;
+			continue;
+		}
+		size_t sz;
+		if (h.probe(sz) <= 0) { // EOS, end of the run for this pair
+			h.close();
+			st.open--;
+			continue;
+		}
+		Run run;
+		{
+			std::unique_lock lk(st.mtx);
+			run = st.run;
+		}
+		if (buff.size() < run.size) buff.resize(run.size);
+		if (!serveWindow(h, run, buff.data())) {
+			h.close();
+			st.open--;
+			continue;
+		}
+		std::unique_lock lk(st.mtx);
+		if (++st.served == st.expected) st.cv.notify_all();
+	}
+}
+
+// receiver thread owning some pairs (-d)
+static void directReceiver(std::vector<HandleUser>& handles, const Run& run) {
+	std::vector<char> buff(run.size);
+	for(int i = 0; i < run.warmup + run.iters; ++i)
+		for(auto& h : handles)
+			if (!serveWindow(h, run, buff.data())) return;
+	char c;
+	for(auto& h : handles) {
+		h.receive(&c, 1); // EOS
+		h.close();
+	}
+}
+
+static int server(const std::string& uri, int receivers, bool direct, int nclients, bench::Format fmt) {
+	if (Manager::listen(uri) == -1) {
+		MTCL_ERROR("[mtcl-mr-multi]:\t", "listen on %s failed, errno=%d (%s)\n", uri.c_str(), errno, strerror(errno));
+		return -1;
+	}
+#if defined(SINGLE_IO_THREAD)
+	if (!direct && receivers > 1) {
+		MTCL_PRINT(0, "[mtcl-mr-multi]:\t", "SINGLE_IO_THREAD, using one receiver thread\n");
+		receivers = 1;
+	}
+#endif
+	std::vector<HandleUser> controls;
+	while((int)controls.size() < nclients) {
+		auto h = Manager::getNext();
+		if (h.isNewConnection()) controls.push_back(std::move(h));
+	}
+
+	ServerState st;
+	std::vector<std::thread> threads;
+	if (!direct)
+		for(int i = 0; i < receivers; ++i)
+			threads.emplace_back(getNextReceiver, std::ref(st));
+
+	bench::Reporter rep(fmt, {"test", "transport", "pairs", "receivers"});
+	if (nclients > 1) rep.begin();
+	while(true) {
+		// all the clients describe the next run
+		Run run{0, 0, 0, 0, 0}, r;
+		bool stop = false;
+		for(auto& c : controls) {
+			if (c.receive(&r, sizeof(r)) != sizeof(r)) { stop = true; break; }
+			run.pairs += r.pairs;
+			run.window = r.window; run.warmup = r.warmup; run.iters = r.iters; run.size = r.size;
+		}
+		if (stop) break;
+		{
+			std::unique_lock lk(st.mtx);
+			st.run = run;
+			st.served = 0;
+			st.expected = (long)run.pairs * (run.warmup + run.iters);
+			st.connected = 0;
+		}
+		int32_t token = 0;
+		for(auto& c : controls) sendMsg(c, &token, sizeof(token));  // ready
+
+		std::vector<HandleUser> data;
+		if (direct) {
+			while((int)data.size() < run.pairs) {
+				auto h = Manager::getNext();
+				if (h.isNewConnection()) data.push_back(std::move(h));
+			}
+		} else {
+			while(st.connected < run.pairs)
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+		auto start = bench::Clock::now();
+		for(auto& c : controls) sendMsg(c, &token, sizeof(token));  // go
+		if (direct) {
+			int n = std::min(receivers, run.pairs);
+			std::vector<std::vector<HandleUser>> parts(n);
+			for(size_t i = 0; i < data.size(); ++i) parts[i % n].push_back(std::move(data[i]));
+			std::vector<std::thread> th;
+			for(auto& p : parts) th.emplace_back(directReceiver, std::ref(p), std::cref(run));
+			for(auto& t : th) t.join();
+		} else {
+			std::unique_lock lk(st.mtx);
+			st.cv.wait(lk, [&]{ return st.served == st.expected; });
+		}
+		double us = bench::elapsed_us(start, bench::Clock::now());
+		if (nclients > 1)
+			rep.row({"mr-aggregate", uri.substr(0, uri.find(':')), std::to_string(run.pairs),
+					 std::to_string(direct ? std::min(receivers, run.pairs) : receivers)},
+					run.size, "msg/s", bench::summarize({st.expected * run.window * 1e6 / us}, true));
+	}
+	if (nclients > 1) rep.end();
+	// the other clients may be still closing their pairs
+	while(st.open > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	st.stop = true;
+	for(auto& t : threads) t.join();
+	for(auto& c : controls) c.close();
+	return 0;
+}
+
+/* ------------------------------- client ---------------------------------- */
+
+// sender thread: windows on its pairs, round robin
+static void sender(std::vector<HandleUser*> pairs, const Run& run, Barrier& warm, Barrier& done,
+				   std::atomic<bool>& ok) {
+	std::vector<char> buff(run.size, 'a');
+	int32_t ack;
+	auto windows = [&](int n) {
+		for(int i = 0; i < n && ok; ++i) {
+			for(auto h : pairs)
+				for(int j = 0; j < run.window; ++j)
+					if (!sendMsg(*h, buff.data(), run.size)) { ok = false; return; }
+			for(auto h : pairs)
+				if (!recvMsg(*h, &ack, sizeof(ack))) { ok = false; return; }
+		}
+	};
+	windows(run.warmup);
+	warm.wait();
+	windows(run.iters);
+	done.wait();
+}
+
+// one run with the given number of pairs and threads, returns the rate (msg/s) or -1
+static double clientRun(HandleUser& ctrl, const std::string& uri, const Run& run, int nthreads) {
+	int32_t token;
+	if (!sendMsg(ctrl, &run, sizeof(run)) || !recvMsg(ctrl, &token, sizeof(token))) return -1;
+	std::vector<HandleUser> pairs;
+	for(int i = 0; i < run.pairs; ++i) {
+		auto h = Manager::connect(uri);
+		if (!h.isValid()) {
+			MTCL_ERROR("[mtcl-mr-multi]:\t", "cannot connect to %s\n", uri.c_str());
+			return -1;
+		}
+		pairs.push_back(std::move(h));
+	}
+	if (!recvMsg(ctrl, &token, sizeof(token))) return -1;
+
+	std::vector<std::vector<HandleUser*>> parts(nthreads);
+	for(size_t i = 0; i < pairs.size(); ++i) parts[i % nthreads].push_back(&pairs[i]);
+	Barrier warm(nthreads + 1), done(nthreads + 1);
+	std::atomic<bool> ok{true};
+	std::vector<std::thread> threads;
+	for(auto& p : parts) threads.emplace_back(sender, p, std::cref(run), std::ref(warm), std::ref(done), std::ref(ok));
+	warm.wait();
+	auto start = bench::Clock::now();
+	done.wait();
+	double us = bench::elapsed_us(start, bench::Clock::now());
+	for(auto& t : threads) t.join();
+	char c;
+	for(auto& h : pairs) {
+		h.close();
+		h.receive(&c, 1);  // EOS from the server
+	}
+	return ok ? (double)run.pairs * run.iters * run.window * 1e6 / us : -1;
+}
+
+static int client(const std::string& uri, const std::vector<int>& npairs, const std::vector<int>& nthreads,
+				  Run run, int reps, bench::Format fmt) {
+	HandleUser ctrl;
+	for(int i = 0; i < 50 && !ctrl.isValid(); ++i) {
+		ctrl = Manager::connect(uri);
+		if (!ctrl.isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+	if (!ctrl.isValid()) {
+		MTCL_ERROR("[mtcl-mr-multi]:\t", "cannot connect to %s\n", uri.c_str());
+		return -1;
+	}
+	bench::Reporter rep(fmt, {"test", "transport", "pairs", "threads", "efficiency"});
+	rep.begin();
+	double base = 0;
+	int basePairs = 0;
+	for(int p : npairs)
+		for(int t : nthreads) {
+			if (t > p) continue;
+			run.pairs = p;
+			std::vector<double> rates;
+			for(int r = 0; r < reps; ++r) {
+				double rate = clientRun(ctrl, uri, run, t);
+				if (rate < 0) {
+					rep.end();
+					return -1;
+				}
+				rates.push_back(rate);
+			}
+			auto s = bench::summarize(rates, true);
+			if (base == 0) { base = s.median; basePairs = p; }
+			char eff[16];
+			std::snprintf(eff, sizeof(eff), "%.2f", s.median / (base * p / basePairs));
+			rep.row({"mr", uri.substr(0, uri.find(':')), std::to_string(p), std::to_string(t), eff},
+					run.size, "msg/s", s);
+		}
+	rep.end();
+	ctrl.close();
+	return 0;
+}
+
+static void usage(const char* name) {
+	std::cerr << "Usage:\n"
+			  << "  " << name << " server <URI> [-t receivers] [-d] [-c clients] [-o table|csv|json]\n"
+			  << "  " << name << " client <URI> [-p pairs,...] [-t threads,...] [-W window] [-s size]\n"
+			  << "        [-w warmup] [-i iterations] [-r repetitions] [-o table|csv|json]\n";
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		usage(argv[0]);
+		return -1;
+	}
+	std::string role{argv[1]}, uri{argv[2]};
+	if (role != "server" && role != "client") {
+		usage(argv[0]);
+		return -1;
+	}
+	std::vector<int> npairs{1, 2, 4, 8}, nthreads{1, 2, 4};
+	Run run{0, 64, 10, 1000, 8};
+	int reps = 3, nclients = 1;
+	bool direct = false;
+	bench::Format fmt = bench::Format::TABLE;
+
+	optind = 3;
+	int opt;
+	while((opt = getopt(argc, argv, "p:t:W:s:w:i:r:c:do:")) != -1) {
+		switch(opt) {
+		case 'p': npairs   = parse_list(optarg); break;
+		case 't': nthreads = parse_list(optarg); break;
+		case 'W': run.window = std::stoi(optarg); break;
+		case 's': run.size   = bench::parse_size(optarg); break;
+		case 'w': run.warmup = std::stoi(optarg); break;
+		case 'i': run.iters  = std::stoi(optarg); break;
+		case 'r': reps     = std::stoi(optarg); break;
+		case 'c': nclients = std::stoi(optarg); break;
+		case 'd': direct   = true; break;
+		case 'o':
+			if (bench::parse_format(optarg, fmt)) break;
+			[[fallthrough]];
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (npairs.empty() || nthreads.empty() || run.size == 0 || run.window < 1 ||
+		run.iters < 1 || run.warmup < 0 || reps < 1 || nclients < 1) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	Manager::init("mtcl-mr-multi-" + role + std::to_string(getpid()));
+	int r = role == "server" ? server(uri, nthreads[0], direct, nclients, fmt)
+		                     : client(uri, npairs, nthreads, run, reps, fmt);
+	Manager::finalize(true);
+	return r;
+}
@@ -0,0 +1,289 @@
+/*
+ * Open-loop latency: the client sends requests at a fixed target rate,
+ * independently of the replies, and the server echoes them back.
+ *
+ * A sender thread issues request i at its intended time start + i/rate while
+ * the main thread receives the replies and records the latencies into
+ * histograms. Each request carries its intended and its actual send time,
+ * only the client clock is used:
+ *
+ *   corrected   reply time - intended send time. When the sender is delayed
+ *               (a send blocks, the server or the IO thread queue up) the
+ *               requests that should have been sent in the meantime are
+ *               accounted for the time they waited, i.e., the measure is not
+ *               affected by coordinated omission.
+ *   raw         reply time - actual send time, what a closed-loop benchmark
+ *               would report.
+ *
+ * For each load level (target rate) the client reports the achieved rate and
+ * the p50/p99/p99.9/max latencies in microseconds. The server either receives
+ * directly from the handle (default) or goes through Manager::getNext for
+ * every request (-n), that is, through the IO thread and the ready queue.
+ *
+ * === Compilation ===
+ *
+ *  $> make mtcl-openloop
+ *  $> make SINGLE_IO_THREAD=1 mtcl-openloop
+ *
+ * === Execution ===
+ *
+ *  $> ./mtcl-openloop server <URI> [-n]
+ *  $> ./mtcl-openloop client <URI> [-R rates] [-s size] [-d seconds] [-w seconds] [-o fmt]
+ *
+ *  e.g.
+ *  $> ./mtcl-openloop server TCP:0.0.0.0:13000 -n &
+ *  $> ./mtcl-openloop client TCP:localhost:13000 -R 1000,10000,100000 -d 10
+ *
+ * Client options:
+ *   -R list   target rates in requests per second (default 1000,10000,50000)
+ *   -s size   request size in bytes, at least 24 (default 64)
+ *   -d sec    measured seconds of each load level (default 5)
+ *   -w sec    warm-up seconds of each load level, not measured (default 1)
+ *   -o fmt    output format: table, csv or json (default table)
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include "mtcl.hpp"
+#include "bench.hpp"
+
+// header of every request, the rest of the message is padding
+struct Request {
+	uint64_t seq;
+	int64_t  intended;  // ns, client clock
+	int64_t  sent;      // ns, client clock
+};
+
+static inline int64_t now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		bench::Clock::now().time_since_epoch()).count();
+}
+
+static std::vector<double> parse_list(const std::string& s) {
+	std::vector<double> v;
+	std::istringstream is(s);
+	std::string item;
+	while(std::getline(is, item, ','))
+		if (!item.empty()) v.push_back(std::stod(item));
+	return v;
+}
+
+/* ------------------------------- server ---------------------------------- */
+
+// echoes one request, returns false at the end of the stream
+static bool echo(HandleUser& h, std::vector<char>& buff) {
+	size_t sz;
+	if (h.probe(sz) <= 0 || sz == 0) return false;
+	if (buff.size() < sz) buff.resize(sz);
+	if (h.receive(buff.data(), sz) != (ssize_t)sz ||
+		h.send(buff.data(), sz) != (ssize_t)sz) {
+		MTCL_ERROR("[mtcl-openloop]:\t", "echo error, errno=%d (%s)\n", errno, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static int server(const std::string& uri, bool useGetNext) {
+	if (Manager::listen(uri) == -1) {
+		MTCL_ERROR("[mtcl-openloop]:\t", "listen on %s failed, errno=%d (%s)\n", uri.c_str(), errno, strerror(errno));
+		return -1;
+	}
+	std::vector<char> buff(sizeof(Request));
+	if (!useGetNext) {
+		auto h = Manager::getNext();
+		while(echo(h, buff));
+		h.close();
+		return 0;
+	}
+	// every request goes back to the Manager and through the ready queue
+	while(true) {
+		auto h = Manager::getNext();
+		if (h.isNewConnection()) continue;
+		if (!echo(h, buff)) {
+			h.close();
+			break;
+		}
+	}
+	return 0;
+}
+
+/* ------------------------------- client ---------------------------------- */
+
+struct Level {
+	double   rate;       // target, requests per second
+	uint64_t warmup;     // requests not measured
+	uint64_t total;      // requests sent
+	double   achieved;   // measured requests per second
+	bench::Histogram corrected, raw;
+};
+
+static bool runLevel(HandleUser& h, Level& l, size_t size) {
+	const double interval = 1e9 / l.rate;
+	std::vector<char> sbuff(size, 'a'), rbuff(size);
+	bool sendok = true;
+	int64_t first = 0, last = 0;
+
+	std::thread sender([&]() {
+		int64_t start = now_ns() + 1000000;
+		Request* req = reinterpret_cast<Request*>(sbuff.data());
+		for(uint64_t i = 0; i < l.total && sendok; ++i) {
+			int64_t intended = start + (int64_t)(i * interval);
+			int64_t t = now_ns();
+			// sleeping is too coarse for short intervals, spinning the last 100us
+			if (intended - t > 200000)
+				std::this_thread::sleep_for(std::chrono::nanoseconds(intended - t - 100000));
+			while((t = now_ns()) < intended);
+			if (i == l.warmup) first = t;
+			req->seq = i;
+			req->intended = intended;
+			req->sent = t;
+			sendok = h.send(sbuff.data(), size) == (ssize_t)size;
+		}
+		last = now_ns();
+	});
+
+	bool recvok = true;
+	for(uint64_t i = 0; i < l.total; ++i) {
+		if (h.receive(rbuff.data(), size) != (ssize_t)size) {
+			recvok = false;
+			break;
+		}
+		int64_t t = now_ns();
+		const Request* rep = reinterpret_cast<const Request*>(rbuff.data());
+		if (rep->seq < l.warmup) continue;
+		l.corrected.record(t - rep->intended);
+		l.raw.record(t - rep->sent);
+	}
+	if (!recvok) MTCL_ERROR("[mtcl-openloop]:\t", "receive error, errno=%d (%s)\n", errno, strerror(errno));
+	sender.join();
+	if (!sendok) MTCL_ERROR("[mtcl-openloop]:\t", "send error, errno=%d (%s)\n", errno, strerror(errno));
+
+	l.achieved = (last > first) ? (l.total - l.warmup) * 1e9 / (last - first) : 0;
+	return sendok && recvok;
+}
+
+static void begin(bench::Format fmt) {
+	switch(fmt) {
+	case bench::Format::TABLE:
+		std::printf("%-10s %10s %10s %8s %-9s %10s %10s %10s %10s %10s %10s\n", "transport", "rate",
+					"achieved", "size", "latency", "samples", "mean", "p50", "p99", "p99.9", "max");
+		break;
+	case bench::Format::CSV:
+		std::printf("transport,rate,achieved,size,latency,samples,mean,p50,p99,p99.9,max\n");
+		break;
+	case bench::Format::JSON:
+		std::printf("[\n");
+		break;
+	}
+}
+
+// latencies in microseconds
+static void row(bench::Format fmt, const std::string& transport, const Level& l, size_t size,
+				const char* kind, const bench::Histogram& hg, bool first) {
+	double v[] = {hg.mean() / 1e3, hg.percentile(50) / 1e3, hg.percentile(99) / 1e3,
+				  hg.percentile(99.9) / 1e3, hg.max() / 1e3};
+	switch(fmt) {
+	case bench::Format::TABLE:
+		std::printf("%-10s %10.0f %10.0f %8zu %-9s %10lu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+					transport.c_str(), l.rate, l.achieved, size, kind, hg.count(),
+					v[0], v[1], v[2], v[3], v[4]);
+		break;
+	case bench::Format::CSV:
+		std::printf("%s,%.0f,%.0f,%zu,%s,%lu,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+					transport.c_str(), l.rate, l.achieved, size, kind, hg.count(),
+					v[0], v[1], v[2], v[3], v[4]);
+		break;
+	case bench::Format::JSON:
+		std::printf("%s  {\"transport\": \"%s\", \"rate\": %.0f, \"achieved\": %.0f, \"size\": %zu, "
+					"\"latency\": \"%s\", \"samples\": %lu, \"unit\": \"us\", \"mean\": %.3f, "
+					"\"p50\": %.3f, \"p99\": %.3f, \"p99.9\": %.3f, \"max\": %.3f}",
+					first ? "" : ",\n", transport.c_str(), l.rate, l.achieved, size, kind,
+					hg.count(), v[0], v[1], v[2], v[3], v[4]);
+		break;
+	}
+	std::fflush(stdout);
+}
+
+static int client(const std::string& uri, const std::vector<double>& rates, size_t size,
+				  double seconds, double warmup, bench::Format fmt) {
+	HandleUser h;
+	for(int i = 0; i < 50 && !h.isValid(); ++i) {
+		h = Manager::connect(uri);
+		if (!h.isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	}
+	if (!h.isValid()) {
+		MTCL_ERROR("[mtcl-openloop]:\t", "cannot connect to %s\n", uri.c_str());
+		return -1;
+	}
+	std::string transport = uri.substr(0, uri.find(':'));
+	bool ok = true, first = true;
+	begin(fmt);
+	for(auto rate : rates) {
+		Level l;
+		l.rate   = rate;
+		l.warmup = (uint64_t)(rate * warmup);
+		l.total  = l.warmup + std::max<uint64_t>(1, (uint64_t)(rate * seconds));
+		if (!(ok = runLevel(h, l, size))) break;
+		row(fmt, transport, l, size, "corrected", l.corrected, first);
+		row(fmt, transport, l, size, "raw", l.raw, false);
+		first = false;
+	}
+	if (fmt == bench::Format::JSON) std::printf("%s]\n", first ? "" : "\n");
+	h.close();
+	return ok ? 0 : -1;
+}
+
+static void usage(const char* name) {
+	std::cerr << "Usage:\n"
+			  << "  " << name << " server <URI> [-n]\n"
+			  << "  " << name << " client <URI> [-R rates] [-s size] [-d seconds] [-w seconds]"
+			  << " [-o table|csv|json]\n";
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		usage(argv[0]);
+		return -1;
+	}
+	std::string cmd{argv[1]}, uri{argv[2]};
+	if (cmd != "server" && cmd != "client") {
+		usage(argv[0]);
+		return -1;
+	}
+	std::vector<double> rates{1000, 10000, 50000};
+	size_t size = 64;
+	double seconds = 5, warmup = 1;
+	bool useGetNext = false;
+	bench::Format fmt = bench::Format::TABLE;
+
+	optind = 3;
+	int opt;
+	while((opt = getopt(argc, argv, "nR:s:d:w:o:")) != -1) {
+		switch(opt) {
+		case 'n': useGetNext = true; break;
+		case 'R': rates   = parse_list(optarg); break;
+		case 's': size    = bench::parse_size(optarg); break;
+		case 'd': seconds = std::stod(optarg); break;
+		case 'w': warmup  = std::stod(optarg); break;
+		case 'o':
+			if (bench::parse_format(optarg, fmt)) break;
+			[[fallthrough]];
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (size < sizeof(Request) || seconds <= 0 || warmup < 0 || rates.empty() ||
+		std::any_of(rates.begin(), rates.end(), [](double r) { return r <= 0; })) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	Manager::init(cmd == "server" ? "mtcl-openloop-server" : "mtcl-openloop-client");
+	int r = cmd == "server" ? server(uri, useGetNext) : client(uri, rates, size, seconds, warmup, fmt);
+	Manager::finalize(true);
+	return r;
+}
@@ -0,0 +1,370 @@
+/*
+ * Replays on the local machine the traffic recorded with MTCL_CAPTURE (see
+ * include/capture.hpp): the sizes and the timing of the sends and the shape
+ * of the communication, over any transport compiled in the library.
+ *
+ * Each capture file (one per process of the original run) becomes a sender
+ * process, which opens one connection for each of its captured handles and
+ * repeats their sends at the same times. The handles are grouped in
+ * destinations: the handles connected to the same URI, otherwise the ones
+ * with the same name, otherwise each handle by itself (e.g., the accepted
+ * connections, whose peer is not known). Each destination becomes a
+ * receiver process, thus the fan-in (many handles to one destination) and
+ * the fan-out (one process sending to many destinations) of the original
+ * run are preserved. The sends are aligned across the files using the start
+ * time recorded in each of them.
+ *
+ * === Compilation ===
+ *
+ *  $> make mtcl-replay
+ *
+ *  the captured application is compiled with -DMTCL_ENABLE_CAPTURE
+ *
+ * === Execution ===
+ *
+ *  $> MTCL_CAPTURE=/tmp/app-%a.cap ./app ...
+ *  $> ./mtcl-replay info /tmp/app-*.cap
+ *  $> ./mtcl-replay run <URI> /tmp/app-*.cap [options]
+ *
+ *  e.g.
+ *  $> ./mtcl-replay run TCP:localhost:13000 /tmp/app-*.cap -s 2
+ *  $> ./mtcl-replay run SHM:/replay /tmp/app-*.cap -n -o csv
+ *
+ * The k-th destination listens to the URI with k added to its trailing
+ * number (TCP:localhost:13000, TCP:localhost:13001, ...) or, if it does not
+ * end with a number, with "-k" appended (SHM:/replay-0, SHM:/replay-1, ...).
+ *
+ * Options (run):
+ *   -s speed   time scale of the replay, 2 sends twice as fast (default 1)
+ *   -n         no timing, every sender sends as fast as possible
+ *   -o fmt     output format: table, csv or json (default table)
+ *
+ * For every sender the tool reports the time taken by the replay and by
+ * the original run, and how late the sends were with respect to their
+ * schedule; for every receiver the messages and the bytes received. The
+ * captured zero-size sends are replayed as 1-byte messages, an empty
+ * message is an EOS for the library.
+ */
+
+#include <csignal>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "mtcl.hpp"
+#include "bench.hpp"
+
+// a captured handle and where it is replayed
+struct Flow {
+	uint32_t id;
+	size_t dest;
+};
+
+struct Plan {
+	std::vector<std::string> files;
+	std::vector<capture::File> captures;
+	std::vector<std::vector<Flow>> flows;     // per file
+	std::vector<std::string> dests;           // destination keys
+	std::vector<int> connections;             // per destination
+	uint64_t epoch = 0;                       // earliest start
+};
+
+// sent by each child to the parent through a pipe (atomic, < PIPE_BUF)
+struct Result {
+	int32_t  sender;   // 1 sender, 0 receiver
+	int32_t  index;    // file or destination
+	int32_t  ok;
+	uint64_t msgs, bytes;
+	double   seconds;
+	double   late_avg, late_p99, late_max;   // us, senders only
+};
+
+static bool load(Plan& plan) {
+	std::map<std::string, size_t> keys;
+	plan.captures.resize(plan.files.size());
+	plan.flows.resize(plan.files.size());
+	for(size_t i = 0; i < plan.files.size(); ++i) {
+		auto& c = plan.captures[i];
+		if (!c.load(plan.files[i])) {
+			MTCL_ERROR("[mtcl-replay]:\t", "cannot read the capture file %s\n", plan.files[i].c_str());
+			return false;
+		}
+		if (i == 0 || c.epoch < plan.epoch) plan.epoch = c.epoch;
+		for(auto& [id, h] : c.handles) {
+			std::string key = !h.peer.empty() ? h.peer :
+				h.name != "no-name-provided" ? h.name :
+				plan.files[i] + "#" + std::to_string(id);
+			auto it = keys.find(key);
+			if (it == keys.end()) {
+				it = keys.emplace(key, plan.dests.size()).first;
+				plan.dests.push_back(key);
+				plan.connections.push_back(0);
+			}
+			plan.connections[it->second]++;
+			plan.flows[i].push_back({id, it->second});
+		}
+	}
+	return true;
+}
+
+static std::string destURI(const std::string& base, size_t k) {
+	size_t p = base.find_last_not_of("0123456789");
+	if (p == std::string::npos || p + 1 == base.size())
+		return base + "-" + std::to_string(k);
+	return base.substr(0, p + 1) + std::to_string(std::stoul(base.substr(p + 1)) + k);
+}
+
+static std::string basename(const std::string& path) {
+	size_t p = path.rfind('/');
+	return p == std::string::npos ? path : path.substr(p + 1);
+}
+
+static int info(Plan& plan, bench::Format fmt) {
+	bench::Table t(fmt, {"file", "handle", "name", "protocol", "dest", "msgs", "bytes",
+						 "avg_size", "max_size", "seconds"});
+	t.begin();
+	for(size_t i = 0; i < plan.files.size(); ++i) {
+		auto& c = plan.captures[i];
+		for(auto& f : plan.flows[i]) {
+			uint64_t msgs = 0, bytes = 0, max = 0, first = 0, last = 0;
+			for(auto& s : c.sends) {
+				if (s.id != f.id) continue;
+				if (!msgs) first = s.ns;
+				last = s.ns;
+				msgs++;
+				bytes += s.size;
+				max = std::max<uint64_t>(max, s.size);
+			}
+			auto& h = c.handles[f.id];
+			t.row({basename(plan.files[i]), std::to_string(f.id), h.name, h.protocol,
+				   std::to_string(f.dest), std::to_string(msgs), std::to_string(bytes),
+				   bench::num(msgs ? (double)bytes / msgs : 0), std::to_string(max),
+				   bench::num((last - first) / 1e9, 3)});
+		}
+	}
+	t.end();
+	return 0;
+}
+
+static void report(int fd, const Result& r) {
+	if (write(fd, &r, sizeof(r)) != sizeof(r))
+		MTCL_ERROR("[mtcl-replay]:\t", "cannot send the result to the parent, errno=%d\n", errno);
+}
+
+// receives from all the connections of a destination until they are closed
+static Result receiver(const std::string& uri, size_t k, int connections) {
+	Result r{0, (int32_t)k, 0, 0, 0, 0, 0, 0, 0};
+	if (Manager::listen(uri) == -1) {
+		MTCL_ERROR("[mtcl-replay]:\t", "listen on %s failed, errno=%d (%s)\n", uri.c_str(), errno, strerror(errno));
+		return r;
+	}
+	std::vector<char> buff;
+	bench::Clock::time_point start;
+	int closed = 0;
+	while(closed < connections) {
+		auto h = Manager::getNext();
+		if (h.isNewConnection()) continue;
+		size_t size;
+		if (h.probe(size, true) < 0) {
+			MTCL_ERROR("[mtcl-replay]:\t", "probe error on %s, errno=%d (%s)\n", uri.c_str(), errno, strerror(errno));
+			return r;
+		}
+		if (size == 0) {  // EOS
+			h.close();
+			closed++;
+			continue;
+		}
+		if (buff.size() < size) buff.resize(size);
+		if (h.receive(buff.data(), size) != (ssize_t)size) {
+			MTCL_ERROR("[mtcl-replay]:\t", "receive error on %s, errno=%d (%s)\n", uri.c_str(), errno, strerror(errno));
+			return r;
+		}
+		if (!r.msgs) start = bench::Clock::now();
+		r.msgs++;
+		r.bytes += size;
+		r.seconds = bench::elapsed_us(start, bench::Clock::now()) / 1e6;
+	}
+	r.ok = 1;
+	return r;
+}
+
+// replays the sends of a file, starting when the parent closes the go pipe
+static Result sender(const Plan& plan, size_t i, const std::vector<std::string>& uris,
+					 double speed, bool timing, int ready, int go) {
+	Result r{1, (int32_t)i, 0, 0, 0, 0, 0, 0, 0};
+	const auto& c = plan.captures[i];
+	std::map<uint32_t, HandleUser> handles;
+	for(auto& f : plan.flows[i]) {
+		HandleUser h;
+		for(int n = 0; n < 50 && !h.isValid(); ++n) {
+			h = Manager::connect(uris[f.dest]);
+			if (!h.isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		}
+		if (!h.isValid()) {
+			MTCL_ERROR("[mtcl-replay]:\t", "cannot connect to %s\n", uris[f.dest].c_str());
+			return r;
+		}
+		handles[f.id] = std::move(h);
+	}
+	char c0 = 0;
+	if (write(ready, &c0, 1) != 1 || read(go, &c0, 1) != 0) return r;
+
+	size_t maxsize = 1;
+	for(auto& s : c.sends) maxsize = std::max<size_t>(maxsize, s.size);
+	std::vector<char> buff(maxsize, 'a');
+	std::vector<double> late;
+	if (timing) late.reserve(c.sends.size());
+	const double offset = c.epoch - plan.epoch;
+	auto start = bench::Clock::now();
+	for(auto& s : c.sends) {
+		if (timing) {
+			auto at = start + std::chrono::nanoseconds((int64_t)((offset + s.ns) / speed));
+			std::this_thread::sleep_until(at);
+			late.push_back(std::max(0.0, bench::elapsed_us(at, bench::Clock::now())));
+		}
+		size_t size = std::max<size_t>(s.size, 1);
+		if (handles[s.id].send(buff.data(), size) != (ssize_t)size) {
+			MTCL_ERROR("[mtcl-replay]:\t", "send error, errno=%d (%s)\n", errno, strerror(errno));
+			return r;
+		}
+		r.msgs++;
+		r.bytes += size;
+	}
+	r.seconds = bench::elapsed_us(start, bench::Clock::now()) / 1e6;
+	for(auto& [_, h] : handles) h.close();
+	auto st = bench::summarize(late);
+	r.late_avg = st.avg;
+	r.late_p99 = st.p99;
+	r.late_max = st.max;
+	r.ok = 1;
+	return r;
+}
+
+static int run(Plan& plan, const std::string& base, double speed, bool timing, bench::Format fmt) {
+	std::vector<std::string> uris;
+	for(size_t k = 0; k < plan.dests.size(); ++k) uris.push_back(destURI(base, k));
+
+	int results[2], ready[2], go[2];
+	if (pipe(results) < 0 || pipe(ready) < 0 || pipe(go) < 0) {
+		MTCL_ERROR("[mtcl-replay]:\t", "pipe failed, errno=%d\n", errno);
+		return -1;
+	}
+	std::vector<pid_t> receivers, senders;
+	for(size_t k = 0; k < plan.dests.size(); ++k) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(results[0]); close(ready[0]); close(ready[1]); close(go[0]); close(go[1]);
+			Manager::init("mtcl-replay-recv-" + std::to_string(k));
+			Result r = receiver(uris[k], k, plan.connections[k]);
+			Manager::finalize(true);
+			report(results[1], r);
+			_exit(r.ok ? 0 : 1);
+		}
+		receivers.push_back(pid);
+	}
+	for(size_t i = 0; i < plan.files.size(); ++i) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(results[0]); close(ready[0]); close(go[1]);
+			Manager::init("mtcl-replay-send-" + std::to_string(i));
+			Result r = sender(plan, i, uris, speed, timing, ready[1], go[0]);
+			Manager::finalize(true);
+			report(results[1], r);
+			_exit(r.ok ? 0 : 1);
+		}
+		senders.push_back(pid);
+	}
+	close(results[1]); close(ready[1]); close(go[0]);
+
+	// all the senders start together, once connected (EOF if one fails)
+	char c;
+	for(size_t i = 0; i < senders.size(); ++i)
+		if (read(ready[0], &c, 1) != 1) break;
+	close(go[1]);
+
+	bool ok = true;
+	for(auto pid : senders) {
+		int status;
+		waitpid(pid, &status, 0);
+		ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+	if (!ok)  // the receivers would wait for the missing connections
+		for(auto pid : receivers) kill(pid, SIGTERM);
+	for(auto pid : receivers) {
+		int status;
+		waitpid(pid, &status, 0);
+		ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	std::vector<Result> rs;
+	for(Result r; read(results[0], &r, sizeof(r)) == sizeof(r); ) rs.push_back(r);
+	close(results[0]); close(ready[0]);
+	std::sort(rs.begin(), rs.end(), [](const Result& a, const Result& b) {
+		return a.sender != b.sender ? a.sender > b.sender : a.index < b.index;
+	});
+
+	bench::Table t(fmt, {"role", "name", "msgs", "bytes", "seconds", "orig_sec",
+						 "late_avg_us", "late_p99_us", "late_max_us"});
+	t.begin();
+	for(auto& r : rs) {
+		if (r.sender) {
+			auto& s = plan.captures[r.index].sends;
+			double orig = s.empty() ? 0 : (s.back().ns - s.front().ns) / 1e9;
+			t.row({"sender", basename(plan.files[r.index]), std::to_string(r.msgs), std::to_string(r.bytes),
+				   bench::num(r.seconds, 3), bench::num(orig, 3),
+				   timing ? bench::num(r.late_avg) : "-", timing ? bench::num(r.late_p99) : "-",
+				   timing ? bench::num(r.late_max) : "-"});
+		} else {
+			t.row({"receiver", uris[r.index], std::to_string(r.msgs), std::to_string(r.bytes),
+				   bench::num(r.seconds, 3), "-", "-", "-", "-"});
+		}
+	}
+	t.end();
+	if (!ok) MTCL_ERROR("[mtcl-replay]:\t", "the replay failed\n");
+	return ok ? 0 : -1;
+}
+
+static void usage(const char* name) {
+	std::cerr << "Usage:\n"
+			  << "  " << name << " info <capture>... [-o table|csv|json]\n"
+			  << "  " << name << " run <URI> <capture>... [-s speed] [-n] [-o table|csv|json]\n";
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		usage(argv[0]);
+		return -1;
+	}
+	std::string cmd{argv[1]};
+	if (cmd != "info" && cmd != "run") {
+		usage(argv[0]);
+		return -1;
+	}
+	std::string uri;
+	Plan plan;
+	double speed = 1;
+	bool timing = true;
+	bench::Format fmt = bench::Format::TABLE;
+
+	// files and options may be interleaved
+	for(int i = 2; i < argc; ++i) {
+		std::string a{argv[i]};
+		if (a == "-n") timing = false;
+		else if ((a == "-s" || a == "-o") && i + 1 < argc) {
+			std::string v{argv[++i]};
+			if (a == "-o" && !bench::parse_format(v, fmt)) { usage(argv[0]); return -1; }
+			if (a == "-s" && (speed = std::atof(v.c_str())) <= 0) { usage(argv[0]); return -1; }
+		} else if (a[0] == '-') {
+			usage(argv[0]);
+			return -1;
+		} else if (cmd == "run" && uri.empty()) uri = a;
+		else plan.files.push_back(a);
+	}
+	if (plan.files.empty()) {
+		usage(argv[0]);
+		return -1;
+	}
+	if (!load(plan)) return -1;
+	return cmd == "info" ? info(plan, fmt) : run(plan, uri, speed, timing, fmt);
+}
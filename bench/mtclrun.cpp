@@ -0,0 +1,398 @@
+/*
+ * Local launcher of MTCL applications: generates the configuration file of
+ * the components, then starts one process per component on this host,
+ * pinned to its own core, and collects their output.
+ *
+ * === Compilation ===
+ *
+ *  $> make mtclrun
+ *
+ * === Execution ===
+ *
+ *  $> ./mtclrun -n <counts> [options] -- <program> [args...]
+ *
+ *  e.g.
+ *  $> ./mtclrun -n 4 -f tcp_config.json -- ./test_bcast %c
+ *  $> ./mtclrun -n 4 -a Emitter,Collector,Worker1,Worker2 -l 0,1 -p SHM \
+ *         -- ./iterative_benchmark_scatter-gather %r 2 10 64 %f
+ *  $> ./mtclrun -n 2,4,8,16,32,64,128 -a rank%r -O results \
+ *         -- ./mtcl-coll-bench %r %n -C %f -c bcast -o csv
+ *
+ * Options:
+ *   -n counts  number of processes, a comma separated list runs the
+ *              application once for each count (e.g., a scaling study)
+ *   -a names   component names: a pattern where %r is the rank and %R the
+ *              rank+1 (default App%R), or a comma separated list
+ *   -l ranks   ranks with a listening endpoint: a comma separated list or
+ *              "all" (default 0)
+ *   -p proto   protocol of the components: TCP, SHM or UCX (default TCP);
+ *              the TCP and UCX ports are chosen among the free ones
+ *   -f file    configuration file to write (default mtclrun-<pid>.json,
+ *              removed at the end)
+ *   -c cpus    cores for the processes, e.g., 0-15 or 0,2,4,6, assigned
+ *              round robin by rank; "none" disables the pinning (default
+ *              the cores allowed to the launcher)
+ *   -x VAR=v   environment variable for all the processes, repeatable
+ *   -O dir     writes the output of each process to dir/<count>/<name>.log
+ *              instead of printing it prefixed by the component name
+ *   -t secs    kills all the processes after secs seconds (default none)
+ *
+ * In the arguments of the program and in the values of -x, %r is replaced
+ * by the rank, %R by the rank+1, %n by the number of processes, %c by the
+ * component name and %f by the configuration file. Each process also finds
+ * them in MTCL_RUN_RANK, MTCL_RUN_SIZE, MTCL_RUN_NAME and MTCL_RUN_CONFIG.
+ *
+ * If a process fails (or the timeout expires) the others are terminated;
+ * the exit status is the one of the first process that failed. MPI
+ * components must be launched by mpirun.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+struct Options {
+	std::vector<int> counts;
+	std::string names = "App%R";
+	std::string listeners = "0";
+	std::string protocol = "TCP";
+	std::string config;
+	std::vector<int> cpus;
+	bool pin = true;
+	std::vector<std::string> env;
+	std::string outdir;
+	int timeout = 0;
+	std::vector<std::string> argv;
+};
+
+struct Process {
+	pid_t pid = -1;
+	int fd = -1;                // output pipe, -1 when closed
+	std::string name, partial;  // line not yet terminated
+	std::ofstream log;
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int) { interrupted = 1; }
+
+static std::vector<std::string> split(const std::string& s, char sep) {
+	std::vector<std::string> r;
+	size_t pos = 0;
+	for(size_t next; (next = s.find(sep, pos)) != std::string::npos; pos = next + 1)
+		r.push_back(s.substr(pos, next - pos));
+	r.push_back(s.substr(pos));
+	return r;
+}
+
+static void replaceAll(std::string& s, const std::string& from, const std::string& to) {
+	for(size_t p = 0; (p = s.find(from, p)) != std::string::npos; p += to.size())
+		s.replace(p, from.size(), to);
+}
+
+// parses "0-3,8,10-11"
+static bool parseCpus(const std::string& s, std::vector<int>& cpus) {
+	for(auto& r : split(s, ',')) {
+		auto d = r.find('-');
+		try {
+			int first = std::stoi(r.substr(0, d));
+			int last  = d == std::string::npos ? first : std::stoi(r.substr(d + 1));
+			if (first < 0 || last < first) return false;
+			for(int c = first; c <= last; ++c) cpus.push_back(c);
+		} catch(...) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// a TCP port not in use (another process may take it before the application)
+static int freePort() {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	sockaddr_in sa{};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_ANY);
+	socklen_t len = sizeof(sa);
+	int port = -1;
+	if (bind(fd, (sockaddr*)&sa, sizeof(sa)) == 0 && getsockname(fd, (sockaddr*)&sa, &len) == 0)
+		port = ntohs(sa.sin_port);
+	close(fd);
+	return port;
+}
+
+static std::string componentName(const Options& o, int rank) {
+	if (o.names.find(',') != std::string::npos) {
+		auto names = split(o.names, ',');
+		return rank < (int)names.size() ? names[rank] : "App" + std::to_string(rank + 1);
+	}
+	std::string n = o.names;
+	replaceAll(n, "%r", std::to_string(rank));
+	replaceAll(n, "%R", std::to_string(rank + 1));
+	return n;
+}
+
+static bool isListener(const Options& o, int rank) {
+	if (o.listeners == "all") return true;
+	for(auto& r : split(o.listeners, ','))
+		if (r == std::to_string(rank)) return true;
+	return false;
+}
+
+/**
+ * @brief Writes the configuration of n components on the local host, in the
+ * format of the library configuration files.
+ */
+static bool generateConfig(const Options& o, const std::string& file, int n) {
+	std::ofstream ofs(file);
+	ofs << "{\n    \"components\":[\n";
+	for(int r = 0; r < n; ++r) {
+		ofs << "        {\"name\":\"" << componentName(o, r) << "\", \"host\":\"localhost\", "
+			<< "\"protocols\":[\"" << o.protocol << "\"]";
+		if (isListener(o, r)) {
+			std::string endpoint;
+			if (o.protocol == "SHM")
+				endpoint = "SHM:/mtclrun-" + std::to_string(getpid()) + "-" + std::to_string(r);
+			else {
+				int port = freePort();
+				if (port < 0) {
+					std::cerr << "mtclrun: cannot find a free port, errno=" << errno << "\n";
+					return false;
+				}
+				endpoint = o.protocol + ":0.0.0.0:" + std::to_string(port);
+			}
+			ofs << ", \"listen-endpoints\":[\"" << endpoint << "\"]";
+		}
+		ofs << "}" << (r < n - 1 ? "," : "") << "\n";
+	}
+	ofs << "    ]\n}\n";
+	return ofs.good();
+}
+
+static std::string substitute(std::string s, int rank, int n, const std::string& name, const std::string& config) {
+	replaceAll(s, "%%", "\x01");
+	replaceAll(s, "%r", std::to_string(rank));
+	replaceAll(s, "%R", std::to_string(rank + 1));
+	replaceAll(s, "%n", std::to_string(n));
+	replaceAll(s, "%c", name);
+	replaceAll(s, "%f", config);
+	replaceAll(s, "\x01", "%");
+	return s;
+}
+
+// in the child, never returns
+static void start(const Options& o, int rank, int n, const std::string& name,
+				  const std::string& config, int out) {
+	dup2(out, STDOUT_FILENO);
+	dup2(out, STDERR_FILENO);
+	close(out);
+	if (o.pin && !o.cpus.empty()) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(o.cpus[rank % o.cpus.size()], &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0)
+			std::cerr << "mtclrun: cannot pin " << name << ", errno=" << errno << "\n";
+	}
+	setenv("MTCL_RUN_RANK", std::to_string(rank).c_str(), 1);
+	setenv("MTCL_RUN_SIZE", std::to_string(n).c_str(), 1);
+	setenv("MTCL_RUN_NAME", name.c_str(), 1);
+	setenv("MTCL_RUN_CONFIG", config.c_str(), 1);
+	for(auto& e : o.env) {
+		auto eq = e.find('=');
+		setenv(e.substr(0, eq).c_str(), substitute(e.substr(eq + 1), rank, n, name, config).c_str(), 1);
+	}
+	std::vector<std::string> args;
+	for(auto& a : o.argv) args.push_back(substitute(a, rank, n, name, config));
+	std::vector<char*> argv;
+	for(auto& a : args) argv.push_back(&a[0]);
+	argv.push_back(nullptr);
+	execvp(argv[0], argv.data());
+	std::cerr << "mtclrun: cannot execute " << args[0] << ": " << strerror(errno) << "\n";
+	_exit(127);
+}
+
+// forwards the complete lines of p, all of them if eof
+static void forward(Process& p, const char* data, size_t size, bool eof) {
+	p.partial.append(data, size);
+	size_t pos = 0;
+	for(size_t nl; (nl = p.partial.find('\n', pos)) != std::string::npos; pos = nl + 1) {
+		std::string line = p.partial.substr(pos, nl - pos + 1);
+		if (p.log.is_open()) p.log << line;
+		else std::cout << "[" << p.name << "] " << line;
+	}
+	p.partial.erase(0, pos);
+	if (eof && !p.partial.empty()) {
+		if (p.log.is_open()) p.log << p.partial << "\n";
+		else std::cout << "[" << p.name << "] " << p.partial << "\n";
+		p.partial.clear();
+	}
+	std::cout.flush();
+}
+
+// returns the exit status of the first process that failed, 0 if none
+static int run(const Options& o, int n) {
+	std::string config = o.config.empty() ? "mtclrun-" + std::to_string(getpid()) + ".json" : o.config;
+	if (!generateConfig(o, config, n)) {
+		std::cerr << "mtclrun: cannot write the configuration file " << config << "\n";
+		return 1;
+	}
+	std::string dir;
+	if (!o.outdir.empty()) {
+		dir = o.outdir + "/" + std::to_string(n);
+		mkdir(o.outdir.c_str(), 0755);
+		mkdir(dir.c_str(), 0755);
+	}
+
+	std::vector<Process> procs(n);
+	for(int r = 0; r < n; ++r) {
+		Process& p = procs[r];
+		p.name = componentName(o, r);
+		int fds[2];
+		if (pipe(fds) < 0) {
+			std::cerr << "mtclrun: pipe failed, errno=" << errno << "\n";
+			return 1;
+		}
+		p.pid = fork();
+		if (p.pid == 0) {
+			close(fds[0]);
+			for(int i = 0; i < r; ++i) close(procs[i].fd);
+			start(o, r, n, p.name, config, fds[1]);
+		}
+		close(fds[1]);
+		p.fd = fds[0];
+		if (!dir.empty()) p.log.open(dir + "/" + p.name + ".log");
+	}
+
+	int result = 0, alive = n, open = n;
+	bool killed = false;
+	time_t deadline = o.timeout ? time(nullptr) + o.timeout : 0;
+	auto killAll = [&]() {
+		if (killed) return;
+		killed = true;
+		for(auto& p : procs)
+			if (p.pid > 0) kill(p.pid, SIGTERM);
+	};
+	while(alive > 0 || open > 0) {
+		if (interrupted || (deadline && time(nullptr) >= deadline)) {
+			if (!killed) std::cerr << "mtclrun: " << (interrupted ? "interrupted" : "timeout") << ", terminating\n";
+			if (!result) result = 1;
+			killAll();
+		}
+		std::vector<pollfd> pfds;
+		std::vector<Process*> owners;
+		for(auto& p : procs)
+			if (p.fd >= 0) {
+				pfds.push_back({p.fd, POLLIN, 0});
+				owners.push_back(&p);
+			}
+		if (!pfds.empty() && poll(pfds.data(), pfds.size(), 100) > 0) {
+			char buff[4096];
+			for(size_t i = 0; i < pfds.size(); ++i) {
+				if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+				ssize_t r = read(pfds[i].fd, buff, sizeof(buff));
+				if (r > 0) forward(*owners[i], buff, r, false);
+				else {
+					forward(*owners[i], buff, 0, true);
+					close(owners[i]->fd);
+					owners[i]->fd = -1;
+					open--;
+				}
+			}
+		} else if (pfds.empty()) usleep(100000);
+
+		int st;
+		for(pid_t pid; alive > 0 && (pid = waitpid(-1, &st, WNOHANG)) > 0; ) {
+			alive--;
+			for(auto& p : procs)
+				if (p.pid == pid) p.pid = -1;
+			if (WIFEXITED(st) && WEXITSTATUS(st) == 0) continue;
+			if (!result) {
+				result = WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+				std::cerr << "mtclrun: a process failed with status " << result << ", terminating\n";
+			}
+			killAll();
+		}
+	}
+	if (o.config.empty()) unlink(config.c_str());
+	return result;
+}
+
+static void usage(const char* name) {
+	std::cerr << "Usage: " << name << " -n counts [-a names] [-l ranks|all] [-p TCP|SHM|UCX] [-f config]\n"
+			  << "        [-c cpus|none] [-x VAR=value]... [-O dir] [-t secs] -- program [args...]\n";
+}
+
+int main(int argc, char** argv) {
+	Options o;
+	int opt;
+	while((opt = getopt(argc, argv, "+n:a:l:p:f:c:x:O:t:")) != -1) {
+		switch(opt) {
+		case 'n':
+			for(auto& c : split(optarg, ',')) {
+				try { o.counts.push_back(std::stoi(c)); } catch(...) { usage(argv[0]); return 1; }
+			}
+			break;
+		case 'a': o.names     = optarg; break;
+		case 'l': o.listeners = optarg; break;
+		case 'p': o.protocol  = optarg; break;
+		case 'f': o.config    = optarg; break;
+		case 'c':
+			if (std::string(optarg) == "none") o.pin = false;
+			else if (!parseCpus(optarg, o.cpus)) { usage(argv[0]); return 1; }
+			break;
+		case 'x':
+			if (!std::strchr(optarg, '=')) { usage(argv[0]); return 1; }
+			o.env.push_back(optarg);
+			break;
+		case 'O': o.outdir  = optarg; break;
+		case 't': o.timeout = std::atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	for(int i = optind; i < argc; ++i) o.argv.push_back(argv[i]);
+	if (o.counts.empty() || o.argv.empty() ||
+		std::any_of(o.counts.begin(), o.counts.end(), [](int n) { return n < 1; })) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (o.protocol != "TCP" && o.protocol != "SHM" && o.protocol != "UCX") {
+		std::cerr << "mtclrun: unsupported protocol " << o.protocol
+				  << (o.protocol.rfind("MPI", 0) == 0 ? ", use mpirun" : "") << "\n";
+		return 1;
+	}
+	if (o.pin && o.cpus.empty()) {
+		cpu_set_t set;
+		if (sched_getaffinity(0, sizeof(set), &set) == 0)
+			for(int c = 0; c < CPU_SETSIZE; ++c)
+				if (CPU_ISSET(c, &set)) o.cpus.push_back(c);
+	}
+
+	struct sigaction sa{};
+	sa.sa_handler = onSignal;
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+
+	for(int n : o.counts) {
+		if (o.counts.size() > 1 && o.outdir.empty())
+			std::cout << "# mtclrun: " << n << " processes" << std::endl;
+		int r = run(o, n);
+		if (r) return r;
+	}
+	return 0;
+}
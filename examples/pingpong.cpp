@@ -12,6 +12,8 @@
  *   The number of accepted connections can be tweaked via the 
  *	 MAX_NUM_CLIENTS macro in this file. After this amount of connections 
  *   the server stops accepting new connections and terminates.
+ *
+ * Latency and bandwidth are measured by bench/mtcl-bench (lat and bw modes).
  * 
  * === Compilation ===
  * 
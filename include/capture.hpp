@@ -0,0 +1,281 @@
+#ifndef MTCL_CAPTURE_HPP
+#define MTCL_CAPTURE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "utils.hpp"
+
+/*
+ * Capture of the traffic sent by the process, to be replayed by
+ * bench/mtcl-replay. Only timestamps, sizes and handles are recorded, never
+ * the payloads.
+ *
+ * Compiled only with MTCL_ENABLE_CAPTURE and enabled at run time by the
+ * MTCL_CAPTURE=<file> environment variable (%p is replaced by the process
+ * id and %a by the application name, see Manager::init). A send costs a
+ * clock read and a 16-byte record in a buffer of the calling thread, with
+ * no lock, the buffer is appended to the file as a block when it holds
+ * CAPTURE_BLOCK_RECORDS sends and by Manager::finalize.
+ *
+ * File format (native byte order):
+ *   "MTCLCAP1", uint64 ns since the epoch at the start (aligns the files
+ *   of different processes), uint16 length, application name
+ *   then any sequence of
+ *   'H' uint32 id, uint16 length, name, uint16 length, protocol,
+ *       uint16 length, peer       a handle, before its first send; peer is
+ *                                 the URI given to Manager::connect, empty
+ *                                 for the accepted connections
+ *   'B' uint32 count, count x {uint64 ns since the start, uint32 id,
+ *       uint32 size}              sends of one thread, in time order
+ */
+
+namespace capture {
+
+const char MAGIC[8] = {'M','T','C','L','C','A','P','1'};
+
+struct Send {
+    uint64_t ns;
+    uint32_t id;
+    uint32_t size;
+};
+
+struct HandleInfo {
+    std::string name, protocol, peer;
+};
+
+/**
+ * @brief Content of a capture file, used by the replay tool.
+ */
+struct File {
+    std::string app;
+    uint64_t epoch = 0;
+    std::map<uint32_t, HandleInfo> handles;
+    std::vector<Send> sends;   // sorted by time
+
+    bool load(const std::string& filename) {
+        FILE* f = std::fopen(filename.c_str(), "rb");
+        if (!f) return false;
+        std::unique_ptr<FILE, int(*)(FILE*)> guard(f, std::fclose);
+        auto str = [&](std::string& s) {
+            uint16_t n;
+            if (std::fread(&n, sizeof(n), 1, f) != 1) return false;
+            s.resize(n);
+            return n == 0 || std::fread(&s[0], 1, n, f) == n;
+        };
+        char magic[sizeof(MAGIC)];
+        if (std::fread(magic, sizeof(magic), 1, f) != 1 ||
+            std::string(magic, sizeof(magic)) != std::string(MAGIC, sizeof(MAGIC)) ||
+            std::fread(&epoch, sizeof(epoch), 1, f) != 1 || !str(app))
+            return false;
+        for(int tag; (tag = std::fgetc(f)) != EOF; ) {
+            uint32_t v;
+            if (std::fread(&v, sizeof(v), 1, f) != 1) return false;
+            if (tag == 'H') {
+                HandleInfo& h = handles[v];
+                if (!str(h.name) || !str(h.protocol) || !str(h.peer)) return false;
+            } else if (tag == 'B') {
+                size_t n = sends.size();
+                sends.resize(n + v);
+                if (std::fread(&sends[n], sizeof(Send), v, f) != v) return false;
+            } else return false;
+        }
+        std::stable_sort(sends.begin(), sends.end(),
+                         [](const Send& a, const Send& b) { return a.ns < b.ns; });
+        return true;
+    }
+};
+
+} // namespace capture
+
+#if defined(MTCL_ENABLE_CAPTURE)
+
+class Capture {
+    // filled by its thread, appended to the file when full; busy while the
+    // thread appends, finalize waits for it (see sent)
+    struct Buffer {
+        std::atomic<bool> busy{false};
+        std::vector<capture::Send> sends;
+        Buffer() { sends.reserve(CAPTURE_BLOCK_RECORDS); }
+    };
+
+    // the id of a connected handle is assigned by connected, it is described
+    // at its first send
+    static const uint32_t UNDESCRIBED = 1u << 31;
+
+    inline static std::mutex mtx;                       // protects the file, buffers and peers
+    inline static FILE* file = nullptr;
+    inline static std::atomic<bool> enabled{false};
+    inline static std::atomic<uint32_t> nextId{0};
+    inline static std::vector<std::unique_ptr<Buffer>> buffers;
+    inline static std::map<uint32_t, std::string> peers;  // by id, connected, not sent yet
+    inline static uint64_t start = 0;
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void putString(const std::string& s) {
+        uint16_t n = (uint16_t)std::min<size_t>(s.size(), UINT16_MAX);
+        std::fwrite(&n, sizeof(n), 1, file);
+        std::fwrite(s.data(), 1, n, file);
+    }
+
+    // the buffers outlive their threads, their sends are written by finalize
+    static Buffer* buffer() {
+        thread_local Buffer* b = nullptr;
+        if (!b) {
+            std::unique_lock lk(mtx);
+            buffers.emplace_back(new Buffer);
+            b = buffers.back().get();
+        }
+        return b;
+    }
+
+    // called by the thread of b, or by finalize when it is not busy
+    static void write(Buffer& b) {
+        std::unique_lock lk(mtx);
+        if (file && !b.sends.empty()) {
+            uint32_t n = b.sends.size();
+            std::fputc('B', file);
+            std::fwrite(&n, sizeof(n), 1, file);
+            std::fwrite(b.sends.data(), sizeof(capture::Send), n, file);
+        }
+        b.sends.clear();
+    }
+
+    // first send of a handle: assigns its id and writes its description
+    static uint32_t describe(std::atomic<uint32_t>& id, const std::string& name, const char* protocol) {
+        std::unique_lock lk(mtx);
+        uint32_t v = id.load();
+        if (v && !(v & UNDESCRIBED)) return v;  // described by another thread
+        std::string peer;
+        if (v) {
+            v &= ~UNDESCRIBED;
+            if (auto it = peers.find(v); it != peers.end()) {
+                peer = it->second;
+                peers.erase(it);
+            }
+        } else v = ++nextId;
+        if (file) {
+            std::fputc('H', file);
+            std::fwrite(&v, sizeof(v), 1, file);
+            putString(name);
+            putString(protocol);
+            putString(peer);
+        }
+        id.store(v);
+        return v;
+    }
+
+public:
+    /**
+     * @brief Enables the capture, the sends will be written to \b filename
+     * where %p is replaced by the process id and %a by the application name.
+     */
+    static void init(const std::string& filename, const std::string& appName) {
+        std::string name = filename;
+        for(size_t p; (p = name.find("%p")) != std::string::npos; )
+            name.replace(p, 2, std::to_string(getpid()));
+        for(size_t p; (p = name.find("%a")) != std::string::npos; )
+            name.replace(p, 2, appName);
+        std::unique_lock lk(mtx);
+        if (file) return;
+        if (!(file = std::fopen(name.c_str(), "wb"))) {
+            MTCL_ERROR("[Capture]:\t", "cannot open the capture file %s, errno=%d\n", name.c_str(), errno);
+            return;
+        }
+        start = now();
+        uint64_t epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        std::fwrite(capture::MAGIC, sizeof(capture::MAGIC), 1, file);
+        std::fwrite(&epoch, sizeof(epoch), 1, file);
+        putString(appName);
+        enabled = true;
+    }
+
+    static bool on() { return enabled.load(std::memory_order_relaxed); }
+
+    // a handle returned by Manager::connect(uri), id is its captureId
+    static void connected(std::atomic<uint32_t>& id, const std::string& uri) {
+        if (!on()) return;
+        std::unique_lock lk(mtx);
+        uint32_t v = ++nextId;
+        peers[v] = uri;
+        id.store(v | UNDESCRIBED);
+    }
+
+    // the handle is closed for writing, it is described only if it has sent
+    static void closed(std::atomic<uint32_t>& id) {
+        if (!on() || !(id.load(std::memory_order_relaxed) & UNDESCRIBED)) return;
+        std::unique_lock lk(mtx);
+        peers.erase(id.load() & ~UNDESCRIBED);
+    }
+
+    static void sent(std::atomic<uint32_t>& id, const std::string& name, const char* protocol, size_t size) {
+        if (!on()) return;
+        Buffer* b = buffer();
+        // either finalize sees busy and waits, or this thread sees the
+        // capture disabled (both sequentially consistent)
+        b->busy.store(true);
+        if (enabled.load()) {
+            uint32_t v = id.load(std::memory_order_relaxed);
+            if (!v || (v & UNDESCRIBED)) v = describe(id, name, protocol);
+            b->sends.push_back({now() - start, v, (uint32_t)std::min<size_t>(size, UINT32_MAX)});
+            if (b->sends.size() >= CAPTURE_BLOCK_RECORDS) write(*b);
+        }
+        b->busy.store(false, std::memory_order_release);
+    }
+
+    /**
+     * @brief Writes the buffered sends of all the threads and closes the
+     * file, called by Manager::finalize.
+     */
+    static void finalize() {
+        if (!on()) return;
+        enabled = false;
+        std::vector<Buffer*> bs;
+        {
+            std::unique_lock lk(mtx);
+            for(auto& b : buffers) bs.push_back(b.get());
+        }
+        for(auto b : bs) {
+            while(b->busy.load(std::memory_order_acquire)) std::this_thread::yield();
+            write(*b);
+        }
+        std::unique_lock lk(mtx);
+        std::fclose(file);
+        file = nullptr;
+        peers.clear();
+    }
+};
+
+#else  // the capture compiles away
+
+class Capture {
+public:
+    static void init(const std::string&, const std::string&) {
+        MTCL_ERROR("[Capture]:\t", "MTCL_CAPTURE is ignored, the library is not compiled with MTCL_ENABLE_CAPTURE\n");
+    }
+    static bool on() { return false; }
+    static void connected(std::atomic<uint32_t>&, const std::string&) {}
+    static void closed(std::atomic<uint32_t>&) {}
+    static void finalize() {}
+};
+
+#endif
+
+#endif
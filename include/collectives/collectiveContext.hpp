@@ -17,10 +17,12 @@
 #endif
 
 
+class MTCLRuntime;
 class CollectiveContext : public CommunicationHandle {
-    friend class Manager;
+    friend class MTCLRuntime;
 
 protected:
+    MTCLRuntime* runtime = nullptr;  // releases the context (see yield)
     int size;
     bool root;
     int rank;
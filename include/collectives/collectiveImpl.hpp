@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "../handle.hpp"
+#include "../trace.hpp"
 #include "../utils.hpp"
 
 
@@ -97,7 +98,19 @@ protected:
 			return -1;
 		}	   
 		realHandle->probed={false,0};
-		return realHandle->receive(buff, std::min(sz,size));
+		TraceScope tr("receive", realHandle->getName());
+		ssize_t r = realHandle->receive(buff, std::min(sz,size));
+		tr.setBytes(r);
+		return r;
+    }
+
+    // a message of the collective to one participant, traced as a phase of
+    // the collective (the receiving phases in receiveFromHandle)
+    ssize_t sendToHandle(Handle* realHandle, const void* buff, size_t size) {
+		TraceScope tr("send", realHandle->getName());
+		ssize_t r = realHandle->send(buff, size);
+		tr.setBytes(r);
+		return r;
     }
 
 
@@ -185,7 +198,7 @@ public:
     ssize_t sendrecv(const void* sendbuff, size_t sendsize, void* recvbuff, size_t recvsize, size_t datasize = 1) {
         if(root) {
             for(auto& h : participants) {
-                if(h->send(sendbuff, sendsize) < 0) {
+                if(sendToHandle(h, sendbuff, sendsize) < 0) {
                     errno = ECONNRESET;
                     return -1;
                 }
@@ -301,7 +314,7 @@ public:
                     rcount--;
                 }
 
-                if(participants.at(i)->send(sendbuff, chunksize) < 0) {
+                if(sendToHandle(participants.at(i), sendbuff, chunksize) < 0) {
                     errno = ECONNRESET;
                     return -1;
                 }
@@ -581,7 +594,7 @@ public:
 
             auto h = participants.at(0);
 
-            if(h->send(sendbuff, chunksize) < 0) {
+            if(sendToHandle(h, sendbuff, chunksize) < 0) {
                 errno = ECONNRESET;
                 return -1;
             }
@@ -685,7 +698,7 @@ public:
             }
 
             for(auto h : participants) {
-                if(h->send(recvbuff, recvsize) < 0) {
+                if(sendToHandle(h, recvbuff, recvsize) < 0) {
                     errno = ECONNRESET;
                     return -1;
                 }
@@ -709,7 +722,7 @@ public:
 
             auto h = participants.at(0);
 
-            if(h->send(sendbuff, chunksize) < 0) {
+            if(sendToHandle(h, sendbuff, chunksize) < 0) {
                 errno = ECONNRESET;
                 return -1;
             }
@@ -828,7 +841,7 @@ public:
                 displ += chunksize;
 
                 if (i != 0) {
-                    if(participants.at(i - 1)->send(chunkbuff, chunksize * nparticipants) < 0) {
+                    if(sendToHandle(participants.at(i - 1), chunkbuff, chunksize * nparticipants) < 0) {
                         errno = ECONNRESET;
                         return -1;
                     }
@@ -843,7 +856,7 @@ public:
         } else {
             auto h = participants.at(0);
 
-            if(h->send(sendbuff, sendsize) < 0) {
+            if(sendToHandle(h, sendbuff, sendsize) < 0) {
                 errno = ECONNRESET;
                 return -1;
             }
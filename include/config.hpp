@@ -2,6 +2,7 @@
 #define CONFIG_HPP
 
 #include <string>
+#include <csignal>
 
 // -------------- some configuration parameters ----------------
 
@@ -43,6 +44,45 @@ const std::string MQTT_SERVER_ADDRESS{ "tcp://localhost:1883" };
 const unsigned UCX_BACKLOG             = 128;
 const unsigned UCX_POLL_TIMEOUT        = 10; 
 
+// ------ PROXY ------
+// direct connection attempted when a P2P connection goes through the proxies
+// (only if compiled with MTCL_ENABLE_PROXY_UPGRADE)
+const int UPGRADE_CONNECTION_RETRY     = 1;
+const unsigned UPGRADE_CONNECTION_TIMEOUT = 100;  // milliseconds
+const unsigned UPGRADE_PENDING_TIMEOUT = 5000;  // milliseconds, then a direct connection without its proxied one is refused
+
+// -------- TRACE ------
+// only if compiled with MTCL_ENABLE_TRACE and MTCL_TRACE is set
+const size_t TRACE_BUFFER_EVENTS       = (1<<16); // per thread, the oldest are overwritten
+const int TRACE_FLUSH_SIGNAL           = SIGUSR1; // writes the trace file
+const unsigned TRACE_UPDATE_THRESHOLD  = 100;     // shorter update() calls (e.g., idle polls) are not recorded
+
+// -------- STATS ------
+// only if compiled with MTCL_ENABLE_STATS
+const unsigned STATS_SHARDS            = 16;      // counters of a transport, the threads update different ones
+
+// -------- LOG ------
+// only if compiled with MTCL_ENABLE_ASYNC_LOG
+const size_t LOG_BUFFER_RECORDS        = 1024;    // per thread, when full the thread writes them
+const size_t LOG_RECORD_SIZE           = 512;     // bytes, longer strings are truncated
+const size_t LOG_FREE_RINGS            = 4;       // buffers of exited threads kept for the new ones
+const unsigned LOG_FLUSH_INTERVAL      = 1000;    // the background thread writes the messages
+
+// -------- METRICS ------
+// only if MTCL_METRICS is set
+const unsigned METRICS_POLL_TIMEOUT    = 100;     // milliseconds, the exporter checks if it has to stop
+const unsigned METRICS_IO_TIMEOUT      = 1000;    // milliseconds, slow scrapers are disconnected
+const size_t METRICS_MAX_REQUEST       = 4096;    // bytes, longer requests are refused
+
+// -------- CAPTURE ------
+// only if compiled with MTCL_ENABLE_CAPTURE and MTCL_CAPTURE is set
+const size_t CAPTURE_BLOCK_RECORDS     = 4096;    // sends buffered per thread before writing them
+
+// -------- EMU ------
+const size_t EMU_SEND_BUFFER           = (4<<20); // bytes waiting for the emulated link before send blocks
+const size_t EMU_MAX_QUEUED            = (256<<20); // bytes per connection in the delay line before send blocks
+const unsigned EMU_END_TIMEOUT         = 2000;    // milliseconds, end drops the messages not delivered by then
+
 // -------- COLLECTIVES ------
 const int CCONNECTION_RETRY            = 10;
 const unsigned CCONNECTION_TIMEOUT     = 100;     // milliseconds
@@ -24,7 +24,8 @@ class CommunicationHandle {
     friend class HandleUser;
 	friend class FanInGeneric;
 	friend class FanOutGeneric;
-    friend class Manager;
+    friend class MTCLRuntime;
+    template<typename> friend class TypedHandle;
 
 protected:
 	std::string handleName{"no-name-provided"};
@@ -32,6 +33,8 @@ protected:
 	std::atomic<bool> closed_rd = false, closed_wr = false;
     std::atomic<int> counter = 0;
     HandleType type = P2P;
+    StatsCounters stats;
+    std::atomic<uint32_t> captureId{0};  // assigned by Capture at the connect or at the first send
 
 
     virtual void incrementReferenceCounter() = 0;
@@ -92,6 +95,8 @@ public:
     virtual int getSize() {return 1;}
 	virtual int getTeamRank() { return -1; }
     virtual int getTeamPartitionSize(size_t buffcount) { return -1; }
+    // name of the transport, empty for the collectives
+    virtual const char* getProtocol() { return ""; }
 	
     void setName(const std::string &name) { handleName = name; }
 	const std::string& getName() { return handleName; }
@@ -105,10 +110,23 @@ public:
 class Handle : public CommunicationHandle {
     friend class CollectiveImpl;
     // friend class HandleUser;
-    friend class Manager;
+    friend class MTCLRuntime;
     friend class ConnType;
+    friend class HandleUpgradable;
+    friend class HandlePooled;
+    friend class HandleEMU;
 
     ConnType* parent;
+    // handle exposed to the user in place of this one (e.g., HandleUpgradable)
+    CommunicationHandle* wrapper = nullptr;
+    // handle of another transport decorating this connection (e.g., HandleEMU),
+    // the Manager treats its events as the ones of the decorator
+    Handle* outer = nullptr;
+    // pooled connections between two sessions (see HandlePooled)
+    bool parked  = false;   // in the Manager's pool (connecting side)
+    bool rearmed = false;   // waiting for the next session (accepting side)
+    bool peerEOS = false;   // the peer has ended the last session
+    const bool counted = false;  // in the connection counters of the transport
 	
     void incrementReferenceCounter(){
         counter++;
@@ -135,6 +153,8 @@ public:
      */
     virtual bool peek() = 0;
 
+    const char* getProtocol() { return parent ? parent->instanceName.c_str() : ""; }
+
     void yield() {
         if (!closed_rd)
             parent->notify_yield(this);
@@ -165,8 +185,18 @@ public:
 		}*/
     }
     
-    Handle(ConnType* parent) : parent(parent) {}	
-    virtual ~Handle() {};
+    /**
+     * @param parent transport of the handle
+     * @param wraps true for the handles wrapping another one of the same
+     * transport, not counted as a new connection
+     */
+    Handle(ConnType* parent, bool wraps=false) : parent(parent), counted(parent && !wraps) {
+        if (parent) stats.setParent(&parent->stats);
+        if (counted) stats.opened();
+    }	
+    virtual ~Handle() {
+        if (counted) stats.closed();
+    }
 };
 
 
@@ -184,17 +214,18 @@ void ConnType::setAsClosed(Handle* h, bool blockflag){
 				if (h->probed.first) {
 					sz = h->probed.second;
 				} else {
-					if(h->probe(sz) == -1) {
+					if(h->probe(sz) <= 0) {
 						MTCL_PRINT(100, "[internal]:\t", "ConnType::setAsClosed probe error\n");
-						return;
+						break;
 					}
 				}
 				if(sz == 0) break;
 				MTCL_ERROR("[internal]:\t", "Spurious message received of size %ld on handle with name %s!\n", sz, h->getName().c_str());
 				char* buff = new char[sz];
-				if(h->receive(buff, sz) == -1) {
+				if(h->receive(buff, sz) <= 0) {
 					MTCL_PRINT(100, "[internal]:\t", "ConnType::setAsClosed receive error\n");
-					return;
+					delete[] buff;
+					break;
 				}
 				h->probed={false,0};
 				delete[] buff;
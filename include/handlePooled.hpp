@@ -0,0 +1,115 @@
+#ifndef HANDLEPOOLED_HPP
+#define HANDLEPOOLED_HPP
+
+#include <functional>
+
+#include "handle.hpp"
+
+/**
+ * @brief P2P Handle whose underlying connection survives the close.
+ *
+ * Each use of the connection is a session. Closing this Handle sends an EOS
+ * on the underlying connection without closing it; when the session ends the
+ * connection is handed to the Manager, that parks it (connecting side) or
+ * waits for the next session on it (accepting side).
+ * The user always sees this Handle, the Manager redirects here the events of
+ * the underlying handle.
+ */
+class HandlePooled : public Handle {
+    friend class MTCLRuntime;
+
+    Handle* h;              // underlying connection, nullptr when the session ended
+    bool eos    = false;    // the peer has ended the session
+    bool broken = false;    // the connection cannot be reused
+    bool yielded = false;   // the Manager reports it, getNext gives it back
+    // called once at the end of the session with the underlying connection
+    std::function<void(Handle*, bool eos, bool broken)> onEnd;
+
+    void endSession() {
+        if (!h) return;
+        Handle* t = h;
+        h = nullptr;
+        t->wrapper = nullptr;
+        onEnd(t, eos, broken);
+        t->decrementReferenceCounter();
+    }
+
+    void incrementReferenceCounter() {
+        counter++;
+        yielded = false;
+    }
+
+    void decrementReferenceCounter() {
+        counter--;
+        if (counter == 0 && closed_wr && !yielded) {
+            // the session ends also if the peer EOS has not been read yet
+            endSession();
+            delete this;
+        }
+    }
+
+protected:
+    ssize_t sendEOS() { return h ? h->sendEOS() : 0; }
+
+public:
+    HandlePooled(Handle* h, std::function<void(Handle*, bool, bool)> onEnd) :
+            Handle(h->parent, true), h(h), onEnd(onEnd) {
+        h->incrementReferenceCounter();
+        h->wrapper = this;
+    }
+
+    ssize_t send(const void* buff, size_t size) {
+        if (!h) { errno = EBADF; return -1; }
+        ssize_t r = h->send(buff, size);
+        if (r == -1) broken = true;
+        return r;
+    }
+
+    ssize_t probe(size_t& size, const bool blocking=true) {
+        if (!h) { errno = EBADF; return -1; }
+        ssize_t r = h->probe(size, blocking);
+        if (r > 0 && size == 0) eos = true;
+        if (r == 0 || (r == -1 && errno != EWOULDBLOCK && errno != EAGAIN))
+            broken = true;
+        return r;
+    }
+
+    ssize_t receive(void* buff, size_t size) {
+        if (!h) { errno = EBADF; return -1; }
+        ssize_t r = h->receive(buff, size);
+        if (r <= 0) broken = true;
+        return r;
+    }
+
+    bool peek() {
+        return h && h->peek();
+    }
+
+    void yield() {
+        // once closed the connection is going back to the Manager, the IO
+        // thread must not report it to the user anymore; after the close of
+        // the write side only the session lasts until the peer EOS is read
+        if (!h || closed_rd) return;
+        yielded = true;
+        h->yield();
+    }
+
+    void close(bool close_wr=true, bool close_rd=true) {
+        if (close_wr && !closed_wr) {
+            if (sendEOS() == -1) broken = true;
+            closed_wr = true;
+        }
+        if (close_rd && !closed_rd) {
+            closed_rd = true;
+        }
+        if (closed_rd && closed_wr) endSession();
+
+        if (counter == 0 && closed_rd && closed_wr) {
+            delete this;
+        }
+    }
+
+    ~HandlePooled() {}
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef HANDLETYPED_HPP
+#define HANDLETYPED_HPP
+
+#include <typeinfo>
+
+#include "handleUser.hpp"
+
+/**
+ * @brief Handle of a connection of the transport T (e.g., ConnTcp), whose
+ * operations are statically dispatched to T::handle_type and can be inlined.
+ *
+ * It has the semantics of HandleUser (probe, EOS, yield, statistics, tracing
+ * and capture) without the virtual calls on the communication path. It is
+ * obtained from Manager::connect<T>, or from a HandleUser returned by
+ * Manager::getNext:
+ *
+ *   auto h = Manager::connect<ConnTcp>("TCP:host:13000");
+ *   TypedHandle<ConnTcp> t(Manager::getNext());
+ *
+ * Only the direct connections of T can be typed: pooled, proxied and
+ * emulated connections, or the ones of another transport, give an invalid
+ * handle.
+ */
+template<typename T>
+class TypedHandle {
+public:
+    using handle_type = typename T::handle_type;
+
+private:
+    handle_type* h = nullptr;
+    bool isReadable = false;
+
+    void release() {
+        if (!h) return;
+        if (isReadable) this->yield();
+        static_cast<CommunicationHandle*>(h)->decrementReferenceCounter();
+        h = nullptr;
+    }
+
+public:
+    TypedHandle() {}
+
+    /**
+     * @brief Takes the connection of \b u if it is a direct connection of T,
+     * otherwise \b u is left untouched and this handle is invalid (errno is
+     * set to \c EPROTOTYPE).
+     */
+    explicit TypedHandle(HandleUser&& u) {
+        if (!u.realHandle) return;
+        if (typeid(*u.realHandle) != typeid(handle_type)) {
+            MTCL_PRINT(100, "[internal]:\t", "TypedHandle: %s is not a direct connection of the transport\n",
+                       u.realHandle->getName().c_str());
+            errno = EPROTOTYPE;
+            return;
+        }
+        h = static_cast<handle_type*>(u.realHandle);  // the reference moves to this handle
+        isReadable      = u.isReadable;
+        u.realHandle    = nullptr;
+        u.isReadable    = false;
+        u.newConnection = false;
+    }
+
+    TypedHandle(const TypedHandle&) = delete;
+    TypedHandle& operator=(const TypedHandle&) = delete;
+
+    TypedHandle(TypedHandle&& o) : h(o.h), isReadable(o.isReadable) {
+        o.h = nullptr;
+        o.isReadable = false;
+    }
+    TypedHandle& operator=(TypedHandle&& o) {
+        if (this != &o) {
+            release();
+            h = o.h;
+            isReadable = o.isReadable;
+            o.h = nullptr;
+            o.isReadable = false;
+        }
+        return *this;
+    }
+
+    // releases the handle to the manager
+    void yield() {
+        isReadable = false;
+        if (h) {
+            h->stats.yielded();
+            h->handle_type::yield();
+        }
+    }
+
+    bool isValid() { return h; }
+
+    size_t getID() { return (size_t)static_cast<CommunicationHandle*>(h); }
+
+    const std::string& getName() { return h->getName(); }
+    void setName(const std::string& name) { h->setName(name); }
+
+    ssize_t send(const void* buff, size_t size) {
+        if (!h || h->closed_wr) {
+            MTCL_PRINT(100, "[internal]:\t", "TypedHandle::send EBADF\n");
+            errno = EBADF;
+            return -1;
+        }
+        TraceScope tr("send", h->getName());
+        tr.setBytes(size);
+        MTCL_PROBE3(send, getID(), size, h->handle_type::getProtocol());
+        StatsTimer t;
+        ssize_t r = h->handle_type::send(buff, size);
+        if (r >= 0) {
+            h->stats.sent(size, t.elapsed());
+#ifdef MTCL_ENABLE_CAPTURE
+            Capture::sent(h->captureId, h->getName(), h->handle_type::getProtocol(), size);
+#endif
+        }
+        MTCL_PROBE2(send_done, getID(), r);
+        return r;
+    }
+
+    ssize_t probe(size_t& size, const bool blocking=true) {
+        if (!h) {
+            MTCL_PRINT(100, "[internal]:\t", "TypedHandle::probe EBADF\n");
+            errno = EBADF;
+            return -1;
+        }
+        if (h->probed.first) { // previously probed, return 0 if EOS received
+            size = h->probed.second;
+            return (size ? sizeof(size_t) : 0);
+        }
+        if (!isReadable || h->closed_rd) return 0;
+
+        TraceScope tr("probe", h->getName());
+        MTCL_PROBE3(probe, getID(), blocking, h->handle_type::getProtocol());
+        StatsTimer t;
+        ssize_t r = h->handle_type::probe(size, blocking);
+        MTCL_PROBE3(probe_done, getID(), r, r > 0 ? size : 0);
+        bool wouldBlock = r == -1 && (errno==EWOULDBLOCK || errno==EAGAIN);
+        h->stats.probed(blocking ? t.elapsed() : 0, wouldBlock);
+        if (wouldBlock) tr.cancel();
+        if (r <= 0) {
+            if (r == 0 || errno == ECONNRESET) {
+                isReadable = false;
+                h->handle_type::close(true, true);
+                return 0;
+            }
+            if (wouldBlock) errno = EWOULDBLOCK;
+            return -1;
+        }
+        h->probed = {true, size};
+        if (size == 0) { // EOS received
+            h->handle_type::close(false, true);
+            isReadable = false;
+            return 0;
+        }
+        return r;
+    }
+
+    ssize_t receive(void* buff, size_t size) {
+        size_t sz;
+        if (!h || !h->probed.first) {
+            ssize_t r;
+            if ((r = this->probe(sz, true)) <= 0) return r;
+        } else if (!isReadable || h->closed_rd) return 0;
+        if ((sz = h->probed.second) > size) {
+            MTCL_ERROR("[internal]:\t", "TypedHandle::receive ENOMEM, receiving less data\n");
+            errno = ENOMEM;
+            return -1;
+        }
+        h->probed = {false, 0};
+        TraceScope tr("receive", h->getName());
+        MTCL_PROBE3(receive, getID(), sz, h->handle_type::getProtocol());
+        StatsTimer t;
+        ssize_t r = h->handle_type::receive(buff, sz);
+        tr.setBytes(r);
+        if (r > 0) h->stats.received(r, t.elapsed());
+        MTCL_PROBE2(receive_done, getID(), r);
+        return r;
+    }
+
+    void close() {
+        if (!h) return;
+#ifdef MTCL_ENABLE_CAPTURE
+        Capture::closed(h->captureId);
+#endif
+        h->handle_type::close(true, false);
+    }
+
+    std::pair<bool, bool> isClosed() {
+        if (!h) return {true, true};
+        return {h->closed_rd, h->closed_wr};
+    }
+
+    /**
+     * @brief Statistics of this handle, always zero if the library is not
+     * compiled with MTCL_ENABLE_STATS.
+     *
+     * @param reset if true the counters are zeroed after the snapshot
+     */
+    MTCLStats getStats(bool reset=false) {
+        if (!h) return {};
+        return h->stats.snapshot(reset);
+    }
+
+    ~TypedHandle() {
+        release();
+    }
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef HANDLEUPGRADABLE_HPP
+#define HANDLEUPGRADABLE_HPP
+
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "handle.hpp"
+
+/**
+ * @brief P2P Handle established through the proxies whose data path can be
+ * migrated on a direct connection between the two peers.
+ *
+ * The two directions are migrated independently. The writer moves on the
+ * direct connection by closing the write side of the proxied one, the reader
+ * drains the proxied connection up to its EOS and then moves on the direct
+ * one. This way messages are received in the same order they have been sent.
+ * The user always sees this Handle, the Manager redirects here the events of
+ * the underlying handles.
+ */
+class HandleUpgradable : public Handle {
+    friend class MTCLRuntime;
+
+    enum UpgradeState {TRYING, DONE, FAILED};
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    UpgradeState state;
+    Handle* proxied;            // connection through the proxies
+    Handle* direct = nullptr;   // direct connection, set when the upgrade succeeds
+    Handle* rd;                 // handle currently used for reading
+    Handle* wr;                 // handle currently used for writing
+    std::function<void()> onClose;
+
+    void acquire(Handle* h) {
+        h->incrementReferenceCounter();
+        h->wrapper = this;
+    }
+
+    static Handle* detach(Handle*& h) {
+        Handle* r = h;
+        h = nullptr;
+        return r;
+    }
+
+    // NOTE: it must be called without holding mtx, closing the read side
+    // the transport may acquire its own locks (also held by the IO thread)
+    static void release(Handle* h) {
+        if (!h) return;
+        h->wrapper = nullptr;
+        h->close(true, true);
+        h->decrementReferenceCounter();
+    }
+
+    // must be called holding mtx, returns the handle to be released (if any)
+    Handle* switchWriter() {
+        if (wr == proxied && direct) {
+            // this EOS tells the peer to continue reading from the direct connection
+            proxied->close(true, false);
+            wr = direct;
+            if (rd != proxied) return detach(proxied);
+        }
+        return nullptr;
+    }
+
+    // must be called holding mtx, returns the handle to be released (if any)
+    Handle* switchReader() {
+        rd = direct;
+        if (wr != proxied) return detach(proxied);
+        return nullptr;
+    }
+
+protected:
+    // never used, the close method is overridden
+    ssize_t sendEOS() { return 0; }
+
+public:
+    /**
+     * @param h handle connected through the proxies
+     * @param initiator true if this side is trying to connect directly to the peer
+     */
+    HandleUpgradable(Handle* h, bool initiator) : Handle(h->parent, true),
+            state(initiator ? TRYING : FAILED), proxied(h), rd(h), wr(h) {
+        acquire(h);
+    }
+
+    /**
+     * @brief Sets the direct connection to the peer.
+     *
+     * @param h direct connection
+     * @param sendAck if true, notifies the peer that the direct connection
+     * can be used (done by the side accepting the direct connection)
+     * @return false if the handle has already been closed, thus the direct
+     * connection cannot be used.
+     */
+    bool attach(Handle* h, bool sendAck) {
+        std::unique_lock lk(mtx);
+        int ack = 1;
+        if (direct || (closed_rd && closed_wr) ||
+            (sendAck && h->send(&ack, sizeof(int)) == -1)) {
+            state = FAILED;
+            cond.notify_all();
+            return false;
+        }
+        acquire(h);
+        direct = h;
+        // the proxied connection has already been closed by the user,
+        // the peer has to find the EOS also on the direct connection
+        if (closed_wr) direct->close(true, false);
+        state = DONE;
+        cond.notify_all();
+        return true;
+    }
+
+    // the direct connection cannot be established
+    void upgradeFailed() {
+        std::unique_lock lk(mtx);
+        state = FAILED;
+        cond.notify_all();
+    }
+
+    bool isUpgraded() {
+        std::unique_lock lk(mtx);
+        return wr == direct && rd == direct;
+    }
+
+    ssize_t send(const void* buff, size_t size) {
+        Handle *h, *old;
+        {
+            std::unique_lock lk(mtx);
+            old = switchWriter();
+            h = wr;
+        }
+        release(old);
+        return h->send(buff, size);
+    }
+
+    ssize_t probe(size_t& size, const bool blocking=true) {
+        while(true) {
+            Handle* h;
+            bool fromProxied;
+            {
+                std::unique_lock lk(mtx);
+                h = rd;
+                fromProxied = (rd == proxied);
+            }
+            ssize_t r = h->probe(size, blocking);
+            if (!fromProxied || (r > 0 && size > 0) || (r < 0 && errno != ECONNRESET))
+                return r;
+
+            // EOS (or connection closed) on the proxied handle: if the direct
+            // connection is (or is going to be) available we continue there
+            Handle* old;
+            {
+                std::unique_lock lk(mtx);
+                cond.wait(lk, [&]{ return state != TRYING; });
+                if (!direct) return r;
+                old = switchReader();
+            }
+            release(old);
+        }
+    }
+
+    ssize_t receive(void* buff, size_t size) {
+        Handle* h;
+        {
+            std::unique_lock lk(mtx);
+            h = rd;
+        }
+        return h->receive(buff, size);
+    }
+
+    bool peek() {
+        Handle* h;
+        {
+            std::unique_lock lk(mtx);
+            h = rd;
+        }
+        return h->peek();
+    }
+
+    void yield() {
+        if (closed_rd) return;
+        Handle* h;
+        {
+            std::unique_lock lk(mtx);
+            h = rd;
+        }
+        h->yield();
+    }
+
+    void close(bool close_wr=true, bool close_rd=true) {
+        Handle* old[3] = {nullptr, nullptr, nullptr};
+        {
+            std::unique_lock lk(mtx);
+            if (close_wr && !closed_wr) {
+                old[0] = switchWriter();
+                wr->close(true, false);
+                closed_wr = true;
+            }
+            if (close_rd && !closed_rd) {
+                closed_rd = true;
+            }
+            if (closed_rd && closed_wr) {
+                old[1] = detach(proxied);
+                old[2] = detach(direct);
+            }
+        }
+        for(auto h : old) release(h);
+        if (closed_rd && closed_wr && onClose) {
+            onClose();
+            onClose = nullptr;
+        }
+        if (counter == 0 && closed_rd && closed_wr) {
+            delete this;
+        }
+    }
+
+    ~HandleUpgradable() {}
+};
+
+#endif
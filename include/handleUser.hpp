@@ -5,11 +5,15 @@
 #include "collectives/collectiveContext.hpp"
 #endif
 #include "handle.hpp"
+#include "trace.hpp"
+#include "capture.hpp"
+#include "probes.hpp"
 #include "errno.h"
 
 class HandleUser {
     friend class ConnType;
-    friend class Manager;
+    friend class MTCLRuntime;
+    template<typename> friend class TypedHandle;
     CommunicationHandle* realHandle;
     bool isReadable    = false;
     bool newConnection = true;
@@ -44,7 +48,10 @@ public:
     void yield() {
         isReadable = false;
         newConnection = false;
-        if (realHandle) realHandle->yield();
+        if (realHandle) {
+            realHandle->stats.yielded();
+            realHandle->yield();
+        }
     }
 
     bool isValid() {
@@ -74,7 +81,19 @@ public:
             errno = EBADF; // the "communicator" is not valid or closed
             return -1;
         }
-        return realHandle->send(buff, size);
+        TraceScope tr("send", realHandle->getName());
+        tr.setBytes(size);
+        MTCL_PROBE3(send, getID(), size, realHandle->getProtocol());
+        StatsTimer t;
+        ssize_t r = realHandle->send(buff, size);
+        if (r >= 0) {
+            realHandle->stats.sent(size, t.elapsed());
+#ifdef MTCL_ENABLE_CAPTURE
+            Capture::sent(realHandle->captureId, realHandle->getName(), realHandle->getProtocol(), size);
+#endif
+        }
+        MTCL_PROBE2(send_done, getID(), r);
+        return r;
     }
 
 	ssize_t probe(size_t& size, const bool blocking=true) {
@@ -96,7 +115,15 @@ public:
 
 		// reading the header to get the size of the message
 		ssize_t r;
-		if ((r=realHandle->probe(size, blocking))<=0) {
+		TraceScope tr("probe", realHandle->getName());
+		MTCL_PROBE3(probe, getID(), blocking, realHandle->getProtocol());
+		StatsTimer t;
+		r=realHandle->probe(size, blocking);
+		MTCL_PROBE3(probe_done, getID(), r, r > 0 ? size : 0);
+		bool wouldBlock = r == -1 && (errno==EWOULDBLOCK || errno==EAGAIN);
+		realHandle->stats.probed(blocking ? t.elapsed() : 0, wouldBlock);
+		if (wouldBlock) tr.cancel(); // only the probes that found something
+		if (r<=0) {
 			switch(r) {
 			case 0: {
 				isReadable=false;
@@ -154,16 +181,32 @@ public:
 			return -1;
 		}	   
 		realHandle->probed={false,0};
-		return realHandle->receive(buff, std::min(sz,size));
+		TraceScope tr("receive", realHandle->getName());
+		MTCL_PROBE3(receive, getID(), sz, realHandle->getProtocol());
+		StatsTimer t;
+		ssize_t r = realHandle->receive(buff, std::min(sz,size));
+		tr.setBytes(r);
+		if (r > 0) realHandle->stats.received(r, t.elapsed());
+		MTCL_PROBE2(receive_done, getID(), r);
+		return r;
     }
 
     ssize_t sendrecv(const void* sendbuff, size_t sendsize, void* recvbuff, size_t recvsize, size_t datasize = 1) {
 		realHandle->probed={false,0};
-        return realHandle->sendrecv(sendbuff, sendsize, recvbuff, recvsize, datasize);
+        TraceScope tr("sendrecv", realHandle->getName());
+        tr.setBytes(sendsize);
+        MTCL_PROBE3(sendrecv, getID(), sendsize, realHandle->getName().c_str());
+        ssize_t r = realHandle->sendrecv(sendbuff, sendsize, recvbuff, recvsize, datasize);
+        MTCL_PROBE2(sendrecv_done, getID(), r);
+        return r;
     }
 
     void close(){
-        if (realHandle) realHandle->close(true, false);
+        if (!realHandle) return;
+#ifdef MTCL_ENABLE_CAPTURE
+        Capture::closed(realHandle->captureId);
+#endif
+        realHandle->close(true, false);
     }
 
     int size() {
@@ -183,6 +226,17 @@ public:
 		return {realHandle->closed_rd, realHandle->closed_wr};
 	}
 
+    /**
+     * @brief Statistics of this handle, always zero if the library is not
+     * compiled with MTCL_ENABLE_STATS.
+     *
+     * @param reset if true the counters are zeroed after the snapshot
+     */
+    MTCLStats getStats(bool reset=false) {
+        if (!realHandle) return {};
+        return realHandle->stats.snapshot(reset);
+    }
+
     HandleType getType() {
         if(realHandle)
             return realHandle->getType();
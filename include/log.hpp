@@ -0,0 +1,350 @@
+#ifndef MTCL_LOG_HPP
+#define MTCL_LOG_HPP
+
+#include <cstdio>
+
+/*
+ * Asynchronous backend of MTCL_PRINT and MTCL_ERROR, compiled with
+ * MTCL_ENABLE_ASYNC_LOG.
+ *
+ * The calling thread copies the format pointer and the arguments (strings
+ * included) into a binary record of its own ring buffer, without locks and
+ * without allocations. A background thread formats the records and writes
+ * them every LOG_FLUSH_INTERVAL microseconds, and when the Manager is
+ * finalized or the process exits. If its ring buffer is full, the calling
+ * thread writes the pending messages itself. The ring buffer of an exited
+ * thread is given to the next thread (up to LOG_FREE_RINGS are kept).
+ *
+ * The format strings must be string literals (as in all the library), the
+ * supported conversions are the ones of printf except '*' widths and %n.
+ */
+
+#if defined(MTCL_ENABLE_ASYNC_LOG)
+
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <pthread.h>
+
+#include "config.hpp"
+
+class AsyncLog {
+    struct Record {
+        FILE*       stream;
+        const char* fmt;
+        uint32_t    size;
+        char        data[LOG_RECORD_SIZE - 2*sizeof(void*) - sizeof(uint32_t)];
+    };
+
+    // single producer (its thread), single consumer (holding drainMtx)
+    struct Ring {
+        std::unique_ptr<Record[]> records{new Record[LOG_BUFFER_RECORDS]};
+        std::atomic<uint64_t> head{0}, tail{0};
+    };
+
+    // one value per argument: type tag followed by the value
+    // (i)nt64, (u)int64, (d)ouble, (p)ointer, (s)tring null-terminated.
+    // The arguments not fitting the record are replaced by the (t)runcated
+    // tag, the last byte of the record is reserved for it.
+    struct Writer {
+        char* buf;
+        size_t cap, pos = 0;
+        bool full = false;
+        bool put(char tag, const void* v, size_t n) {
+            if (full || pos + 1 + n > cap - 1) { full = true; return false; }
+            buf[pos++] = tag;
+            std::memcpy(buf + pos, v, n);
+            pos += n;
+            return true;
+        }
+        void str(const char* s) {
+            if (!s) s = "(null)";
+            if (full || pos + 2 > cap - 1) { full = true; return; }
+            size_t n = std::min(std::strlen(s), cap - 1 - pos - 2);  // truncated if too long
+            buf[pos++] = 's';
+            std::memcpy(buf + pos, s, n);
+            pos += n;
+            buf[pos++] = '\0';
+        }
+        // size of the record
+        size_t end() {
+            if (full) buf[pos++] = 't';
+            return pos;
+        }
+        template<typename T> void arg(T v) {
+            using U = std::decay_t<T>;
+            if constexpr (std::is_same_v<U, char*> || std::is_same_v<U, const char*>) {
+                str(v);
+            } else if constexpr (std::is_floating_point_v<U>) {
+                double d = v;
+                put('d', &d, sizeof(d));
+            } else if constexpr (std::is_pointer_v<U> || std::is_null_pointer_v<U>) {
+                const void* p = v;
+                put('p', &p, sizeof(p));
+            } else if constexpr (std::is_enum_v<U>) {
+                int64_t i = (int64_t)v;
+                put('i', &i, sizeof(i));
+            } else {
+                static_assert(std::is_integral_v<U>, "unsupported MTCL_PRINT argument");
+                if constexpr (std::is_signed_v<U>) {
+                    int64_t i = v;
+                    put('i', &i, sizeof(i));
+                } else {
+                    uint64_t u = v;
+                    put('u', &u, sizeof(u));
+                }
+            }
+        }
+    };
+
+    struct Value {
+        char tag = 0;
+        union { int64_t i; uint64_t u; double d; const void* p; };
+        const char* s = nullptr;
+    };
+
+    struct Reader {
+        const char* buf;
+        size_t size, pos = 0;
+        bool truncated = false;
+        bool next(Value& v) {
+            if (pos >= size) return false;
+            v.tag = buf[pos++];
+            if (v.tag == 't') {
+                truncated = true;
+                return false;
+            }
+            if (v.tag == 's') {
+                v.s = buf + pos;
+                pos += std::strlen(v.s) + 1;
+                return true;
+            }
+            size_t n = v.tag == 'p' ? sizeof(void*) : 8;
+            if (pos + n > size) return false;
+            std::memcpy(&v.u, buf + pos, n);
+            pos += n;
+            return true;
+        }
+    };
+
+    inline static std::mutex mtx;        // protects rings and the background thread
+    inline static std::mutex drainMtx;   // one consumer at a time
+    inline static std::vector<std::unique_ptr<Ring>> rings;
+    inline static std::vector<Ring*> freeRings;       // of exited threads, may have pending records
+    inline static std::atomic<bool> started{false};
+    inline static std::atomic<bool> stop{false};
+    inline static std::atomic<bool> closed{false};   // at exit, messages are written synchronously
+    inline static std::thread* worker = nullptr;
+
+    // stops the background thread at exit, writing the pending messages
+    struct Finalizer {
+        ~Finalizer() { AsyncLog::shutdown(); }
+    };
+    inline static Finalizer finalizer;
+
+    // gives back the ring buffer of its thread at exit: the pending records
+    // are written by the next drain, also if a new thread reuses the buffer
+    struct Owner {
+        Ring* r = nullptr;
+        ~Owner() {
+            if (!r) return;
+            std::unique_lock dlk(drainMtx);
+            std::unique_lock lk(mtx);
+            if (freeRings.size() < LOG_FREE_RINGS || r->tail.load() != r->head.load()) {
+                freeRings.push_back(r);
+                return;
+            }
+            for(auto it = rings.begin(); it != rings.end(); ++it)
+                if (it->get() == r) {
+                    rings.erase(it);
+                    break;
+                }
+        }
+    };
+
+    static Ring* ring() {
+        thread_local Owner owner;
+        if (!owner.r) {
+            std::unique_lock lk(mtx);
+            if (!freeRings.empty()) {
+                owner.r = freeRings.back();
+                freeRings.pop_back();
+            } else {
+                rings.emplace_back(new Ring);
+                owner.r = rings.back().get();
+            }
+        }
+        return owner.r;
+    }
+
+    static void start() {
+        std::unique_lock lk(mtx);
+        if (started) return;
+        static bool atfork = false;
+        if (!atfork) {
+            // the child has no background thread and must not write the
+            // messages already written (or to be written) by the parent
+            pthread_atfork([]{ flush(); drainMtx.lock(); mtx.lock(); },
+                           []{ mtx.unlock(); drainMtx.unlock(); },
+                           []{
+                               for(auto& r : rings) r->tail.store(r->head.load());
+                               worker  = nullptr;  // not running in the child
+                               started = false;
+                               mtx.unlock(); drainMtx.unlock();
+                           });
+            atfork = true;
+        }
+        stop    = false;
+        worker  = new std::thread([]{
+            while(!stop.load(std::memory_order_relaxed))
+                if (drain() == 0)
+                    std::this_thread::sleep_for(std::chrono::microseconds(LOG_FLUSH_INTERVAL));
+            drain();
+        });
+        started = true;
+    }
+
+    static void format(const Record& rec, std::string& out) {
+        Reader rd{rec.data, rec.size};
+        Value v;
+        out.clear();
+        if (rd.next(v) && v.tag == 's') out = v.s;  // prefix
+        char buf[LOG_RECORD_SIZE + 64];
+        for(const char* p = rec.fmt; *p; ) {
+            if (*p != '%') { out += *p++; continue; }
+            if (p[1] == '%') { out += '%'; p += 2; continue; }
+            const char* s = p++;
+            while (*p && std::strchr("-+ #0", *p)) ++p;
+            while (std::isdigit((unsigned char)*p)) ++p;
+            if (*p == '.') { ++p; while (std::isdigit((unsigned char)*p)) ++p; }
+            std::string spec(s, p - s);
+            while (*p && std::strchr("hljztLq", *p)) ++p;  // replaced below
+            char conv = *p ? *p++ : '\0';
+            if (!rd.next(v)) { out += "<?>"; continue; }
+            auto asInt = [&]{ return v.tag == 'd' ? (int64_t)v.d : v.i; };
+            switch(conv) {
+            case 'd': case 'i':
+                std::snprintf(buf, sizeof(buf), (spec + "lld").c_str(), (long long)asInt()); break;
+            case 'u': case 'x': case 'X': case 'o':
+                std::snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), (unsigned long long)asInt()); break;
+            case 'c':
+                std::snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int)asInt()); break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                std::snprintf(buf, sizeof(buf), (spec + conv).c_str(), v.tag == 'd' ? v.d : (double)v.i); break;
+            case 's':
+                std::snprintf(buf, sizeof(buf), (spec + "s").c_str(), v.tag == 's' ? v.s : "<?>"); break;
+            case 'p':
+                std::snprintf(buf, sizeof(buf), (spec + "p").c_str(), v.p); break;
+            default:
+                std::snprintf(buf, sizeof(buf), "%s%c", spec.c_str(), conv);
+            }
+            out += buf;
+        }
+        if (rd.truncated) {
+            bool nl = !out.empty() && out.back() == '\n';
+            if (nl) out.pop_back();
+            out += nl ? " (truncated)\n" : " (truncated)";
+        }
+    }
+
+    // writes the pending records, returns how many
+    static size_t drain() {
+        std::unique_lock dlk(drainMtx);
+        std::vector<Ring*> rs;
+        {
+            std::unique_lock lk(mtx);
+            for(auto& r : rings) rs.push_back(r.get());
+        }
+        size_t n = 0;
+        std::string line;
+        for(auto r : rs) {
+            uint64_t tail = r->tail.load(std::memory_order_relaxed);
+            uint64_t head = r->head.load(std::memory_order_acquire);
+            for(; tail < head; ++tail, ++n) {
+                const Record& rec = r->records[tail % LOG_BUFFER_RECORDS];
+                format(rec, line);
+                std::fputs(line.c_str(), rec.stream);
+                r->tail.store(tail + 1, std::memory_order_release);
+            }
+        }
+        if (n) {
+            std::fflush(stdout);
+            std::fflush(stderr);
+        }
+        return n;
+    }
+
+public:
+    template<typename... Args>
+    static void log(FILE* stream, const char* prefix, const char* fmt, Args... args) {
+        if (!started.load(std::memory_order_relaxed)) {
+            if (closed) {
+                Record rec{stream, fmt, 0, {}};
+                Writer w{rec.data, sizeof(rec.data)};
+                w.str(prefix);
+                (w.arg(args), ...);
+                rec.size = w.end();
+                std::string line;
+                format(rec, line);
+                std::fputs(line.c_str(), stream);
+                std::fflush(stream);
+                return;
+            }
+            start();
+        }
+        Ring* r = ring();
+        uint64_t head = r->head.load(std::memory_order_relaxed);
+        if (head - r->tail.load(std::memory_order_acquire) == LOG_BUFFER_RECORDS)
+            drain();  // the background thread is late, no message is lost
+        Record& rec = r->records[head % LOG_BUFFER_RECORDS];
+        rec.stream = stream;
+        rec.fmt    = fmt;
+        Writer w{rec.data, sizeof(rec.data)};
+        w.str(prefix);
+        (w.arg(args), ...);
+        rec.size = w.end();
+        r->head.store(head + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Writes all the messages logged so far.
+     */
+    static void flush() {
+        if (started) drain();
+    }
+
+    // stops the background thread, called at exit
+    static void shutdown() {
+        std::thread* t;
+        {
+            std::unique_lock lk(mtx);
+            t = worker;
+            worker  = nullptr;
+            started = false;
+            closed  = true;
+        }
+        if (!t) return;
+        stop = true;
+        t->join();
+        delete t;
+        drain();
+    }
+};
+
+#else
+
+class AsyncLog {
+public:
+    static void flush() {}
+};
+
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #include <csignal>
 #include <cstdlib>
 #include <map>
+#include <deque>
 #include <set>
 #include <vector>
 #include <queue>
@@ -14,9 +15,14 @@
 
 #include "handle.hpp"
 #include "handleUser.hpp"
+#include "handleTyped.hpp"
+#include "handleUpgradable.hpp"
+#include "handlePooled.hpp"
+#include "metrics.hpp"
 #include "protocolInterface.hpp"
 #include "protocols/tcp.hpp"
 #include "protocols/shm.hpp"
+#include "protocols/emu.hpp"
 
 #ifdef ENABLE_CONFIGFILE
 #include <fstream>
@@ -46,51 +52,121 @@
 
 int  mtcl_verbose = -1;
 
+// first message sent on a new connection (connection handshake)
+enum HandshakeType : int {
+	HANDSHAKE_P2P        = 0,
+	HANDSHAKE_COLLECTIVE = 1,
+	HANDSHAKE_UPGRADABLE = 2,  // P2P through the proxies, followed by the upgrade token
+	HANDSHAKE_UPGRADE    = 3,  // direct connection replacing a proxied one, followed by the token
+	HANDSHAKE_POOLED     = 4   // P2P connection kept open after the close for the next session
+};
+
 /**
- * Main class for the library
+ * Runtime of the library: the protocols with their connections, the IO
+ * thread and the ready queue. The runtimes are independent, e.g., one per
+ * core in a shared-nothing design or one per traffic class, and the static
+ * API of Manager uses a default one.
+ *
+ * The process-wide facilities (tracing, capture, metrics exporter) are
+ * started by the first runtime initialized and stopped when the last one is
+ * finalized, the exporter reports all the initialized runtimes.
+ * MPI can be used by one runtime only.
 */
-class Manager {
+class MTCLRuntime {
     friend class ConnType;
     friend class CollectiveContext;
+    friend class Manager;
+
+    // runtimes using the process-wide facilities
+    inline static std::mutex facilities_mutex;
+    inline static int users = 0;
+    // initialized and not finalized runtimes, reported by the exporter
+    inline static std::mutex runtimes_mutex;
+    inline static std::vector<MTCLRuntime*> runtimes;
    
-    inline static std::map<std::string, std::shared_ptr<ConnType>> protocolsMap;    
-	inline static std::queue<HandleUser> handleReady;
-    inline static std::map<std::string, std::map<std::string,Handle*>> groupsReady;
+    std::map<std::string, std::shared_ptr<ConnType>> protocolsMap;    
+	std::queue<HandleUser> handleReady;
+    std::atomic<size_t> readyDepth{0};  // handleReady.size(), read by the metrics exporter
+    LoopCounters loopStats;
+    unsigned loopReport = 0;  // seconds between two IO loop summaries (MTCL_IOSTATS)
+    uint64_t reportNext = 0;  // time of the next summary and counters at the last one
+    MTCLLoopStats reportPrev;
+    std::map<std::string, MTCLStats> reportPrevProt;
+    std::map<std::string, std::map<std::string,Handle*>> groupsReady;
 #ifndef MTCL_DISABLE_COLLECTIVES
-    inline static std::map<CollectiveContext*, bool> contexts;
+    std::map<CollectiveContext*, bool> contexts;
 #endif
-    inline static std::set<std::string> listening_endps;
-	inline static std::set<std::string> createdTeams;
+    std::set<std::string> listening_endps;
+    // MTCL_PROTOCOLS, or "protocols" in the configuration file: the only available protocols
+    std::set<std::string> enabledProtocols;
+	std::set<std::string> createdTeams;
 	
-    inline static std::string appName;
-    inline static std::string poolName;
+    std::string appName;
+    std::string poolName;
 
 #ifdef ENABLE_CONFIGFILE
-    inline static std::map<std::string, std::pair<std::vector<std::string>, std::vector<std::string>>> pools;
-    inline static std::map<std::string, std::tuple<std::string, std::vector<std::string>, std::vector<std::string>>> components;
+    std::map<std::string, std::pair<std::vector<std::string>, std::vector<std::string>>> pools;
+    std::map<std::string, std::tuple<std::string, std::vector<std::string>, std::vector<std::string>>> components;
+    // peers to connect and teams (participants, root, type) to create at init, per component
+    std::map<std::string, std::vector<std::string>> connectTo;
+    std::map<std::string, std::vector<std::tuple<std::string, std::string, HandleType>>> initTeams;
+    // handles created at init not yet retrieved by connect (per connection string)
+    // and by createTeam (per teamID)
+    std::map<std::string, std::deque<HandleUser>> preconnected;
+    std::map<std::string, HandleUser> preteams;
+    std::mutex preconnect_mutex;
 #endif
 
-    REMOVE_CODE_IF(inline static std::thread t1);
-    inline static bool end;
-    inline static bool initialized = false;
+    REMOVE_CODE_IF(std::thread t1);
+    bool end = false;
+    bool initialized = false;
+    REMOVE_CODE_IF(std::mutex protocols_mutex);  // lazy initialization of the protocols
+    std::thread::id initThread;  // thread that initialized the eager protocols
+
+    // proxied connections that may be replaced by a direct one (accepting side)
+    std::map<std::string, HandleUpgradable*> upgradables;
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE)
+    // direct connections arrived before the proxied connection they replace,
+    // refused after UPGRADE_PENDING_TIMEOUT (the proxied one may be already closed)
+    std::map<std::string, std::pair<Handle*, std::chrono::steady_clock::time_point>> pendingUpgrades;
+#endif
+    // handles to be closed (or yielded) by the IO thread outside the protocols' update
+    std::vector<Handle*> toClose;
+    std::vector<Handle*> toYield;
+    // closed P2P connections ready to be reused, per connection string (connecting side)
+    std::map<std::string, std::deque<Handle*>> connectionPool;
+    size_t poolSize = 0;  // max parked connections per destination (MTCL_CONNECTION_POOL)
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE) && !defined(SINGLE_IO_THREAD)
+    // running upgrades, the finished ones are joined when the next one starts
+    std::map<size_t, std::thread> upgraders;
+    std::vector<size_t> upgradesDone;
+    std::atomic<size_t> upgradeCounter{0};
+#endif
 
-    inline static std::mutex mutex;
-    inline static std::mutex group_mutex;
-    inline static std::mutex ctx_mutex;
-    inline static std::condition_variable condv;
-    inline static std::condition_variable group_cond;
+    std::mutex mutex;
+    std::mutex group_mutex;
+    std::mutex upgrade_mutex;
+    std::mutex pool_mutex;
+    std::mutex ctx_mutex;
+    std::condition_variable condv;
+    std::condition_variable group_cond;
+
+public:
+    MTCLRuntime() {}
+    MTCLRuntime(const MTCLRuntime&) = delete;
+    MTCLRuntime& operator=(const MTCLRuntime&) = delete;
 
 private:
-    Manager() {}
 
 	// initial handshake for a connection, it could be a p2p connection or a connection
-	// part of a collective handle
+	// part of a collective handle. It returns the HandshakeType or -1 in case of error.
+	// For upgradable connections, teamID contains the upgrade token.
 #ifdef ISPROXY
-    static inline int connectionHandshake(char *& teamID, char *& appName, Handle *h) { return 0; }
+    int connectionHandshake(char *& teamID, char *& appName, Handle *h) { return HANDSHAKE_P2P; }
 #else
-	static inline int connectionHandshake(char *& teamID, char *& appName, Handle *h) {
-		// new connection, read handle type (p2p=0, collective=1)
-		int collective = 0;		
+	int connectionHandshake(char *& teamID, char *& appName, Handle *h) {
+		// new connection, read handle type (see HandshakeType)
+		int collective = HANDSHAKE_P2P;
 		size_t size;
 		if (h->probe(size, true) <=0) {
 			MTCL_ERROR("[Manager]:\t", "addinQ handshake error in probe, errno=%d\n", errno);
@@ -98,16 +174,41 @@ private:
 			appName=nullptr;
 			return -1;
 		}
+		if (size == 0) { // EOS, e.g. a pooled connection dropped by the peer
+			MTCL_PRINT(100, "[Manager]:\t", "Manager::addinQ connection closed before the handshake\n");
+			teamID=nullptr;
+			appName=nullptr;
+			return -1;
+		}
 		if (h->receive(&collective, sizeof(int)) <=0) {
 			MTCL_ERROR("[Manager]:\t", "addinQ handshake error in receiving collective flag, errno=%d\n", errno);
 			teamID=nullptr;
 			appName=nullptr;
 			return -1;
 		}
+		// Upgradable connections send further data with the upgrade token
+		if (collective == HANDSHAKE_UPGRADABLE || collective == HANDSHAKE_UPGRADE) {
+			appName=nullptr;
+			if (h->probe(size, true) <= 0 || size>1048576) {
+				MTCL_ERROR("[Manager]:\t", "addinQ handshake error in probe, upgrade token, errno=%d\n", errno);
+				teamID=nullptr;
+				return -1;
+			}
+			teamID = new char[size+1];
+			assert(teamID);
+			if (h->receive(teamID, size) <=0) {
+				MTCL_ERROR("[Manager]:\t", "addinQ handshake error in receiving upgrade token, errno=%d\n", errno);
+				delete [] teamID;
+				teamID=nullptr;
+				return -1;
+			}
+			teamID[size] = '\0';
+			return collective;
+		}
 		// If collective, the handle sends further data with string teamID.
 		// The teamID uniquely associate a single context to all handles of the same collective
 		// This is useful to synchronize the root thread for the accepts.
-		if(collective) {
+		if(collective == HANDSHAKE_COLLECTIVE) {
 			if (h->probe(size, true) <= 0) {
 				MTCL_ERROR("[Manager]:\t", "addinQ handshake error in probe, appName size, errno=%d\n", errno);
 				teamID=nullptr;
@@ -149,19 +250,207 @@ private:
 			}
 			teamID[size] = '\0';			
 			MTCL_PRINT(100, "[Manager]: \t", "Manager::addinQ received connection for team %s from appName=%s\n", teamID, appName);
+			return HANDSHAKE_COLLECTIVE;
 		}	
-		return 0;
+		return collective == HANDSHAKE_POOLED ? HANDSHAKE_POOLED : HANDSHAKE_P2P;
 	}
 #endif
-	
+
+	// addinQ is called by the protocols while holding their locks, the
+	// handle cannot be closed there.
+	void closeLater(Handle* h) {
+#if defined(SINGLE_IO_THREAD)
+		h->close(true, true);
+#else
+		toClose.push_back(h);
+#endif
+	}
+
+	void yieldLater(Handle* h) {
+#if defined(SINGLE_IO_THREAD)
+		h->yield();
+#else
+		toYield.push_back(h);
+#endif
+	}
+
+	// A pooled connection accepted by this side ended its session, its next
+	// message will be the handshake of a new session.
+	void rearmConnection(Handle* h, bool eos, bool broken) {
+		if (broken || end) {
+			h->close(true, true);
+			return;
+		}
+		h->rearmed = true;
+		h->peerEOS = eos;
+		h->yield();
+	}
+
+	// A rearmed connection is readable: the rest of the previous session is
+	// discarded up to the peer EOS, then it is a new connection.
+	// Returns true if the handle has to be treated as a new connection.
+	bool resumeConnection(Handle* h) {
+		if (h->peerEOS) {
+			h->rearmed = h->peerEOS = false;
+			return true;
+		}
+		size_t size;
+		if (h->probe(size, true) <= 0) {
+			closeLater(h);
+			return false;
+		}
+		if (size == 0) h->peerEOS = true;
+		else {
+			std::vector<char> buff(size);
+			if (h->receive(buff.data(), size) <= 0) {
+				closeLater(h);
+				return false;
+			}
+		}
+		yieldLater(h);
+		return false;
+	}
+
+	// A proxied P2P connection has been accepted, the peer may replace it later
+	// with a direct connection presenting the same token.
+	Handle* acceptUpgradable(const std::string& token, Handle* h) {
+		auto w = new HandleUpgradable(h, false);
+		w->onClose = [this, token]() {
+			REMOVE_CODE_IF(std::unique_lock lk(upgrade_mutex));
+			upgradables.erase(token);
+		};
+		REMOVE_CODE_IF(std::unique_lock lk(upgrade_mutex));
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE)
+		auto it = pendingUpgrades.find(token);
+		if (it != pendingUpgrades.end()) { // the direct connection has been faster
+			if (w->attach(it->second.first, true)) {
+				MTCL_PRINT(100, "[Manager]:\t", "Manager::addinQ connection %s upgraded to a direct connection\n", token.c_str());
+			} else closeLater(it->second.first);
+			pendingUpgrades.erase(it);
+			return w;
+		}
+#endif
+		upgradables[token] = w;
+		return w;
+	}
+
+	// The direct connection h replaces the proxied connection identified by token
+	void acceptUpgrade(const std::string& token, Handle* h) {
+		REMOVE_CODE_IF(std::unique_lock lk(upgrade_mutex));
+		auto it = upgradables.find(token);
+		if (it == upgradables.end()) {
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE)
+			// the proxied connection has not been received yet, or it has been
+			// already closed, in that case expireUpgrades refuses h
+			pendingUpgrades[token] = {h, std::chrono::steady_clock::now()};
+#else
+			// the proxied connection may be already closed, the peer keeps it
+			MTCL_PRINT(100, "[Manager]:\t", "Manager::addinQ cannot upgrade connection %s\n", token.c_str());
+			closeLater(h);
+#endif
+			return;
+		}
+		if (it->second->attach(h, true)) {
+			MTCL_PRINT(100, "[Manager]:\t", "Manager::addinQ connection %s upgraded to a direct connection\n", token.c_str());
+		} else {
+			MTCL_PRINT(100, "[Manager]:\t", "Manager::addinQ cannot upgrade connection %s\n", token.c_str());
+			closeLater(h);
+		}
+		upgradables.erase(it);
+	}
+
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE)
+	// Closes the direct connections waiting too long for their proxied one, the
+	// peer waiting for the ack gives up. Called by the IO thread holding upgrade_mutex.
+	void expireUpgrades() {
+		auto now = std::chrono::steady_clock::now();
+		for(auto it = pendingUpgrades.begin(); it != pendingUpgrades.end(); ) {
+			if (now - it->second.second < std::chrono::milliseconds(UPGRADE_PENDING_TIMEOUT)) {
+				++it;
+				continue;
+			}
+			MTCL_PRINT(100, "[Manager]:\t", "Manager::addinQ cannot upgrade connection %s\n", it->first.c_str());
+			closeLater(it->second.first);
+			it = pendingUpgrades.erase(it);
+		}
+	}
+#endif
+
+	// the ready queue, called holding mutex (if not SINGLE_IO_THREAD)
+	void pushReady(CommunicationHandle* ready, bool newConnection) {
+		ready->stats.readyPush();
+		handleReady.push(HandleUser(ready, true, newConnection));
+		readyDepth.store(handleReady.size(), std::memory_order_relaxed);
+		loopStats.dispatch();
+	}
+
+	HandleUser popReady() {
+		auto el = std::move(handleReady.front());
+		handleReady.pop();
+		readyDepth.store(handleReady.size(), std::memory_order_relaxed);
+		el.realHandle->stats.readyPop();
+		return el;
+	}
+
+	// prints the IO loop statistics of the last loopReport seconds
+	void reportLoop() {
+#if defined(MTCL_ENABLE_STATS)
+		if (!reportNext) reportNext = stats_now() + loopReport * 1000000000ull;
+		if (stats_now() < reportNext) return;
+		reportNext += loopReport * 1000000000ull;
+		MTCLLoopStats& prev = reportPrev;
+		std::map<std::string, MTCLStats>& prevProt = reportPrevProt;
+
+		// the counters may have been reset by getStats or getLoopStats
+		auto d = [](uint64_t now, uint64_t before) { return now >= before ? now - before : now; };
+		MTCLLoopStats l = loopStats.snapshot();
+		uint64_t it = d(l.iterations, prev.iterations), dt = d(l.loopTime, prev.loopTime);
+		uint64_t cp = d(l.collectivePolls, prev.collectivePolls);
+		std::string prots;
+		char buf[160];
+		for(auto& [prot, conn] : protocolsMap) {
+			MTCLStats s = conn->stats.snapshot(), &p = prevProt[prot];
+			uint64_t calls = d(s.updateCalls, p.updateCalls), ut = d(s.updateTime, p.updateTime);
+			uint64_t rc = d(s.readyCount, p.readyCount), rt = d(s.readyTime, p.readyTime);
+			std::snprintf(buf, sizeof(buf), ", %s update %.1fus avg %.1fus max %.1f%% ready %.1fus avg",
+						  prot.c_str(), calls ? ut / 1e3 / calls : 0., s.updateMaxTime / 1e3,
+						  dt ? 100. * ut / dt : 0., rc ? rt / 1e3 / rc : 0.);
+			prots += buf;
+			p = s;
+		}
+		MTCL_LOG(stderr, "[Manager]:\t", "IO loop: %.0f it/s, %.3f dispatched/it (max %lu), collectives %lu polls %.1fus avg%s\n",
+				 dt ? it * 1e9 / dt : 0., it ? double(d(l.dispatched, prev.dispatched)) / it : 0.,
+				 l.maxDispatched, cp, cp ? d(l.collectivePollTime, prev.collectivePollTime) / 1e3 / cp : 0.,
+				 prots.c_str());
+		prev = l;
+#endif
+	}
 #if defined(SINGLE_IO_THREAD)
-	static inline void addinQ(bool b, Handle* h) {
+	void addinQ(bool b, Handle* h) {
+		if (h->outer) h = h->outer;  // decorated connection (e.g., EMU)
+		else if (b && h->parent->decorator) h = h->parent->decorator.load()->decorate(h->parent, h);
+		if (h->parked) return;  // checked when reused
+		if (h->rearmed && !(b = resumeConnection(h))) return;
         if(b) { // we have to see if it is part of a collective
 			char *teamID=nullptr;
 			char *appName=nullptr;
-			if (connectionHandshake(teamID, appName, h)==-1) return;
+			int kind = connectionHandshake(teamID, appName, h);
+			if (kind == -1) {
+				closeLater(h);
+				return;
+			}
 
-			if (teamID) {
+			if (kind == HANDSHAKE_UPGRADE) {
+				acceptUpgrade(teamID, h);
+				delete [] teamID;
+				return;
+			}
+			if (kind == HANDSHAKE_UPGRADABLE) {
+				h = acceptUpgradable(teamID, h);
+				delete [] teamID;
+			}
+			else if (kind == HANDSHAKE_POOLED) h = new HandlePooled(h, [this](Handle* p, bool eos, bool broken){ rearmConnection(p, eos, broken); });
+			else if (teamID) {
                 if(groupsReady.count(teamID) == 0)
                     groupsReady.emplace(teamID, std::map<std::string, Handle*>{});
 
@@ -172,17 +461,37 @@ private:
             }
         }
 		
-		handleReady.push(HandleUser(h, true, b));
+		CommunicationHandle* ready = h->wrapper ? h->wrapper : h;
+		MTCL_PROBE3(addinq, (size_t)ready, b, h->getProtocol());
+		pushReady(ready, b);
 	}
 #else	
-    static inline void addinQ(const bool b, Handle* h) {
+    void addinQ(bool b, Handle* h) {
+		if (h->outer) h = h->outer;  // decorated connection (e.g., EMU)
+		else if (b && h->parent->decorator) h = h->parent->decorator.load()->decorate(h->parent, h);
+		if (h->parked) return;  // checked when reused
+		if (h->rearmed && !(b = resumeConnection(h))) return;
 
         if(b) { // For each new connection... is the handle coming from a collective?
 			char *teamID  = nullptr;
 			char *appName = nullptr;
-			if (connectionHandshake(teamID, appName, h) == -1) return;
+			int kind = connectionHandshake(teamID, appName, h);
+			if (kind == -1) {
+				closeLater(h);
+				return;
+			}
 
-			if (teamID) {
+			if (kind == HANDSHAKE_UPGRADE) {
+				acceptUpgrade(teamID, h);
+				delete[] teamID;
+				return;
+			}
+			if (kind == HANDSHAKE_UPGRADABLE) {
+				h = acceptUpgradable(teamID, h);
+				delete[] teamID;
+			}
+			else if (kind == HANDSHAKE_POOLED) h = new HandlePooled(h, [this](Handle* p, bool eos, bool broken){ rearmConnection(p, eos, broken); });
+			else if (teamID) {
 				std::unique_lock lk(group_mutex);
                 if(groupsReady.count(teamID) == 0)
                     groupsReady.emplace(teamID, std::map<std::string, Handle*>{});
@@ -197,12 +506,14 @@ private:
         }
 
         std::unique_lock lk(mutex);
-        handleReady.push(HandleUser(h, true, b));
+        CommunicationHandle* ready = h->wrapper ? h->wrapper : h;
+        MTCL_PROBE3(addinq, (size_t)ready, b, h->getProtocol());
+        pushReady(ready, b);
 		condv.notify_one();
     }
 #endif
 #ifndef MTCL_DISABLE_COLLECTIVES	
-    static bool poll(CollectiveContext* realHandle) {
+    bool poll(CollectiveContext* realHandle) {
 		if (realHandle->probed.first) { // previously probed
             return true;
 		}
@@ -211,11 +522,33 @@ private:
     }
 #endif
 	// IO thread function
-    static void getReadyBackend() {
+    void getReadyBackend() {
+        Trace::setThreadName("mtcl-io");
+        loopStats.begin();
         while(!end){
             for(auto& [prot, conn] : protocolsMap) {
+                if (!conn->active.load(std::memory_order_acquire)) continue;
+                TraceScope tr("update", prot, TRACE_UPDATE_THRESHOLD*1000);
+                MTCL_PROBE1(update, prot.c_str());
+                StatsTimer t;
                 conn->update();
-            }			
+                conn->stats.updated(t.elapsed());
+                MTCL_PROBE1(update_done, prot.c_str());
+            }
+            Trace::poll();
+			{
+				std::vector<Handle*> v, y;
+				{
+					std::unique_lock lk(upgrade_mutex);
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE)
+					expireUpgrades();
+#endif
+					v.swap(toClose);
+					y.swap(toYield);
+				}
+				for(auto h : v) h->close(true, true);
+				for(auto h : y) h->yield();
+			}
 			if constexpr (IO_THREAD_POLL_TIMEOUT)
 				std::this_thread::sleep_for(std::chrono::microseconds(IO_THREAD_POLL_TIMEOUT));
 
@@ -224,22 +557,26 @@ private:
                 std::unique_lock lk(ctx_mutex);
                 for(auto& [ctx, toManage] : contexts) {
                     if(toManage) {
+                        StatsTimer t;
                         bool res = poll(ctx);
+                        loopStats.collectivePolled(t.elapsed());
                         if(res) {
                             toManage = false;
                             std::unique_lock readylk(mutex);
-                            handleReady.push(HandleUser(ctx, true, false));
+                            pushReady(ctx, false);
                             condv.notify_one();
                         }
                     }
                 }
             }
 #endif
+            loopStats.iteration();
+            if (loopReport) reportLoop();
         }
     }
 #ifdef ENABLE_CONFIGFILE
     template <bool B, typename T>
-    static std::vector<std::string> JSONArray2VectorString(const rapidjson::GenericArray<B, T>& arr){
+    std::vector<std::string> JSONArray2VectorString(const rapidjson::GenericArray<B, T>& arr){
         std::vector<std::string> output;
         for(auto& e : arr)  
             output.push_back(e.GetString());
@@ -247,7 +584,18 @@ private:
         return output;
     }
     
-    static int parseConfig(std::string& f){
+    HandleType getTeamType(const std::string& t) {
+        static const std::map<std::string, HandleType> types {
+            {"MTCL_BROADCAST", MTCL_BROADCAST}, {"MTCL_SCATTER", MTCL_SCATTER},
+            {"MTCL_FANIN", MTCL_FANIN}, {"MTCL_FANOUT", MTCL_FANOUT},
+            {"MTCL_GATHER", MTCL_GATHER}, {"MTCL_ALLGATHER", MTCL_ALLGATHER},
+            {"MTCL_ALLTOALL", MTCL_ALLTOALL}
+        };
+        auto it = types.find(t);
+        return it == types.end() ? INVALID_TYPE : it->second;
+    }
+
+    int parseConfig(std::string& f){
         std::ifstream ifs(f);
         if ( !ifs.is_open() ) {
 			MTCL_ERROR("[Manager]:\t", "parseConfig: cannot open file %s for reading, skip it\n",
@@ -262,6 +610,11 @@ private:
 			return -1;
         }
 
+        // protocols available to all the components, MTCL_PROTOCOLS has the precedence
+        if (doc.HasMember("protocols") && doc["protocols"].IsArray() && !std::getenv("MTCL_PROTOCOLS"))
+            for(auto& p : JSONArray2VectorString(doc["protocols"].GetArray()))
+                enabledProtocols.insert(p);
+
         if (doc.HasMember("pools") && doc["pools"].IsArray()){
             // architecture 
             for (auto& c : doc["pools"].GetArray())
@@ -284,6 +637,20 @@ private:
 					
                     auto listen_strs = (c.HasMember("listen-endpoints") && c["listen-endpoints"].IsArray()) ? JSONArray2VectorString(c["listen-endpoints"].GetArray()) : std::vector<std::string>();
                     components[name] = std::make_tuple(c["host"].GetString(), JSONArray2VectorString(c["protocols"].GetArray()), listen_strs);
+
+                    if (c.HasMember("connect-to") && c["connect-to"].IsArray())
+                        connectTo[name] = JSONArray2VectorString(c["connect-to"].GetArray());
+                    if (c.HasMember("teams") && c["teams"].IsArray())
+                        for(auto& t : c["teams"].GetArray()) {
+                            HandleType type = INVALID_TYPE;
+                            if (t.IsObject() && t.HasMember("participants") && t["participants"].IsString() && t.HasMember("root") && t["root"].IsString() && t.HasMember("type") && t["type"].IsString())
+                                type = getTeamType(t["type"].GetString());
+                            if (type == INVALID_TYPE) {
+                                MTCL_ERROR("[Manager]:\t", "parseConfig: a team of component %s is not well defined. Skipping it.\n", name);
+                                continue;
+                            }
+                            initTeams[name].emplace_back(t["participants"].GetString(), t["root"].GetString(), type);
+                        }
                 } else
 					  MTCL_ERROR("[Manager]:\t", "parseConfig: an object in components is not well defined. Skipping it.\n");
         }
@@ -291,8 +658,104 @@ private:
     }
 #endif
 
+#ifdef ENABLE_CONFIGFILE
+	// Connects to the peers and creates the teams listed for this component
+	// in the configuration file ("connect-to" and "teams"), all in parallel.
+	// The handles are then returned by connect and createTeam.
+	void preconnect() {
+		REMOVE_CODE_IF(std::vector<std::thread> threads);
+		for(auto& s : connectTo[appName]) {
+			auto f = [this, s]() {
+				auto h = connectNew(s, CCONNECTION_RETRY, CCONNECTION_TIMEOUT);
+				if (!h.isValid()) {
+					MTCL_ERROR("[Manager]:\t", "Manager::init cannot connect to %s\n", s.c_str());
+					return;
+				}
+				MTCL_PRINT(100, "[Manager]:\t", "Manager::init connected to %s\n", s.c_str());
+				REMOVE_CODE_IF(std::unique_lock lk(preconnect_mutex));
+				preconnected[s].push_back(std::move(h));
+			};
+			ADD_CODE_IF(f());
+			REMOVE_CODE_IF(threads.emplace_back(f));
+		}
+#ifndef MTCL_DISABLE_COLLECTIVES
+		for(auto& [participants, root, type] : initTeams[appName]) {
+			auto f = [this, participants=participants, root=root, type=type]() {
+				auto h = createTeam(participants, root, type);
+				if (!h.isValid()) {
+					MTCL_ERROR("[Manager]:\t", "Manager::init cannot create team %s (root %s)\n", participants.c_str(), root.c_str());
+					return;
+				}
+				MTCL_PRINT(100, "[Manager]:\t", "Manager::init created team %s (root %s)\n", participants.c_str(), root.c_str());
+				REMOVE_CODE_IF(std::unique_lock lk(preconnect_mutex));
+				preteams.emplace(participants + root + "-" + std::to_string(type), std::move(h));
+			};
+			ADD_CODE_IF(f());
+			REMOVE_CODE_IF(threads.emplace_back(f));
+		}
+#endif
+		REMOVE_CODE_IF(for(auto& t : threads) t.join());
+	}
+#endif
+
+#ifndef ISPROXY
+	// A pooled connection opened by this side ended its session, it is
+	// kept for the next connect to the same destination.
+	void parkConnection(const std::string& s, Handle* h, bool eos, bool broken) {
+		if (!broken && !end) {
+			std::unique_lock lk(pool_mutex);
+			auto& q = connectionPool[s];
+			if (q.size() < poolSize) {
+				h->parked  = true;
+				h->peerEOS = eos;
+				q.push_back(h);
+				return;
+			}
+		}
+		h->close(true, true);
+	}
+
+	// The peer must have ended the previous session (anything it sent before
+	// its EOS is discarded) and the connection must be still open.
+	bool isReusable(Handle* h) {
+		size_t size;
+		while(!h->peerEOS) {
+			// no EOS yet: the peer is still using the previous session
+			if (h->probe(size, false) <= 0) return false;
+			if (size == 0) h->peerEOS = true;
+			else {
+				std::vector<char> buff(size);
+				if (h->receive(buff.data(), size) <= 0) return false;
+			}
+		}
+		return h->probe(size, false) == -1 && (errno == EWOULDBLOCK || errno == EAGAIN);
+	}
+
+	// returns a parked connection to s, if any, and starts a new session on it
+	Handle* reuseConnection(const std::string& s) {
+		while(true) {
+			Handle* h;
+			{
+				std::unique_lock lk(pool_mutex);
+				auto it = connectionPool.find(s);
+				if (it == connectionPool.end() || it->second.empty()) return nullptr;
+				h = it->second.front();
+				it->second.pop_front();
+			}
+			int kind = HANDSHAKE_POOLED;
+			if (isReusable(h) && h->send(&kind, sizeof(int)) != -1) {
+				MTCL_PRINT(100, "[Manager]:\t", "Manager::connect reusing a pooled connection to %s\n", s.c_str());
+				h->parked = h->peerEOS = false;
+				return h;
+			}
+			MTCL_PRINT(100, "[Manager]:\t", "Manager::connect dropping a stale pooled connection to %s\n", s.c_str());
+			h->close(true, true);
+		}
+	}
+#endif
+
 #ifndef MTCL_DISABLE_COLLECTIVES
-    static void releaseTeam(CollectiveContext* ctx) {
+    void releaseTeam(CollectiveContext* ctx) {
         std::unique_lock lk(ctx_mutex);
         auto it = contexts.find(ctx);
         if (it != contexts.end())
@@ -311,7 +774,7 @@ public:
      * @param configFile (Optional) Path of the configuration file for the application. It can be a unique configuration file containing both architecture information and application specific information (deployment included).
      * @param configFile2 (Optional) Additional configuration file in the case architecture information and application information are splitted in two separate files. 
     */
-    static int init(std::string appName, std::string configFile1 = "", std::string configFile2 = "") {
+    int init(std::string appName, std::string configFile1 = "", std::string configFile2 = "") {
 		std::signal(SIGPIPE, SIG_IGN);
 
 		char *level;
@@ -329,14 +792,46 @@ public:
 					MTCL_ERROR("[Manger]:\t", "invalid MTCL_VERBOSE value, it should be a number or all|ALL|max|MAX\n");
 				}
 		}
+		char *pool;
+		if ((pool=std::getenv("MTCL_CONNECTION_POOL"))!= NULL) {
+			try {
+				poolSize=std::stoul(pool);
+			} catch(...) {
+				MTCL_ERROR("[Manager]:\t", "invalid MTCL_CONNECTION_POOL value, it should be a number\n");
+			}
+		}
+		char *protocols;
+		if ((protocols=std::getenv("MTCL_PROTOCOLS"))!= NULL) {
+			std::stringstream ss(protocols);
+			std::string p;
+			while(std::getline(ss, p, ','))
+				if (!p.empty()) enabledProtocols.insert(p);
+		}
+		char *iostats;
+		if ((iostats=std::getenv("MTCL_IOSTATS"))!= NULL) {
+#if defined(MTCL_ENABLE_STATS)
+			try {
+				loopReport=std::stoul(iostats);
+			} catch(...) {
+				MTCL_ERROR("[Manager]:\t", "invalid MTCL_IOSTATS value, it should be a number of seconds\n");
+			}
+#else
+			MTCL_ERROR("[Manager]:\t", "MTCL_IOSTATS is ignored, the library is not compiled with MTCL_ENABLE_STATS\n");
+#endif
+		}
 		
-        Manager::appName = appName;
+        this->appName = appName;
 
 		// default transports protocol
         registerType<ConnTcp>("TCP");
 
 		registerType<ConnSHM>("SHM");
 
+		registerType<ConnEMU>("EMU");
+		static_cast<ConnEMU*>(protocolsMap["EMU"].get())->transport = [this](const std::string& name) -> ConnType* {
+			return lookupProtocol(name);
+		};
+
 #ifdef ENABLE_MPI
         registerType<ConnMPI>("MPI");
 #endif
@@ -369,22 +864,44 @@ public:
 #else
      // 
 #endif
+		bool first = acquireFacilities();
 		end = false;
-        for (auto &el : protocolsMap) {
-            if (el.second->init(appName) == -1) {
-				MTCL_PRINT(100, "[Manager]:\t", "ERROR initializing protocol %s\n", el.first.c_str());
-			}
+        // the protocols not enabled are not available, the others are
+        // initialized at their first use
+        if (!enabledProtocols.empty()) {
+            for(auto it = protocolsMap.begin(); it != protocolsMap.end(); )
+                if (!enabledProtocols.count(it->first)) it = protocolsMap.erase(it);
+                else ++it;
         }
+        // the thread-affine protocols (e.g., MPI) are initialized here, by the
+        // first runtime only, on the thread that has to finalize them
+        initThread = std::this_thread::get_id();
+        for(auto& [name, conn] : protocolsMap)
+            if (conn->eager && first) lookupProtocol(name, true);
 #ifdef ENABLE_CONFIGFILE
         // Automatically listen from endpoints listed in config file
-        for(auto& le : std::get<2>(components[Manager::appName])){
-            Manager::listen(le);
+        for(auto& le : std::get<2>(components[this->appName])){
+            listen(le);
         }
 #endif
 
-        REMOVE_CODE_IF(t1 = std::thread([&](){Manager::getReadyBackend();}));
+        REMOVE_CODE_IF(t1 = std::thread([this](){ getReadyBackend(); }));
 
         initialized = true;
+
+		// the exporter walks protocolsMap, reported when the protocols are final
+		{
+			std::unique_lock lk(runtimes_mutex);
+			runtimes.push_back(this);
+		}
+		char *metrics;
+		if ((metrics=std::getenv("MTCL_METRICS"))!= NULL) {
+			std::unique_lock lk(facilities_mutex);
+			Metrics::start(metrics, appName, collectMetrics);  // no-op if already running
+		}
+#ifdef ENABLE_CONFIGFILE
+        preconnect();
+#endif
 		return 0;
     }
 
@@ -397,9 +914,35 @@ public:
      * Internally it stops the polling thread started at the initialization and calls the end 
 	 * method of each registered protocols.
 	 */
-    static void finalize(bool blockflag=false) {
+    void finalize(bool blockflag=false) {
+#ifdef ENABLE_CONFIGFILE
+        // handles created at init and never retrieved, the peers get the EOS
+        for(auto& [_, q] : preconnected)
+            for(auto& h : q) h.close();
+        for(auto& [_, h] : preteams) h.close();
+        preconnected.clear();
+        preteams.clear();
+#endif
 		end = true;
+        {
+            std::unique_lock lk(runtimes_mutex);
+            runtimes.erase(std::find(runtimes.begin(), runtimes.end(), this));
+        }
         REMOVE_CODE_IF(t1.join());
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE) && !defined(SINGLE_IO_THREAD)
+        {
+            std::map<size_t, std::thread> running;
+            {
+                std::unique_lock lk(upgrade_mutex);
+                running.swap(upgraders);
+                upgradesDone.clear();
+            }
+            for(auto& [_, t] : running) t.join();
+        }
+#endif
+        for(auto& [_, q] : connectionPool)
+            for(auto h : q) h->close(true, true);
+        connectionPool.clear();
 
         //while(!handleReady.empty()) handleReady.pop();
 #ifndef MTCL_DISABLE_COLLECTIVES
@@ -410,10 +953,15 @@ public:
             else ctx->counter--;
         }
 #endif
-        for (auto [_,v]: protocolsMap) {
-            v->end(blockflag);
+        for (auto [prot,v]: protocolsMap) {
+            if (v->eager && v->active && std::this_thread::get_id() != initThread) {
+                MTCL_ERROR("[Manager]:\t", "Manager::finalize protocol %s not finalized, call finalize on the thread that called init\n", prot.c_str());
+                continue;
+            }
+            if (v->active) v->end(blockflag);
         }
-
+        releaseFacilities();
+        AsyncLog::flush();
     }
 
     /**
@@ -422,10 +970,11 @@ public:
      * The returned value is an Handle passed by value.
     */  
 #if defined(SINGLE_IO_THREAD)
-    static inline HandleUser getNext(std::chrono::microseconds us=std::chrono::hours(87600)) {
+    HandleUser getNext(std::chrono::microseconds us=std::chrono::hours(87600)) {
+		MTCL_PROBE0(getnext);
 		if (!handleReady.empty()) {
-			auto el = std::move(handleReady.front());
-			handleReady.pop();
+			auto el = popReady();
+			MTCL_PROBE1(getnext_done, el.getID());
 			return el;
 		}
 		// if us is not multiple of the IO_THREAD_POLL_TIMEOUT we wait a bit less....
@@ -435,25 +984,41 @@ public:
 			niter = us/std::chrono::milliseconds(IO_THREAD_POLL_TIMEOUT);
 		if (niter==0) niter++;
 		size_t i=0;
+		TraceScope tr("getNext", appName);
+		loopStats.begin();
 		do { 
 			for(auto& [prot, conn] : protocolsMap) {
+				if (!conn->active) continue;
+				TraceScope tru("update", prot, TRACE_UPDATE_THRESHOLD*1000);
+				MTCL_PROBE1(update, prot.c_str());
+				StatsTimer t;
 				conn->update();
+				conn->stats.updated(t.elapsed());
+				MTCL_PROBE1(update_done, prot.c_str());
 			}
+			Trace::poll();
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE)
+			expireUpgrades();
+#endif
 #ifndef MTCL_DISABLE_COLLECTIVES
             for(auto& [ctx, toManage] : contexts) {
                 if(toManage) {
+                    StatsTimer t;
                     bool res = poll(ctx);
+                    loopStats.collectivePolled(t.elapsed());
                     if(res) {
                         toManage = false;
-                        handleReady.push(HandleUser(ctx, true, false));
+                        pushReady(ctx, false);
                     }
                 }
             }
 #endif
+			loopStats.iteration();
+			if (loopReport) reportLoop();
 
 			if (!handleReady.empty()) {
-				auto el = std::move(handleReady.front());
-				handleReady.pop();
+				auto el = popReady();
+				MTCL_PROBE1(getnext_done, el.getID());
 				return el;
 			}
 			if (i >= niter) break;
@@ -461,21 +1026,149 @@ public:
 			if constexpr (IO_THREAD_POLL_TIMEOUT)
 				std::this_thread::sleep_for(std::chrono::microseconds(IO_THREAD_POLL_TIMEOUT));	
 		} while(true);
+		MTCL_PROBE1(getnext_done, 0);
 		return HandleUser(nullptr, true, true);
     }	
 #else	
-    static inline HandleUser getNext(std::chrono::microseconds us=std::chrono::hours(87600)) { 
+    HandleUser getNext(std::chrono::microseconds us=std::chrono::hours(87600)) { 
+        TraceScope tr("getNext", appName);
+        MTCL_PROBE0(getnext);
         std::unique_lock lk(mutex);
         if (condv.wait_for(lk, us, [&]{return !handleReady.empty();})) {
-			auto el = std::move(handleReady.front());
-			handleReady.pop();
+			auto el = popReady();
+			MTCL_PROBE1(getnext_done, el.getID());
 			lk.unlock();
 			return el;
 		}
+        MTCL_PROBE1(getnext_done, 0);
         return HandleUser(nullptr, true, true);
     }
 #endif
-	
+
+    /**
+     * \brief Statistics of each registered transport, i.e., the sum of the
+     * statistics of all its handles (also the ones already closed).
+     *
+     * The counters are zero if the library is not compiled with MTCL_ENABLE_STATS.
+     *
+     * @param reset if true the counters are zeroed after the snapshot
+     * @return a map from the transport name to its statistics
+    */
+    std::map<std::string, MTCLStats> getStats(bool reset=false) {
+        std::map<std::string, MTCLStats> r;
+        for(auto& [prot, conn] : protocolsMap)
+            r[prot] = conn->stats.snapshot(reset);
+        return r;
+    }
+
+    /**
+     * \brief Statistics of the IO loop: iterations, handles dispatched to the
+     * ready queue and polls of the collective contexts. The time spent by each
+     * transport in update() is in its statistics (see getStats).
+     *
+     * The counters are zero if the library is not compiled with MTCL_ENABLE_STATS.
+     *
+     * @param reset if true the counters are zeroed after the snapshot
+    */
+    MTCLLoopStats getLoopStats(bool reset=false) {
+        return loopStats.snapshot(reset);
+    }
+
+private:
+    // the process-wide facilities, returns true for the first runtime
+    bool acquireFacilities() {
+        std::unique_lock lk(facilities_mutex);
+        if (users++) return false;
+        char *trace;
+        if ((trace=std::getenv("MTCL_TRACE"))!= NULL) Trace::init(trace, appName);
+        char *capture;
+        if ((capture=std::getenv("MTCL_CAPTURE"))!= NULL) Capture::init(capture, appName);
+        return true;
+    }
+
+    // stops the process-wide facilities after the last runtime
+    void releaseFacilities() {
+        std::unique_lock lk(facilities_mutex);
+        if (--users) return;
+        Metrics::stop();
+        Trace::flush();
+        Capture::finalize();
+    }
+
+    // appends the metrics of all the runtimes for the exporter (see
+    // metrics.hpp), runs in its thread: protocolsMap does not change after
+    // init and a runtime leaves runtimes before its finalize
+    static void collectMetrics(std::string& out) {
+        std::unique_lock lk(runtimes_mutex);
+        Metrics::family(out, "mtcl_ready_queue_depth", "Handles ready to be returned by Manager::getNext.", "gauge");
+        for(auto rt : runtimes)
+            Metrics::sample(out, "mtcl_ready_queue_depth", rt->appName, "", (double)rt->readyDepth.load(std::memory_order_relaxed));
+#if defined(MTCL_ENABLE_STATS)
+        std::vector<std::map<std::string, MTCLStats>> stats;
+        std::vector<MTCLLoopStats> loops;
+        for(auto rt : runtimes) {
+            auto& s = stats.emplace_back();
+            for(auto& [prot, conn] : rt->protocolsMap)
+                s[prot] = conn->stats.snapshot();
+            loops.push_back(rt->loopStats.snapshot());
+        }
+
+        auto counter = [&](const char* name, const char* help, const char* type, auto field, double scale) {
+            Metrics::family(out, name, help, type);
+            for(size_t i = 0; i < runtimes.size(); ++i)
+                for(auto& [prot, s] : stats[i])
+                    Metrics::sample(out, name, runtimes[i]->appName, "protocol=\"" + Metrics::escape(prot) + "\"", s.*field * scale);
+        };
+        counter("mtcl_messages_sent_total", "Messages sent.", "counter", &MTCLStats::msgSent, 1);
+        counter("mtcl_bytes_sent_total", "Bytes sent.", "counter", &MTCLStats::bytesSent, 1);
+        counter("mtcl_messages_received_total", "Messages received.", "counter", &MTCLStats::msgReceived, 1);
+        counter("mtcl_bytes_received_total", "Bytes received.", "counter", &MTCLStats::bytesReceived, 1);
+        counter("mtcl_probes_total", "Probes, including the ones done by receive.", "counter", &MTCLStats::probes, 1);
+        counter("mtcl_would_block_total", "Non-blocking probes that found nothing.", "counter", &MTCLStats::wouldBlock, 1);
+        counter("mtcl_ready_total", "Handles returned by Manager::getNext.", "counter", &MTCLStats::readyCount, 1);
+        counter("mtcl_ready_wait_seconds_total", "Time spent by the handles in the ready queue.", "counter", &MTCLStats::readyTime, 1e-9);
+        counter("mtcl_connections_opened_total", "Connections opened.", "counter", &MTCLStats::connOpened, 1);
+        counter("mtcl_connections_closed_total", "Connections closed.", "counter", &MTCLStats::connClosed, 1);
+        counter("mtcl_connections", "Connections currently open.", "gauge", &MTCLStats::connOpen, 1);
+        counter("mtcl_update_total", "update() calls by the IO loop.", "counter", &MTCLStats::updateCalls, 1);
+        counter("mtcl_update_seconds_total", "Time spent in update() by the IO loop.", "counter", &MTCLStats::updateTime, 1e-9);
+
+        auto loop = [&](const char* name, const char* help, auto field, double scale) {
+            Metrics::family(out, name, help, "counter");
+            for(size_t i = 0; i < runtimes.size(); ++i)
+                Metrics::sample(out, name, runtimes[i]->appName, "", loops[i].*field * scale);
+        };
+        loop("mtcl_io_loop_iterations_total", "Iterations of the IO loop.", &MTCLLoopStats::iterations, 1);
+        loop("mtcl_io_loop_seconds_total", "Time spent in the IO loop.", &MTCLLoopStats::loopTime, 1e-9);
+        loop("mtcl_io_loop_dispatched_total", "Handles pushed in the ready queue.", &MTCLLoopStats::dispatched, 1);
+        loop("mtcl_collective_polls_total", "Polls of the collective contexts.", &MTCLLoopStats::collectivePolls, 1);
+        loop("mtcl_collective_poll_seconds_total", "Time spent polling the collective contexts.", &MTCLLoopStats::collectivePollTime, 1e-9);
+
+        auto histogram = [&](const std::string& name, const char* help, MTCLHistogram (StatsCounters::*get)()) {
+            Metrics::family(out, name, help, "histogram");
+            for(auto rt : runtimes)
+                for(auto& [prot, conn] : rt->protocolsMap) {
+                    MTCLHistogram h = (conn->stats.*get)();
+                    std::string l = "protocol=\"" + Metrics::escape(prot) + "\"";
+                    uint64_t cumulative = 0;
+                    for(int i = 0; i < MTCLHistogram::NBUCKETS; ++i) {
+                        char le[32];
+                        std::snprintf(le, sizeof(le), "%g", MTCLHistogram::upperBound(i));
+                        cumulative += h.buckets[i];
+                        Metrics::sample(out, name + "_bucket", rt->appName, l + ",le=\"" + le + "\"", (double)cumulative);
+                    }
+                    Metrics::sample(out, name + "_bucket", rt->appName, l + ",le=\"+Inf\"", (double)h.count);
+                    Metrics::sample(out, name + "_sum", rt->appName, l, h.sum * 1e-9);
+                    Metrics::sample(out, name + "_count", rt->appName, l, (double)h.count);
+                }
+        };
+        histogram("mtcl_send_duration_seconds", "Duration of the send calls.", &StatsCounters::sendHistogram);
+        histogram("mtcl_receive_duration_seconds", "Duration of the receive calls.", &StatsCounters::recvHistogram);
+#endif
+    }
+
+public:
+
     /**
      * \brief Create an instance of the protocol implementation.
      * 
@@ -483,7 +1176,7 @@ public:
      * @param name string representing the name of the instance of the protocol
     */
     template<typename T>
-    static void registerType(std::string name){
+    void registerType(std::string name){
         static_assert(std::is_base_of<ConnType,T>::value, "Not a ConnType subclass");
         if(initialized) {
 			MTCL_ERROR("[Manager]:\t", "The Manager has been already initialized. Impossible to register new protocols.\n");
@@ -492,9 +1185,11 @@ public:
 
         protocolsMap[name] = std::shared_ptr<T>(new T);
         
-        protocolsMap[name]->addinQ = [&](bool b, Handle* h){ Manager::addinQ(b,h); };
+        protocolsMap[name]->addinQ = [this](bool b, Handle* h){ addinQ(b,h); };
 
         protocolsMap[name]->instanceName = name;
+
+        protocolsMap[name]->stats.enableHistograms();
     }
 
     /**
@@ -504,22 +1199,163 @@ public:
      * 
      * @param connectionString URI containing parameters to perform the effective listen operation
     */
-    static int listen(std::string s) {
+    int listen(std::string s) {
         // Check if Manager has already this endpoint listening
         if(listening_endps.count(s) != 0) return 0;
         listening_endps.insert(s);
 
         std::string protocol = s.substr(0, s.find(":"));
         
-        if (!protocolsMap.count(protocol)){
+        ConnType* conn = lookupProtocol(protocol);
+        if (!conn){
 			errno=EPROTO;
             return -1;
         }
-        return protocolsMap[protocol]->listen(s.substr(protocol.length()+1, s.length()));
+        return conn->listen(s.substr(protocol.length()+1, s.length()));
+    }
+
+    /**
+     * \brief Initialize a registered protocol.
+     *
+     * The protocols are initialized at their first use (listen or connect),
+     * this call anticipates the initialization. The thread-affine ones (MPI)
+     * are always initialized by init, this call only checks them.
+     *
+     * @param name name of the protocol (e.g., "UCX")
+     * @return 0 on success, -1 if the protocol is not registered or its
+     * initialization failed
+    */
+    int initProtocol(const std::string& name) {
+        return lookupProtocol(name) ? 0 : -1;
+    }
+
+private:
+    // the protocol registered as name, initialized at the first call (the eager
+    // ones by init); nullptr if it is not registered (e.g., not in
+    // MTCL_PROTOCOLS) or its init failed
+    ConnType* lookupProtocol(const std::string& name, bool eagerInit = false) {
+        auto it = protocolsMap.find(name);
+        if (it == protocolsMap.end()) {
+            errno = EPROTONOSUPPORT;
+            return nullptr;
+        }
+        ConnType* conn = it->second.get();
+        if (conn->active.load(std::memory_order_acquire)) return conn;
+        // not initialized by init (another runtime uses it) or its init failed
+        if (conn->eager && !eagerInit) {
+            errno = EPROTONOSUPPORT;
+            return nullptr;
+        }
+        REMOVE_CODE_IF(std::unique_lock lk(protocols_mutex));
+        if (!conn->active && !conn->failed) {
+            MTCL_PRINT(100, "[Manager]:\t", "Manager::lookupProtocol initializing protocol %s\n", name.c_str());
+            if (conn->init(appName) == -1) {
+                MTCL_ERROR("[Manager]:\t", "ERROR initializing protocol %s\n", name.c_str());
+                conn->failed = true;
+            } else conn->active.store(true, std::memory_order_release);
+        }
+        if (conn->failed) {
+            errno = EPROTONOSUPPORT;
+            return nullptr;
+        }
+        return conn;
+    }
+
+    Handle* connectWith(const std::string& protocol, const std::string& address, int retry, unsigned timeout) {
+        ConnType* conn = lookupProtocol(protocol);
+        return conn ? conn->connect(address, retry, timeout) : nullptr;
+    }
+
+public:
+
+
+#ifdef ENABLE_CONFIGFILE
+    // connects directly to one of the listening endpoints of the component
+    // (with any registered protocol if protocol is empty)
+    Handle* connectDirect(const std::tuple<std::string, std::vector<std::string>, std::vector<std::string>>& component,
+                                 const std::string& protocol, int retry, unsigned timeout) {
+        for (auto& le : std::get<2>(component)){
+            if (protocol.empty()){
+                std::string sWoProtocol = le.substr(le.find(":") + 1, le.length());
+                std::string remote_protocol = le.substr(0, le.find(":"));
+                if (protocolsMap.count(remote_protocol)){
+                    auto* h = connectWith(remote_protocol, sWoProtocol, retry, timeout);
+                    if (h) return h;
+                }
+            }
+            else if (le.find(protocol) != std::string::npos){
+                auto* handle = connectWith(protocol, le.substr(le.find(":") + 1, le.length()), retry, timeout);
+                if (handle) return handle;
+            }
+        }
+        return nullptr;
     }
+#endif
 
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE) && !defined(SINGLE_IO_THREAD)
+    // Tries to reach directly the peer of a proxied connection. If the peer accepts
+    // the direct connection, it replaces the proxied one in the HandleUpgradable.
+    void upgradeConnection(HandleUpgradable* w, const std::string s, const std::string token) {
+        size_t pos;
+        std::string protocol = s.substr(0, (pos = s.find(":")) == std::string::npos ? 0 : pos);
+        std::string appLabel = protocol.empty() ? s : s.substr(pos + 1, s.length());
+
+        Handle* d = connectDirect(components.at(appLabel), protocol, UPGRADE_CONNECTION_RETRY, UPGRADE_CONNECTION_TIMEOUT);
+        bool ok = false;
+        if (d) {
+            int kind = HANDSHAKE_UPGRADE, ack = 0;
+            size_t sz;
+            ok = d->send(&kind, sizeof(int)) != -1 &&
+                 d->send(token.c_str(), token.length()) != -1;
+            // waits for the ack, giving up if the connection is closed in the meantime
+            ssize_t r = -1;
+            while (ok && (r = d->probe(sz, false)) == -1 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+                if (end || w->isClosed()) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            ok = ok && r > 0 && sz == sizeof(int) &&
+                 d->receive(&ack, sizeof(int)) > 0 && ack == 1;
+        }
+        if (ok && w->attach(d, false)) {
+            MTCL_PRINT(100, "[Manager]:\t", "Manager::connect connection to %s upgraded to a direct connection\n", s.c_str());
+        } else {
+            MTCL_PRINT(100, "[Manager]:\t", "Manager::connect connection to %s stays on the proxies\n", s.c_str());
+            if (d) d->close(true, true);
+            w->upgradeFailed();
+        }
+        static_cast<CommunicationHandle*>(w)->decrementReferenceCounter();
+    }
 
-    static Handle* connectHandle(std::string s, int retry, unsigned timeout) {
+    // P2P connection through the proxies, the peer is contacted directly in background
+    HandleUser upgradableHandshake(Handle* handle, const std::string& s) {
+        size_t id = upgradeCounter++;
+        std::string token{appName + ":" + std::to_string(getpid()) + ":" + std::to_string(id)};
+        int kind = HANDSHAKE_UPGRADABLE;
+        if (handle->send(&kind, sizeof(int))==-1 || handle->send(token.c_str(), token.length())==-1) {
+            MTCL_ERROR("[Manager]:\t", "handshake error, errno=%d (%s)\n",
+                       errno, strerror(errno));
+            return HandleUser();
+        }
+        auto w = new HandleUpgradable(handle, true);
+        static_cast<CommunicationHandle*>(w)->incrementReferenceCounter(); // released by upgradeConnection
+        {
+            std::unique_lock lk(upgrade_mutex);
+            for(auto done : upgradesDone) {
+                upgraders[done].join();
+                upgraders.erase(done);
+            }
+            upgradesDone.clear();
+            upgraders.emplace(id, std::thread([this, w, s, token, id]() {
+                upgradeConnection(w, s, token);
+                std::unique_lock lk(upgrade_mutex);
+                upgradesDone.push_back(id);
+            }));
+        }
+        return HandleUser(w, true, true);
+    }
+#endif
+
+    Handle* connectHandle(std::string s, int retry, unsigned timeout) {
         size_t pos;
         std::string protocol = s.substr(0, (pos = s.find(":")) == std::string::npos ? 0 : pos);
        
@@ -531,7 +1367,7 @@ public:
                     std::string sWoProtocol = le.substr(le.find(":") + 1, le.length());
                     std::string remote_protocol = le.substr(0, le.find(":"));
                     if (protocolsMap.count(remote_protocol)){
-                        auto* h = protocolsMap[remote_protocol]->connect(sWoProtocol, retry, timeout);
+                        auto* h = connectWith(remote_protocol, sWoProtocol, retry, timeout);
                         if (h) return h;
                     }
                 }
@@ -555,8 +1391,10 @@ public:
                 std::string& host = std::get<0>(component); // host= [pool:]hostname
                 std::string pool = getPoolFromHost(host);
 
-                    if (pool != poolName && (pool.empty() || poolName.empty())){ 
+                    if (pool != poolName){ 
                         std::string connectionString2Proxy;
+                        // no protocol specified (e.g., createTeam), the proxies always listen on TCP
+                        if (protocol.empty()) protocol = "TCP";
                         if (poolName.empty() && !pool.empty()){ // go through the proxy of the destination pool
                             // connect verso il proxy di pool
                             if (protocol == "UCX" || protocol == "TCP"){
@@ -564,9 +1402,9 @@ public:
                                 // if the ip contains a port is better to skip it, probably is a tunnel used betweens proxies
                                 Handle* handle;
                                 if (ip.find(":") != std::string::npos) 
-                                    handle = protocolsMap["TCP"]->connect(ip, retry,timeout);
+                                    handle = connectWith("TCP", ip, retry,timeout);
                                 else
-                                    handle = protocolsMap[protocol]->connect(ip + ":" + (protocol == "UCX" ? "13001" : "13000"), retry, timeout);
+                                    handle = connectWith(protocol, ip + ":" + (protocol == "UCX" ? "13001" : "13000"), retry, timeout);
                                 //handle->send(s.c_str(), s.length());
                                 if (handle){
                                     handle->type = HandleType::PROXY;
@@ -575,7 +1413,7 @@ public:
                                 }
                                }
                             } else {
-                                auto* handle = protocolsMap[protocol]->connect("PROXY-" + pool, retry, timeout);
+                                auto* handle = connectWith(protocol, "PROXY-" + pool, retry, timeout);
                                 //handle->send(s.c_str(), s.length());
                                 if (handle) {
                                     handle->type = HandleType::PROXY;
@@ -587,7 +1425,7 @@ public:
                         if (!poolName.empty() && !pool.empty()){ // try to contact my proxy
                             if (protocol == "UCX" || protocol == "TCP"){
                                for (auto& ip: pools[poolName].first){
-								   auto* handle = protocolsMap[protocol]->connect(ip + ":" + (protocol == "UCX" ? "13001" : "13000"), retry, timeout);
+								   auto* handle = connectWith(protocol, ip + ":" + (protocol == "UCX" ? "13001" : "13000"), retry, timeout);
                                 //handle->send(s.c_str(), s.length());
                                 if (handle) {
                                     handle->type = HandleType::PROXY;
@@ -595,7 +1433,7 @@ public:
                                 }
                                }
                             } else {
-                                auto* handle = protocolsMap[protocol]->connect("PROXY-" + poolName, retry, timeout);
+                                auto* handle = connectWith(protocol, "PROXY-" + poolName, retry, timeout);
                                 //handle->send(s.c_str(), s.length());
                                 if (handle) {
                                     handle->type = HandleType::PROXY;
@@ -606,23 +1444,7 @@ public:
                         return nullptr;
                     } else {
                         // connessione diretta
-                        for (auto& le : std::get<2>(component)){
-                            if (protocol.empty()){
-                                std::string sWoProtocol = le.substr(le.find(":") + 1, le.length());
-                                std::string remote_protocol = le.substr(0, le.find(":"));
-                                if (protocolsMap.count(remote_protocol)){
-                                    auto* h = protocolsMap[remote_protocol]->connect(sWoProtocol, retry, timeout);
-                                    if (h) return h;
-                                }
-                            }
-                            else if (le.find(protocol) != std::string::npos){
-                                auto* handle = protocolsMap[protocol]->connect(le.substr(le.find(":") + 1, le.length()), retry, timeout);
-                                if (handle) return handle;
-                            }
-                        }
-                        
-                        
-                        return nullptr;
+                        return connectDirect(component, protocol, retry, timeout);
                     } 
                 
   
@@ -630,8 +1452,8 @@ public:
         #endif
 
         if(protocolsMap.count(protocol)) {
-            Handle* handle = protocolsMap[protocol]->connect(s.substr(s.find(":") + 1, s.length()),
-															 retry, timeout);
+            Handle* handle = connectWith(protocol, s.substr(s.find(":") + 1, s.length()),
+                                         retry, timeout);
             if(handle) {
                 return handle;
             }
@@ -657,7 +1479,7 @@ public:
             App2 --> |App1 and App3
             App3 --> |App1 and App2
     */
-    static HandleUser createTeam(const std::string participants, const std::string root, HandleType type) {
+    HandleUser createTeam(const std::string participants, const std::string root, HandleType type) {
 #ifdef ISPROXY
     return HandleUser();
 #endif
@@ -673,12 +1495,22 @@ public:
 #else
         std::string teamID{participants + root + "-" + std::to_string(type)};
 
-		if (createdTeams.count(teamID) != 0) {
-			MTCL_ERROR("[Manager]:\t", "Manager::createTeam, team already created [%s]\n", teamID.c_str());
-			errno=EINVAL;
-			return HandleUser();
+		{
+			REMOVE_CODE_IF(std::unique_lock lk(preconnect_mutex));
+			// already created at init
+			auto it = preteams.find(teamID);
+			if (it != preteams.end()) {
+				HandleUser h = std::move(it->second);
+				preteams.erase(it);
+				return h;
+			}
+			if (createdTeams.count(teamID) != 0) {
+				MTCL_ERROR("[Manager]:\t", "Manager::createTeam, team already created [%s]\n", teamID.c_str());
+				errno=EINVAL;
+				return HandleUser();
+			}
+			createdTeams.insert(teamID);
 		}
-		createdTeams.insert(teamID);
 		
         // Retrieve team size
         size_t size = 0;
@@ -691,7 +1523,7 @@ public:
 		std::vector<std::string> ordering;
 		
         while(std::getline(is, line, ':')) {
-            if(Manager::appName == line) {
+            if(this->appName == line) {
                 rank=size;
             }
             if(root == line) root_ok=true;
@@ -728,7 +1560,7 @@ public:
         }
 
         MTCL_PRINT(100, "[Manager]:\t", "Manager::createTeam initializing collective with size: %d - AppName: %s - rank: %d - mpi: %d - ucc: %d\n",
-				   size, Manager::appName.c_str(), rank, mpi_impl, ucc_impl);
+				   size, this->appName.c_str(), rank, mpi_impl, ucc_impl);
 
 
 		// This vector will contain the participants' handle ordered according to the ordering vector
@@ -739,20 +1571,23 @@ public:
         if (mpi_impl) {
 			impl = MPI;
 			if constexpr (!MPI_ENABLED) {
-					MTCL_ERROR("[Manager]:\t", "Manager::createTeam the selected protocol (MPI) has not been enabled AppName: %s\n", Manager::appName.c_str());
+					MTCL_ERROR("[Manager]:\t", "Manager::createTeam the selected protocol (MPI) has not been enabled AppName: %s\n", this->appName.c_str());
 					return HandleUser();
 			}
+			// the MPI collectives use MPI_COMM_WORLD
+			if (initProtocol("MPI") == -1) return HandleUser();
 		} else if(ucc_impl) {
 			impl = UCC;
 			if constexpr (!UCC_ENABLED) {
-					MTCL_ERROR("[Manager]:\t", "Manager::createTeam the selected protocol (UCX/UCC) has not been enabled AppName: %s\n", Manager::appName.c_str());
+					MTCL_ERROR("[Manager]:\t", "Manager::createTeam the selected protocol (UCX/UCC) has not been enabled AppName: %s\n", this->appName.c_str());
 					return HandleUser();
 				}
 		}
         else impl = GENERIC;
 
-        auto ctx = createContext(type, size, Manager::appName == root, rank);
-        if(Manager::appName == root) {
+        auto ctx = createContext(type, size, this->appName == root, rank);
+        if (ctx) ctx->runtime = this;
+        if(this->appName == root) {
             if(ctx == nullptr) {
                 MTCL_ERROR("[Manager]:\t", "Operation type not supported\n");
                 return HandleUser();
@@ -766,7 +1601,7 @@ public:
 						coll_handles.push_back(h->second);
 					}
 					for(auto h : coll_handles) {
-						h->setName(teamID+"-"+Manager::appName);
+						h->setName(teamID+"-"+this->appName);
 					}
                     groupsReady.erase(teamID);
                 }
@@ -774,7 +1609,7 @@ public:
                     //NOTE: Active and indefinite wait for group creation
                     do { 
                         for(auto& [prot, conn] : protocolsMap) {
-                            conn->update();
+                            if (conn->active) conn->update();
                         }
                         if ((groupsReady.count(teamID) != 0) && ctx->update(groupsReady.at(teamID).size())) {
 							for(auto appName : ordering) {
@@ -783,7 +1618,7 @@ public:
 								coll_handles.push_back(h->second);
 							}
                             for(auto h : coll_handles) {
-                                h->setName(teamID+"-"+Manager::appName);
+                                h->setName(teamID+"-"+this->appName);
                             }
                             groupsReady.erase(teamID);
                             break;
@@ -802,7 +1637,7 @@ public:
 					coll_handles.push_back(h->second);
 				}
 				for(auto h : coll_handles) {
-					h->setName(teamID+"-"+Manager::appName);
+					h->setName(teamID+"-"+this->appName);
 				}
 				
                 groupsReady.erase(teamID);
@@ -858,10 +1693,10 @@ public:
 			
             int collective = 1;
 			handle->send(&collective, sizeof(int));         // TODO: error check!
-			handle->send((Manager::appName).c_str(), (Manager::appName).length());  // ''
+			handle->send((this->appName).c_str(), (this->appName).length());  // ''
             handle->send(teamID.c_str(), teamID.length());  // ''
 
-			handle->setName(teamID+"-"+Manager::appName);
+			handle->setName(teamID+"-"+this->appName);
 
             coll_handles.push_back(handle);
         }
@@ -871,7 +1706,7 @@ public:
         if(!ctx->setImplementation(impl, coll_handles, uniqtag)) {
             return HandleUser();
         }
-        ctx->setName(teamID+"-"+Manager::appName);
+        ctx->setName(teamID+"-"+this->appName);
 		{
 			std::unique_lock lk(ctx_mutex);
 			contexts.emplace(ctx, false);
@@ -891,22 +1726,66 @@ public:
      * 
      * Connect to a peer following the URI passed in the connection string or following a label defined in the configuration file.
      * The URI is of the form "PROTOCOL:param:param: ... : param"
+     * If the connection has been established at init ("connect-to" in the configuration file), that handle is returned.
      * 
      * @param connectionString URI of the peer or label 
     */
-    static HandleUser connect(std::string s, int nretry=-1, unsigned timeout=0) {
+    HandleUser connect(std::string s, int nretry=-1, unsigned timeout=0) {
+#ifdef ENABLE_CONFIGFILE
+        {
+            REMOVE_CODE_IF(std::unique_lock lk(preconnect_mutex));
+            auto it = preconnected.find(s);
+            if (it != preconnected.end() && !it->second.empty()) {
+                HandleUser h = std::move(it->second.front());
+                it->second.pop_front();
+                Capture::connected(h.realHandle->captureId, s);
+                return h;
+            }
+        }
+#endif
+        HandleUser h = connectNew(s, nretry, timeout);
+        if (h.isValid()) Capture::connected(h.realHandle->captureId, s);
+        return h;
+    }
+
+    /**
+     * \brief Connect to a peer with a handle of the transport T (e.g., ConnTcp)
+     *
+     * The operations of the handle are statically dispatched (see TypedHandle).
+     * If the connection is not a direct one of T (e.g., it is pooled, through
+     * the proxies or of another transport) it is closed and the handle is not
+     * valid, with errno set to EPROTOTYPE.
+     *
+     * @param connectionString URI of the peer or label
+    */
+    template<typename T>
+    TypedHandle<T> connect(std::string s, int nretry=-1, unsigned timeout=0) {
+        HandleUser h = connect(s, nretry, timeout);
+        TypedHandle<T> t(std::move(h));
+        if (h.isValid()) {
+            MTCL_ERROR("[Manager]:\t", "Manager::connect %s is not a direct connection of the requested transport\n", s.c_str());
+            h.realHandle->close(true, true);
+            h.isReadable = false;
+            errno = EPROTOTYPE;
+        }
+        return t;
+    }
+
+private:
+    HandleUser connectNew(std::string s, int nretry, unsigned timeout) {
+#ifndef ISPROXY
+        if (poolSize)
+            if (Handle* pooled = reuseConnection(s))
+                return HandleUser(new HandlePooled(pooled, [this, s](Handle* h, bool eos, bool broken) { parkConnection(s, h, eos, broken); }), true, true);
+#endif
         Handle* handle = connectHandle(s, nretry, timeout);
 
         // if handle is connected, we perform the handshake
 #ifndef ISPROXY        
         if(handle) {
-            int collective = 0; // no nbh conversion
-            if (handle->send(&collective, sizeof(int))==-1) {
-                MTCL_ERROR("[Manager]:\t", "handshake error, errno=%d (%s)\n",
-						   errno, strerror(errno));
-                return HandleUser();				
-			}
-
+            // proxied connections are never pooled
+            bool pooled = poolSize && handle->type == HandleType::P2P;
+            // the proxy expects the destination first, then the collective flag (as in createTeam)
             if (handle->type == HandleType::PROXY){
                 if (handle->send(s.c_str(), s.length())==-1){
                     MTCL_ERROR("[Manager]:\t", "PROXY handshake error, errno=%d (%s)\n",
@@ -914,29 +1793,90 @@ public:
                     return HandleUser();				
                 }
                 handle->type = HandleType::P2P;
+#if defined(MTCL_ENABLE_PROXY_UPGRADE) && defined(ENABLE_CONFIGFILE) && !defined(SINGLE_IO_THREAD)
+                return upgradableHandshake(handle, s);
+#endif
             }
+
+            int collective = pooled ? HANDSHAKE_POOLED : HANDSHAKE_P2P; // no nbh conversion
+            if (handle->send(&collective, sizeof(int))==-1) {
+                MTCL_ERROR("[Manager]:\t", "handshake error, errno=%d (%s)\n",
+						   errno, strerror(errno));
+                return HandleUser();				
+			}
+            if (pooled)
+                return HandleUser(new HandlePooled(handle, [this, s](Handle* h, bool eos, bool broken) { parkConnection(s, h, eos, broken); }), true, true);
         }
 #endif        
 		
         return HandleUser(handle, true, true);
     };
 
+public:
+
     /**
      * \brief Given an handle return the name of the protocol instance given in phase of registration.
      * 
      * Example. If TCP implementation was registered as Manager::registerType<ConnTcp>("EX"), this function on handles produced by that kind of protocol instance will return "EX".
     */
-    static std::string getTypeOfHandle(HandleUser& h){
+    std::string getTypeOfHandle(HandleUser& h){
         auto realHandle = (Handle*)h.realHandle;
         return realHandle->parent->instanceName;
     }
 
 };
 
+/**
+ * Main class for the library: the static API, on a default runtime. Other
+ * runtimes are created as MTCLRuntime objects, with the same API.
+*/
+class Manager {
+    inline static MTCLRuntime runtime;
+
+public:
+    /**
+     * \brief The default runtime, the one used by the other functions.
+    */
+    static MTCLRuntime& getRuntime() { return runtime; }
+
+    // see the functions with the same name of MTCLRuntime
+    static int init(std::string appName, std::string configFile1 = "", std::string configFile2 = "") {
+        return runtime.init(appName, configFile1, configFile2);
+    }
+    static void finalize(bool blockflag=false) { runtime.finalize(blockflag); }
+
+    static HandleUser getNext(std::chrono::microseconds us=std::chrono::hours(87600)) {
+        return runtime.getNext(us);
+    }
+
+    static std::map<std::string, MTCLStats> getStats(bool reset=false) { return runtime.getStats(reset); }
+    static MTCLLoopStats getLoopStats(bool reset=false) { return runtime.getLoopStats(reset); }
+
+    template<typename T>
+    static void registerType(std::string name) { runtime.registerType<T>(name); }
+
+    static int listen(std::string s) { return runtime.listen(s); }
+    static int initProtocol(const std::string& name) { return runtime.initProtocol(name); }
+
+    static HandleUser createTeam(const std::string participants, const std::string root, HandleType type) {
+        return runtime.createTeam(participants, root, type);
+    }
+
+    static HandleUser connect(std::string s, int nretry=-1, unsigned timeout=0) {
+        return runtime.connect(s, nretry, timeout);
+    }
+    template<typename T>
+    static TypedHandle<T> connect(std::string s, int nretry=-1, unsigned timeout=0) {
+        return runtime.connect<T>(s, nretry, timeout);
+    }
+
+    static std::string getTypeOfHandle(HandleUser& h) { return runtime.getTypeOfHandle(h); }
+};
+
 #ifndef MTCL_DISABLE_COLLECTIVES
 void CollectiveContext::yield() {
     if (!closed_rd && canReceive) {
-        Manager::releaseTeam(this);
+        runtime->releaseTeam(this);
     }
     else if(!closed_rd) {
         MTCL_PRINT(1, "[internal]:\t", "CollectiveContext::yield() cannot yield this context.\n");
@@ -0,0 +1,245 @@
+#ifndef MTCL_METRICS_HPP
+#define MTCL_METRICS_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "utils.hpp"
+
+/*
+ * Prometheus exporter, started by Manager::init if the MTCL_METRICS
+ * environment variable is set:
+ *
+ *   MTCL_METRICS=9100                 HTTP on localhost:9100
+ *   MTCL_METRICS=0.0.0.0:9100         HTTP on all the interfaces
+ *   MTCL_METRICS=unix:/tmp/app.sock   HTTP on a Unix socket
+ *
+ * Every request, whatever the path, gets the metrics in the Prometheus text
+ * format. They are read from relaxed atomic counters (see stats.hpp), a scrape
+ * never takes the locks of the communication path. The transport metrics are
+ * maintained only if the library is compiled with MTCL_ENABLE_STATS.
+ */
+
+class Metrics {
+    struct Custom {
+        std::string name, help;
+        const char* type;
+        std::atomic<int64_t> value{0};
+    };
+
+    inline static std::mutex mtx;               // protects customs
+    inline static std::deque<Custom> customs;   // references are stable
+    inline static std::function<void(std::string&)> collect;
+    inline static std::string labels;           // added to every sample
+    inline static std::string unixPath;
+    inline static std::atomic<bool> stopped{true};
+    inline static std::thread* server = nullptr;
+    inline static int listenfd = -1;
+
+    static std::atomic<int64_t>& custom(const std::string& name, const std::string& help, const char* type) {
+        std::unique_lock lk(mtx);
+        for(auto& c : customs)
+            if (c.name == name) return c.value;
+        auto& c = customs.emplace_back();
+        c.name = name;
+        c.help = help;
+        c.type = type;
+        return c.value;
+    }
+
+    static int bindUnix(const std::string& path) {
+        sockaddr_un sa{};
+        if (path.size() >= sizeof(sa.sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        sa.sun_family = AF_UNIX;
+        std::strncpy(sa.sun_path, path.c_str(), sizeof(sa.sun_path) - 1);
+        ::unlink(path.c_str());
+        if (bind(fd, (sockaddr*)&sa, sizeof(sa)) < 0) {
+            ::close(fd);
+            return -1;
+        }
+        unixPath = path;
+        return fd;
+    }
+
+    static int bindTcp(const std::string& host, const std::string& port) {
+        addrinfo hints{}, *result;
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags    = AI_PASSIVE;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        int fd = -1;
+        for(auto rp = result; rp; rp = rp->ai_next) {
+            if ((fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol)) < 0) continue;
+            int enable = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int));
+            if (bind(fd, rp->ai_addr, rp->ai_addrlen) == 0) break;
+            ::close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(result);
+        return fd;
+    }
+
+    static void serve(int fd) {
+        timeval tv{METRICS_IO_TIMEOUT / 1000, (METRICS_IO_TIMEOUT % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        // the request is not parsed, only read up to the end of the headers
+        std::string req;
+        char buf[512];
+        while(req.find("\r\n\r\n") == std::string::npos && req.find("\n\n") == std::string::npos) {
+            ssize_t r = ::recv(fd, buf, sizeof(buf), 0);
+            if (r <= 0 || req.size() + r > METRICS_MAX_REQUEST) return;
+            req.append(buf, r);
+        }
+
+        std::string body;
+        if (collect) collect(body);
+        {
+            std::unique_lock lk(mtx);
+            for(auto& c : customs) {
+                family(body, c.name, c.help, c.type);
+                sample(body, c.name, "", (double)c.value.load(std::memory_order_relaxed));
+            }
+        }
+        std::string resp = "HTTP/1.0 200 OK\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+        for(size_t off = 0; off < resp.size(); ) {
+            ssize_t r = ::send(fd, resp.data() + off, resp.size() - off, MSG_NOSIGNAL);
+            if (r <= 0) return;
+            off += r;
+        }
+    }
+
+    static void run() {
+        pollfd pfd{listenfd, POLLIN, 0};
+        while(!stopped.load(std::memory_order_relaxed)) {
+            int r = ::poll(&pfd, 1, METRICS_POLL_TIMEOUT);
+            if (r <= 0) continue;
+            int fd = ::accept(listenfd, nullptr, nullptr);
+            if (fd < 0) continue;
+            serve(fd);
+            ::close(fd);
+        }
+    }
+
+public:
+    /**
+     * @brief Starts the exporter thread.
+     *
+     * @param address \b [host:]port or \b unix:path
+     * @param appName value of the \b app label of all the samples
+     * @param collector appends the library metrics to its argument
+     * @return 0 on success, -1 otherwise
+     */
+    static int start(const std::string& address, const std::string& appName,
+                     std::function<void(std::string&)> collector) {
+        if (server) return 0;
+        int fd;
+        if (address.rfind("unix:", 0) == 0)
+            fd = bindUnix(address.substr(5));
+        else {
+            auto p = address.rfind(':');
+            std::string host = p == std::string::npos ? "localhost" : address.substr(0, p);
+            fd = bindTcp(host, address.substr(p == std::string::npos ? 0 : p + 1));
+        }
+        if (fd < 0 || ::listen(fd, 16) < 0) {
+            MTCL_ERROR("[Metrics]:\t", "cannot listen to %s, errno=%d\n", address.c_str(), errno);
+            if (fd >= 0) ::close(fd);
+            return -1;
+        }
+        listenfd = fd;
+        collect  = collector;
+        labels   = "app=\"" + escape(appName) + "\"";
+        stopped  = false;
+        server   = new std::thread(run);
+        MTCL_PRINT(1, "[Metrics]:\t", "exporting the metrics on %s\n", address.c_str());
+        return 0;
+    }
+
+    /**
+     * @brief Stops the exporter thread, called by Manager::finalize.
+     */
+    static void stop() {
+        if (!server) return;
+        stopped = true;
+        server->join();
+        delete server;
+        server = nullptr;
+        ::close(listenfd);
+        listenfd = -1;
+        if (!unixPath.empty()) ::unlink(unixPath.c_str());
+        unixPath.clear();
+    }
+
+    /**
+     * @brief Returns the counter \b name (registered at the first call), the
+     * application increments it and the exporter reports its value.
+     */
+    static std::atomic<int64_t>& counter(const std::string& name, const std::string& help) {
+        return custom(name, help, "counter");
+    }
+
+    /**
+     * @brief As counter, for a value that can also decrease.
+     */
+    static std::atomic<int64_t>& gauge(const std::string& name, const std::string& help) {
+        return custom(name, help, "gauge");
+    }
+
+    // helpers for the collector
+    static std::string escape(const std::string& v) {
+        std::string r;
+        for(char c : v) {
+            if (c == '\\' || c == '"') r += '\\';
+            if (c == '\n') { r += "\\n"; continue; }
+            r += c;
+        }
+        return r;
+    }
+
+    static void family(std::string& out, const std::string& name, const std::string& help, const char* type) {
+        out += "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+    }
+
+    // extra: labels of the sample, e.g., protocol="TCP"
+    static void sample(std::string& out, const std::string& name, const std::string& extra, double value) {
+        char v[32];
+        std::snprintf(v, sizeof(v), "%.17g", value);
+        out += name + "{" + labels + (extra.empty() ? "" : ",") + extra + "} " + v + "\n";
+    }
+
+    // as above, for a sample of the application app (e.g., one of the runtimes)
+    static void sample(std::string& out, const std::string& name, const std::string& app,
+                       const std::string& extra, double value) {
+        char v[32];
+        std::snprintf(v, sizeof(v), "%.17g", value);
+        out += name + "{app=\"" + escape(app) + "\"" + (extra.empty() ? "" : ",") + extra + "} " + v + "\n";
+    }
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef MTCL_PROBES_HPP
+#define MTCL_PROBES_HPP
+
+/*
+ * USDT probe points (provider "mtcl") for bpftrace, perf and SystemTap.
+ *
+ * They are compiled in if <sys/sdt.h> is available (e.g., from the
+ * systemtap-sdt-dev package) unless MTCL_DISABLE_USDT is defined. A probe
+ * not attached costs a nop, the arguments are evaluated anyway.
+ *
+ *   send(id, size, protocol)          send_done(id, result)
+ *   probe(id, blocking, protocol)     probe_done(id, result, size)
+ *   receive(id, size, protocol)       receive_done(id, result)
+ *   sendrecv(id, size, team)          sendrecv_done(id, result)
+ *   addinq(id, newconn, protocol)     handle pushed in the ready queue
+ *   getnext()                         getnext_done(id), id=0 on timeout
+ *   update(protocol)                  update_done(protocol)
+ *
+ * id is the handle id (HandleUser::getID), protocol and team are strings.
+ */
+
+#if !defined(MTCL_DISABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MTCL_USDT 1
+#endif
+#endif
+
+#if defined(MTCL_USDT)
+#define MTCL_PROBE0(name)             DTRACE_PROBE(mtcl, name)
+#define MTCL_PROBE1(name, a)          DTRACE_PROBE1(mtcl, name, a)
+#define MTCL_PROBE2(name, a, b)       DTRACE_PROBE2(mtcl, name, a, b)
+#define MTCL_PROBE3(name, a, b, c)    DTRACE_PROBE3(mtcl, name, a, b, c)
+#else
+#define MTCL_PROBE0(name)
+#define MTCL_PROBE1(name, a)
+#define MTCL_PROBE2(name, a, b)
+#define MTCL_PROBE3(name, a, b, c)
+#endif
+
+#endif
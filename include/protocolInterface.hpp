@@ -1,23 +1,49 @@
 #ifndef PROTOCOLINTERFACE_HPP
 #define PROTOCOLINTERFACE_HPP
 
+#include <atomic>
 #include <queue>
 #include <mutex>
 #include <functional>
 #include <errno.h>
 
+#include "stats.hpp"
+
 class Handle;
 class ConnType {
 
-    friend class Manager;
+    friend class MTCLRuntime;
     friend class Handle;
     std::string instanceName;
+    // initialized by the Manager at the first use (see Manager::initProtocol)
+    std::atomic<bool> active{false};
+    bool failed = false;
 protected:
 
     std::function<void(bool, Handle*)> addinQ;
 
+    // initialized by Manager::init and ended by Manager::finalize, both on the
+    // thread calling them, never at the first use (e.g., MPI)
+    bool eager = false;
+
+    // aggregated statistics of the handles of this transport
+    StatsCounters stats;
+
     static void setAsClosed(Handle* h, bool blockflag);
 
+    // transport wrapping the connections accepted by this one (see ConnEMU)
+    std::atomic<ConnType*> decorator{nullptr};
+
+    static void setDecorator(ConnType* c, ConnType* d) { c->decorator = d; }
+
+    /**
+     * @brief Wraps the connection \b h accepted by the transport \b c, whose
+     * decorator is this one. Called by the Manager before the handshake.
+     *
+     * @return the Handle replacing \b h
+     */
+    virtual Handle* decorate(ConnType* c, Handle* h) { return h; }
+
 public:
     ConnType() {};
     virtual ~ConnType() {};
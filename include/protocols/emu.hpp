@@ -0,0 +1,405 @@
+#ifndef EMU_HPP
+#define EMU_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../handle.hpp"
+#include "../protocolInterface.hpp"
+
+/*
+ * Network emulation over any other transport, to evaluate on one machine
+ * (e.g., on loopback or shared memory) how an application or the proxies
+ * behave on slower links:
+ *
+ *   EMU:<URI>?lat=<time>&bw=<rate>&jitter=<time>&seed=<n>
+ *
+ *   e.g. EMU:TCP:localhost:13000?lat=20ms&bw=100M&jitter=2ms
+ *
+ * lat is the one-way delay of each message, jitter adds to it a uniformly
+ * distributed value in [-jitter, jitter] (the messages are never reordered),
+ * bw is the link rate in bits per second (k, M, G suffixes). Times accept
+ * the ns, us, ms, s units, ms by default. The jitter sequence of each
+ * connection depends only on seed (default 1), thus the runs are
+ * reproducible. All the parameters are optional.
+ *
+ * Each message is copied in the delay line of its connection and sent on
+ * the underlying connection by the delivery thread of the connection when
+ * it is due: after the messages before it have been transmitted at the link
+ * rate, plus the delay. Thus a slow or blocked link does not delay the
+ * messages of the other ones. As on a
+ * real link, send returns as soon as the message is buffered, and blocks
+ * while the bytes waiting for the link exceed EMU_SEND_BUFFER (or the ones
+ * in the delay line EMU_MAX_QUEUED). The EOS is delayed as a message.
+ * At the end the delay lines are drained for at most EMU_END_TIMEOUT, then
+ * the messages left are dropped and the EOS of the connections delivered.
+ *
+ * Manager::connect("EMU:...") shapes the messages sent by the connecting
+ * side, Manager::listen("EMU:...") the ones sent by the accepting side on
+ * all the connections accepted by the underlying transport (the last
+ * listen sets the parameters). The receiving path is the one of the
+ * underlying transport.
+ */
+
+class ConnEMU;
+
+class HandleEMU : public Handle {
+    friend class ConnEMU;
+
+public:
+    // parameters and state of an emulated link, shared by its handle and by
+    // the messages in the delay line
+    struct Link {
+        using Clock = std::chrono::steady_clock;
+
+        struct Params {
+            std::chrono::nanoseconds lat{0}, jitter{0};
+            double bw = 0;                  // bytes per second, 0 unlimited
+            uint64_t seed = 1;
+        };
+
+        enum Kind { DATA, EOS, CLOSE };
+
+        struct Message {
+            Clock::time_point due;
+            std::vector<char> data;
+            Kind kind;
+        };
+
+        Handle* h;                          // underlying connection
+        Params p;
+        std::mt19937_64 rng;
+        Clock::time_point free{};           // the link has transmitted the previous messages
+        Clock::time_point lastDue{};        // messages are delivered in order
+        size_t queued = 0;                  // bytes in the delay line
+        int error = 0;                      // errno of a failed delivery
+        std::deque<Message> line;           // delay line, ordered by due
+        std::thread deliverer;              // joined by ConnEMU
+        bool done = false;                  // the delivery thread has terminated
+        bool closed = false;                // the CLOSE has been delivered
+        std::condition_variable cond;       // with ConnEMU::mtx
+        std::mutex mtx;                     // serializes the calls on h
+
+        Link(Handle* h, const Params& p) : h(h), p(p), rng(p.seed) {
+            h->incrementReferenceCounter();
+        }
+        ~Link() {
+            h->decrementReferenceCounter();
+        }
+
+        // called by the delivery thread holding mtx
+        ssize_t deliver(Kind k, const std::vector<char>& data) {
+            switch(k) {
+            case EOS:   return h->sendEOS();  // the connection stays open (e.g., pooled)
+            case CLOSE: h->close(true, false); return 0;
+            default:    return h->send(data.data(), data.size());
+            }
+        }
+
+        std::chrono::nanoseconds transmission(size_t size) const {
+            return std::chrono::nanoseconds(p.bw > 0 ? (int64_t)(size * 1e9 / p.bw) : 0);
+        }
+
+        // parses "lat=..&bw=..&jitter=..&seed=..", returns false if not valid
+        static bool parse(const std::string& s, Params& p) {
+            auto time = [](const std::string& v, std::chrono::nanoseconds& t) {
+                char* end;
+                double d = std::strtod(v.c_str(), &end);
+                std::string unit(end);
+                double scale = unit == "ns" ? 1 : unit == "us" ? 1e3 : unit == "ms" || unit.empty() ? 1e6 :
+                               unit == "s" ? 1e9 : -1;
+                if (end == v.c_str() || scale < 0 || d < 0) return false;
+                t = std::chrono::nanoseconds((int64_t)(d * scale));
+                return true;
+            };
+            for(size_t pos = 0; pos < s.size(); ) {
+                size_t next = s.find('&', pos);
+                if (next == std::string::npos) next = s.size();
+                std::string kv = s.substr(pos, next - pos);
+                pos = next + 1;
+                size_t eq = kv.find('=');
+                if (eq == std::string::npos) return false;
+                std::string k = kv.substr(0, eq), v = kv.substr(eq + 1);
+                if (k == "lat") {
+                    if (!time(v, p.lat)) return false;
+                } else if (k == "jitter") {
+                    if (!time(v, p.jitter)) return false;
+                } else if (k == "bw") {
+                    char* end;
+                    double d = std::strtod(v.c_str(), &end);
+                    std::string unit(end);
+                    double scale = unit.empty() ? 1 : unit == "k" || unit == "K" ? 1e3 :
+                                   unit == "M" ? 1e6 : unit == "G" ? 1e9 : -1;
+                    if (end == v.c_str() || scale < 0 || d <= 0) return false;
+                    p.bw = d * scale / 8;
+                } else if (k == "seed") {
+                    char* end;
+                    p.seed = std::strtoull(v.c_str(), &end, 10);
+                    if (end == v.c_str() || *end) return false;
+                } else return false;
+            }
+            return true;
+        }
+    };
+
+private:
+    ConnEMU* emu;
+    std::shared_ptr<Link> link;
+
+protected:
+    ssize_t sendEOS();
+
+public:
+    HandleEMU(ConnEMU* emu, Handle* h, const Link::Params& p);
+
+    ssize_t send(const void* buff, size_t size);
+
+    ssize_t probe(size_t& size, const bool blocking=true) {
+        return link->h->probe(size, blocking);
+    }
+
+    ssize_t receive(void* buff, size_t size) {
+        return link->h->receive(buff, size);
+    }
+
+    bool peek() {
+        return link->h->peek();
+    }
+
+    void yield() {
+        if (!closed_rd) link->h->yield();
+    }
+
+    void close(bool close_wr=true, bool close_rd=true);
+    ~HandleEMU() {
+        link->h->outer = nullptr;
+    }
+};
+
+class ConnEMU : public ConnType {
+    friend class MTCLRuntime;
+    friend class HandleEMU;
+    using Link = HandleEMU::Link;
+
+    std::mutex mtx;                     // protects everything below and the links' state
+    std::condition_variable cond;       // a delivery thread has terminated
+    std::set<std::shared_ptr<Link>> links;  // the ones with a delivery thread not joined yet
+    bool stop = false;
+    std::map<ConnType*, Link::Params> accepting;  // set by listen
+
+    // the other transports, set by the Manager
+    std::function<ConnType*(const std::string&)> transport;
+
+    // splits "PROT:address?params" into the transport, its address and the parameters
+    bool resolve(const std::string& s, ConnType*& c, std::string& address, Link::Params& p) {
+        size_t q = s.find('?');
+        std::string uri = s.substr(0, q);
+        size_t colon = uri.find(':');
+        c = colon == std::string::npos ? nullptr : transport(uri.substr(0, colon));
+        if (!c || c == this) {
+            MTCL_ERROR("[EMU]:\t", "invalid transport in %s\n", s.c_str());
+            errno = EPROTO;
+            return false;
+        }
+        address = uri.substr(colon + 1);
+        if (q != std::string::npos && !Link::parse(s.substr(q + 1), p)) {
+            MTCL_ERROR("[EMU]:\t", "invalid parameters in %s\n", s.c_str());
+            errno = EINVAL;
+            return false;
+        }
+        return true;
+    }
+
+    // delivery thread of a link, it terminates after the CLOSE or, after
+    // end, when the delay line is empty
+    void deliver(Link& l) {
+        std::unique_lock lk(mtx);
+        while(true) {
+            if (l.line.empty()) {
+                if (stop || l.closed) break;
+                l.cond.wait(lk);
+                continue;
+            }
+            if (l.line.front().due > Link::Clock::now()) {
+                l.cond.wait_until(lk, l.line.front().due);
+                continue;
+            }
+            Link::Message m = std::move(l.line.front());
+            l.line.pop_front();
+            lk.unlock();
+            int error = 0;
+            {
+                std::unique_lock llk(l.mtx);
+                if (l.deliver(m.kind, m.data) < 0) error = errno;
+            }
+            lk.lock();
+            l.queued -= m.data.size();
+            if (m.kind == Link::CLOSE) l.closed = true;
+            if (error && !l.error) l.error = error;
+            l.cond.notify_all();
+        }
+        l.done = true;
+        cond.notify_all();
+    }
+
+    // joins the terminated delivery threads, called holding mtx
+    void reap() {
+        for(auto it = links.begin(); it != links.end(); ) {
+            if (!(*it)->done) {
+                ++it;
+                continue;
+            }
+            (*it)->deliverer.join();
+            it = links.erase(it);
+        }
+    }
+
+    ssize_t enqueue(std::shared_ptr<Link>& link, const void* buff, size_t size, Link::Kind kind) {
+        auto now = Link::Clock::now();
+        Link& l = *link;
+        std::unique_lock lk(mtx);
+        if (!l.deliverer.joinable()) {
+            reap();
+            links.insert(link);  // owns the link until the thread is joined
+            l.deliverer = std::thread([this, &l]{ deliver(l); });
+        }
+        l.cond.wait(lk, [&]{ return l.queued == 0 || l.queued + size <= EMU_MAX_QUEUED || l.error; });
+        if (l.error) {
+            errno = l.error;
+            return -1;
+        }
+        auto start = std::max(now, l.free);
+        l.free = start + l.transmission(size);
+        auto delay = l.p.lat;
+        if (l.p.jitter.count() > 0) {
+            std::uniform_int_distribution<int64_t> d(-l.p.jitter.count(), l.p.jitter.count());
+            delay = std::max(std::chrono::nanoseconds(0), delay + std::chrono::nanoseconds(d(l.rng)));
+        }
+        auto due = std::max(l.free + delay, l.lastDue);
+        l.lastDue = due;
+        l.queued += size;
+        l.line.push_back({due, std::vector<char>((const char*)buff, (const char*)buff + size), kind});
+        l.cond.notify_all();
+        // the send buffer is full, waits for the link
+        auto buffered = l.transmission(EMU_SEND_BUFFER);
+        lk.unlock();
+        if (l.p.bw > 0 && start - now > buffered)
+            std::this_thread::sleep_until(start - buffered);
+        return size;
+    }
+
+protected:
+    Handle* decorate(ConnType* c, Handle* h) {
+        std::unique_lock lk(mtx);
+        auto it = accepting.find(c);
+        if (it == accepting.end()) return h;
+        auto p = it->second;
+        lk.unlock();
+        return new HandleEMU(this, h, p);
+    }
+
+public:
+    int init(std::string) {
+        return 0;
+    }
+
+    int listen(std::string s) {
+        ConnType* c;
+        std::string address;
+        Link::Params p;
+        if (!resolve(s, c, address, p)) return -1;
+        {
+            std::unique_lock lk(mtx);
+            accepting[c] = p;
+        }
+        setDecorator(c, this);
+        return c->listen(address);
+    }
+
+    Handle* connect(const std::string& s, int retry, unsigned timeout) {
+        ConnType* c;
+        std::string address;
+        Link::Params p;
+        if (!resolve(s, c, address, p)) return nullptr;
+        Handle* h = c->connect(address, retry, timeout);
+        if (!h) return nullptr;
+        return new HandleEMU(this, h, p);
+    }
+
+    // the underlying transports poll the connections
+    void update() {}
+
+    void notify_yield(Handle*) {}
+    void notify_close(Handle*, bool, bool) {}
+
+    // the messages in the delay line are delivered when due, the ones not
+    // delivered within EMU_END_TIMEOUT are dropped, not the EOS
+    void end(bool blockflag=false) {
+        std::unique_lock lk(mtx);
+        stop = true;
+        for(auto& l : links) l->cond.notify_all();
+        auto drained = [&]{
+            for(auto& l : links) if (!l->done) return false;
+            return true;
+        };
+        if (!cond.wait_for(lk, std::chrono::milliseconds(EMU_END_TIMEOUT), drained)) {
+            size_t dropped = 0;
+            for(auto& l : links) {
+                std::deque<Link::Message> eos;
+                for(auto& m : l->line) {
+                    if (m.kind == Link::DATA) {
+                        l->queued -= m.data.size();
+                        ++dropped;
+                    } else eos.push_back({Link::Clock::now(), {}, m.kind});
+                }
+                l->line.swap(eos);
+                l->cond.notify_all();
+            }
+            if (dropped)
+                MTCL_ERROR("[EMU]:\t", "end: %lu messages not delivered within %u ms, dropped\n", dropped, EMU_END_TIMEOUT);
+        }
+        // a delivery blocked on the underlying connection is waited as by its transport
+        cond.wait(lk, drained);
+        reap();
+    }
+};
+
+inline HandleEMU::HandleEMU(ConnEMU* emu, Handle* h, const Link::Params& p) :
+        Handle(emu), emu(emu), link(std::make_shared<Link>(h, p)) {
+    h->outer = this;
+}
+
+inline ssize_t HandleEMU::send(const void* buff, size_t size) {
+    return emu->enqueue(link, buff, size, Link::DATA);
+}
+
+inline ssize_t HandleEMU::sendEOS() {
+    return emu->enqueue(link, nullptr, 0, Link::EOS);
+}
+
+inline void HandleEMU::close(bool close_wr, bool close_rd) {
+    if (close_wr && !closed_wr) {
+        emu->enqueue(link, nullptr, 0, Link::CLOSE);  // EOS and close, when due
+        closed_wr = true;
+    }
+    if (close_rd && !closed_rd) {
+        closed_rd = true;
+        std::unique_lock lk(link->mtx);
+        link->h->close(false, true);
+    }
+    if (counter == 0 && closed_rd && closed_wr) {
+        delete this;
+    }
+}
+
+#endif
@@ -151,6 +151,9 @@ public:
 
 
 class ConnMPI : public ConnType {
+public:
+    using handle_type = HandleMPI;  // see TypedHandle
+
 protected:
     int rank;
 
@@ -159,6 +162,8 @@ protected:
     std::shared_mutex shm;
 
 public:
+    // MPI_Init_thread and MPI_Finalize on the main thread
+    ConnMPI() { eager = true; }
 
     int init(std::string) {
         int provided;
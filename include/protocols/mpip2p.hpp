@@ -157,6 +157,9 @@ public:
 
 
 class ConnMPIP2P : public ConnType {
+public:
+    using handle_type = HandleMPIP2P;  // see TypedHandle
+
 protected:
     char portname[MPI_MAX_PORT_NAME];
     std::string published_label;
@@ -175,7 +178,8 @@ protected:
 
 public:
 
-   ConnMPIP2P(){};
+   // MPI_Init_thread and MPI_Finalize on the main thread
+   ConnMPIP2P(){ eager = true; };
    ~ConnMPIP2P(){};
 
     int init(std::string) {
@@ -140,6 +140,9 @@ public:
 
 
 class ConnMQTT : public ConnType {
+public:
+    using handle_type = HandleMQTT;  // see TypedHandle
+
 private:
     std::string manager_name, new_connection_topic;
     std::string appName;
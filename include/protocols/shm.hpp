@@ -48,6 +48,9 @@ public:
 
 
 class ConnSHM : public ConnType {
+public:
+    using handle_type = HandleSHM;  // see TypedHandle
+
 protected:
 	std::string shmname;
 	std::atomic<int> shmconnid{0};  // to generate unique name
@@ -130,11 +133,10 @@ public:
 		REMOVE_CODE_IF(ulock.lock());		
         for (auto &[handle, to_manage] : connections) {
             if(to_manage) {
-				if (((sz=handle->in.peek())<0)) {
-					if (errno!=EWOULDBLOCK)
-						MTCL_SHM_ERROR("ConnSHM::update, peek errno=%d (%s)\n", errno, strerror(errno));
-					continue;
-				}
+				// peek returns 1 if there is a message in the buffer, 0 otherwise
+				if (handle->in.peek()<=0) continue;
+				// reported once, managed again when the user yields it
+				to_manage = false;
 				// NOTE: called with ulock lock hold. Double lock if there is the IO-thread!
 				addinQ(false, handle);
 			}
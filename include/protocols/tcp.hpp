@@ -140,6 +140,9 @@ public:
 
 
 class ConnTcp : public ConnType {
+public:
+    using handle_type = HandleTCP;  // see TypedHandle
+
 private:
     // enum class ConnEvent {close, yield};
 
@@ -341,7 +344,8 @@ public:
 		int flag = 1;
 		if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *) &flag, sizeof(int)) < 0){
 			MTCL_TCP_ERROR("ConnTcp::connect setsockopt ERROR: errno=%d -- %s\n", errno, strerror(errno));
-            return;
+			::close(fd);
+            return nullptr;
 		}
 #endif		
 
@@ -260,6 +260,9 @@ public:
 };
 
 class ConnUCX : public ConnType {
+public:
+    using handle_type = HandleUCX;  // see TypedHandle
+
 
 protected:
 
@@ -0,0 +1,322 @@
+#ifndef MTCL_STATS_HPP
+#define MTCL_STATS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "config.hpp"
+
+/**
+ * @brief Snapshot of the communication statistics of a handle or of a
+ * transport (see HandleUser::getStats and Manager::getStats).
+ *
+ * The counters are maintained only if the library is compiled with
+ * ```MTCL_ENABLE_STATS```, otherwise they are always zero. Times are in
+ * nanoseconds.
+ */
+struct MTCLStats {
+    uint64_t msgSent       = 0;
+    uint64_t bytesSent     = 0;
+    uint64_t msgReceived   = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t probes        = 0;   // probes, including the ones done by receive
+    uint64_t wouldBlock    = 0;   // non-blocking probes returning EWOULDBLOCK
+    uint64_t yields        = 0;   // handles given back to the Manager
+    uint64_t sendTime      = 0;   // blocked in send
+    uint64_t recvTime      = 0;   // blocked in blocking probes and in receive
+    uint64_t readyCount    = 0;   // times the handle has been in the ready queue
+    uint64_t readyTime     = 0;   // from the ready queue to Manager::getNext
+    uint64_t connOpened    = 0;   // handles created (transports only)
+    uint64_t connClosed    = 0;   // handles destroyed (transports only)
+    uint64_t connOpen      = 0;   // handles alive, not affected by reset
+    uint64_t updateCalls   = 0;   // update() calls by the IO loop (transports only)
+    uint64_t updateTime    = 0;   // spent in update()
+    uint64_t updateMaxTime = 0;   // longest update()
+
+    MTCLStats& operator+=(const MTCLStats& o) {
+        msgSent += o.msgSent;         bytesSent += o.bytesSent;
+        msgReceived += o.msgReceived; bytesReceived += o.bytesReceived;
+        probes += o.probes;           wouldBlock += o.wouldBlock;
+        yields += o.yields;
+        sendTime += o.sendTime;       recvTime += o.recvTime;
+        readyCount += o.readyCount;   readyTime += o.readyTime;
+        connOpened += o.connOpened;   connClosed += o.connClosed;
+        connOpen += o.connOpen;
+        updateCalls += o.updateCalls; updateTime += o.updateTime;
+        updateMaxTime = std::max(updateMaxTime, o.updateMaxTime);
+        return *this;
+    }
+};
+
+/**
+ * @brief Snapshot of the statistics of the IO loop (see Manager::getLoopStats),
+ * i.e., of the IO thread or of the Manager::getNext polling loop with
+ * SINGLE_IO_THREAD. Zero if not compiled with ```MTCL_ENABLE_STATS```.
+ * Times are in nanoseconds.
+ */
+struct MTCLLoopStats {
+    uint64_t iterations         = 0;
+    uint64_t loopTime           = 0;  // spent in the loop, sleeps included
+    uint64_t dispatched         = 0;  // handles pushed in the ready queue
+    uint64_t maxDispatched      = 0;  // in a single iteration
+    uint64_t collectivePolls    = 0;  // polls of the collective contexts
+    uint64_t collectivePollTime = 0;
+};
+
+/**
+ * @brief Latency histogram of the send or receive calls of a transport.
+ *
+ * Bucket i counts the calls that took at most 2^i microseconds, the last
+ * bucket counts the slower ones. Buckets are not cumulative.
+ */
+struct MTCLHistogram {
+    static const int NBUCKETS = 22;   // up to ~1s, plus the overflow bucket
+    uint64_t buckets[NBUCKETS + 1] = {};
+    uint64_t count = 0;
+    uint64_t sum   = 0;               // ns
+
+    static double upperBound(int i) { return 1e-6 * (1ull << i); }  // seconds
+};
+
+#if defined(MTCL_ENABLE_STATS)
+
+static inline uint64_t stats_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void stats_max(std::atomic<uint64_t>& m, uint64_t v) {
+    uint64_t cur = m.load(std::memory_order_relaxed);
+    while (v > cur && !m.compare_exchange_weak(cur, v, std::memory_order_relaxed));
+}
+
+// slot of the calling thread in the sharded counters
+static inline unsigned stats_shard() {
+    static std::atomic<unsigned> next{0};
+    thread_local unsigned shard = next.fetch_add(1, std::memory_order_relaxed) % STATS_SHARDS;
+    return shard;
+}
+
+/**
+ * @brief Counters of a handle or of a transport.
+ *
+ * Updated with relaxed atomics on the communication path. The counters of a
+ * handle are also added to the ones of its transport (parent). A handle is
+ * usually used by one thread at a time, while the counters of a transport
+ * are sharded: each thread updates its own cache line (STATS_SHARDS in
+ * config.hpp) and snapshot sums them.
+ */
+class StatsCounters {
+    enum { MSG_SENT, BYTES_SENT, MSG_RECV, BYTES_RECV, PROBES, WOULDBLOCK, YIELDS,
+           SEND_TIME, RECV_TIME, READY_COUNT, READY_TIME, CONN_OPENED, CONN_CLOSED,
+           CONN_OPEN, UPDATE_CALLS, UPDATE_TIME, UPDATE_MAX, NCOUNTERS };
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> c[NCOUNTERS] = {};
+    };
+
+    struct alignas(64) Histogram {
+        std::atomic<uint64_t> buckets[MTCLHistogram::NBUCKETS + 1] = {};
+        std::atomic<uint64_t> sum{0};
+
+        void observe(uint64_t ns) {
+            uint64_t us = (ns + 999) / 1000;
+            int i = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1);
+            buckets[std::min(i, MTCLHistogram::NBUCKETS)].fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(ns, std::memory_order_relaxed);
+        }
+        void addTo(MTCLHistogram& h) {
+            for(int i = 0; i <= MTCLHistogram::NBUCKETS; ++i) {
+                uint64_t n = buckets[i].load(std::memory_order_relaxed);
+                h.buckets[i] += n;
+                h.count += n;
+            }
+            h.sum += sum.load(std::memory_order_relaxed);
+        }
+    };
+
+    Shard own;                          // the counters of a handle
+    std::unique_ptr<Shard[]> shards;    // the ones of a transport, if sharded
+    StatsCounters* parent = nullptr;
+    uint64_t readySince   = 0;  // written by the IO thread, read after the ready queue
+    // owned by the transport, shared by its handles: STATS_SHARDS for send, then for receive
+    std::shared_ptr<Histogram[]> hist;
+
+    Shard& shard() { return shards ? shards[stats_shard()] : own; }
+
+    void add(int i, uint64_t v) {
+        for(auto s = this; s; s = s->parent)
+            s->shard().c[i].fetch_add(v, std::memory_order_relaxed);
+    }
+    uint64_t get(int i, bool reset, bool max=false) {
+        uint64_t v = 0;
+        for(unsigned k = 0; k <= (shards ? STATS_SHARDS : 0); ++k) {
+            auto& c = k ? shards[k-1].c[i] : own.c[i];
+            uint64_t x = reset ? c.exchange(0, std::memory_order_relaxed) : c.load(std::memory_order_relaxed);
+            v = max ? std::max(v, x) : v + x;
+        }
+        return v;
+    }
+    MTCLHistogram histogram(int which) {
+        MTCLHistogram h;
+        if (hist)
+            for(unsigned k = 0; k < STATS_SHARDS; ++k) hist[which*STATS_SHARDS + k].addTo(h);
+        return h;
+    }
+public:
+    void setParent(StatsCounters* p) {
+        parent = p;
+        hist   = p ? p->hist : nullptr;
+    }
+    // sharded counters and latency histograms of send and receive, set on
+    // the transport counters before its handles are created
+    void enableHistograms() {
+        shards.reset(new Shard[STATS_SHARDS]);
+        hist.reset(new Histogram[2*STATS_SHARDS]);
+    }
+
+    void sent(size_t bytes, uint64_t ns) {
+        add(MSG_SENT, 1); add(BYTES_SENT, bytes); add(SEND_TIME, ns);
+        if (hist) hist[stats_shard()].observe(ns);
+    }
+    void received(size_t bytes, uint64_t ns) {
+        add(MSG_RECV, 1); add(BYTES_RECV, bytes); add(RECV_TIME, ns);
+        if (hist) hist[STATS_SHARDS + stats_shard()].observe(ns);
+    }
+    void opened() { add(CONN_OPENED, 1); add(CONN_OPEN, 1); }
+    void closed() { add(CONN_CLOSED, 1); add(CONN_OPEN, uint64_t(-1)); }
+    void probed(uint64_t ns, bool wouldBlock) {
+        add(PROBES, 1); add(RECV_TIME, ns);
+        if (wouldBlock) add(WOULDBLOCK, 1);
+    }
+    void yielded() { add(YIELDS, 1); }
+    // transport counters only, by the IO loop
+    void updated(uint64_t ns) {
+        auto& c = shard().c;
+        c[UPDATE_CALLS].fetch_add(1, std::memory_order_relaxed);
+        c[UPDATE_TIME].fetch_add(ns, std::memory_order_relaxed);
+        stats_max(c[UPDATE_MAX], ns);
+    }
+    void readyPush() { readySince = stats_now(); }
+    void readyPop() {
+        add(READY_COUNT, 1); add(READY_TIME, stats_now() - readySince);
+    }
+
+    MTCLStats snapshot(bool reset=false) {
+        MTCLStats s;
+        s.msgSent       = get(MSG_SENT, reset);
+        s.bytesSent     = get(BYTES_SENT, reset);
+        s.msgReceived   = get(MSG_RECV, reset);
+        s.bytesReceived = get(BYTES_RECV, reset);
+        s.probes        = get(PROBES, reset);
+        s.wouldBlock    = get(WOULDBLOCK, reset);
+        s.yields        = get(YIELDS, reset);
+        s.sendTime      = get(SEND_TIME, reset);
+        s.recvTime      = get(RECV_TIME, reset);
+        s.readyCount    = get(READY_COUNT, reset);
+        s.readyTime     = get(READY_TIME, reset);
+        s.connOpened    = get(CONN_OPENED, reset);
+        s.connClosed    = get(CONN_CLOSED, reset);
+        s.connOpen      = get(CONN_OPEN, false);
+        s.updateCalls   = get(UPDATE_CALLS, reset);
+        s.updateTime    = get(UPDATE_TIME, reset);
+        s.updateMaxTime = get(UPDATE_MAX, reset, true);
+        return s;
+    }
+
+    MTCLHistogram sendHistogram() { return histogram(0); }
+    MTCLHistogram recvHistogram() { return histogram(1); }
+};
+
+/**
+ * @brief Counters of the IO loop, updated by the thread running it.
+ */
+class LoopCounters {
+    std::atomic<uint64_t> iterations{0}, loopTime{0}, dispatched{0}, maxDispatched{0},
+                          collectivePolls{0}, collectivePollTime{0};
+    std::atomic<uint64_t> pending{0};   // pushed in the ready queue in this iteration
+    uint64_t last = 0;                  // end of the previous iteration, or start of the loop
+
+    static uint64_t get(std::atomic<uint64_t>& v, bool reset) {
+        return reset ? v.exchange(0, std::memory_order_relaxed) : v.load(std::memory_order_relaxed);
+    }
+public:
+    // a handle pushed in the ready queue, possibly by another thread
+    void dispatch() { pending.fetch_add(1, std::memory_order_relaxed); }
+    void collectivePolled(uint64_t ns) {
+        collectivePolls.fetch_add(1, std::memory_order_relaxed);
+        collectivePollTime.fetch_add(ns, std::memory_order_relaxed);
+    }
+    // (re)start of the loop, e.g., at each Manager::getNext with SINGLE_IO_THREAD
+    void begin() { last = stats_now(); }
+    // end of an iteration
+    void iteration() {
+        uint64_t now = stats_now();
+        loopTime.fetch_add(now - last, std::memory_order_relaxed);
+        last = now;
+        iterations.fetch_add(1, std::memory_order_relaxed);
+        if (uint64_t n = pending.exchange(0, std::memory_order_relaxed)) {
+            dispatched.fetch_add(n, std::memory_order_relaxed);
+            stats_max(maxDispatched, n);
+        }
+    }
+
+    MTCLLoopStats snapshot(bool reset=false) {
+        MTCLLoopStats s;
+        s.iterations         = get(iterations, reset);
+        s.loopTime           = get(loopTime, reset);
+        s.dispatched         = get(dispatched, reset);
+        s.maxDispatched      = get(maxDispatched, reset);
+        s.collectivePolls    = get(collectivePolls, reset);
+        s.collectivePollTime = get(collectivePollTime, reset);
+        return s;
+    }
+};
+
+// measures the time spent in a call
+class StatsTimer {
+    uint64_t start = stats_now();
+public:
+    uint64_t elapsed() const { return stats_now() - start; }
+};
+
+#else  // the statistics compile away
+
+class StatsCounters {
+public:
+    void setParent(StatsCounters*) {}
+    void sent(size_t, uint64_t) {}
+    void received(size_t, uint64_t) {}
+    void probed(uint64_t, bool) {}
+    void enableHistograms() {}
+    void yielded() {}
+    void updated(uint64_t) {}
+    void opened() {}
+    void closed() {}
+    void readyPush() {}
+    void readyPop() {}
+    MTCLStats snapshot(bool=false) { return {}; }
+    MTCLHistogram sendHistogram() { return {}; }
+    MTCLHistogram recvHistogram() { return {}; }
+};
+
+class LoopCounters {
+public:
+    void dispatch() {}
+    void collectivePolled(uint64_t) {}
+    void begin() {}
+    void iteration() {}
+    MTCLLoopStats snapshot(bool=false) { return {}; }
+};
+
+class StatsTimer {
+public:
+    uint64_t elapsed() const { return 0; }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef MTCL_TRACE_HPP
+#define MTCL_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "utils.hpp"
+
+/*
+ * Timeline of the communication events, written as a Chrome trace-event JSON
+ * file (it can be opened with chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Compiled only with MTCL_ENABLE_TRACE and enabled at run time by the
+ * MTCL_TRACE=<file> environment variable (see Manager::init). Each thread
+ * records its events into its own ring buffer of TRACE_BUFFER_EVENTS events,
+ * only the most recent ones are kept. The buffers are written to the file by
+ * Manager::finalize and when the process receives TRACE_FLUSH_SIGNAL, while
+ * the threads go on recording: each slot has a sequence number, an event
+ * overwritten while it is read is skipped.
+ */
+
+#if defined(MTCL_ENABLE_TRACE)
+
+#include <csignal>
+
+static inline uint64_t trace_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class Trace {
+    static const size_t LABEL_SIZE = 48;
+
+    // the fields are relaxed atomics, seq (index of the event + 1, 0 while
+    // it is written) tells the reader if they belong to the same event
+    struct Event {
+        std::atomic<uint64_t>    seq{0};
+        std::atomic<const char*> op;
+        std::atomic<uint64_t>    begin, end;  // ns
+        std::atomic<int64_t>     bytes;       // -1 if not meaningful
+        std::atomic<uint64_t>    label[LABEL_SIZE / 8];
+    };
+
+    struct EventCopy {
+        const char* op;
+        uint64_t begin, end;
+        int64_t  bytes;
+        union {
+            uint64_t words[LABEL_SIZE / 8];
+            char     label[LABEL_SIZE];
+        };
+    };
+
+    // written only by its thread, read by flush
+    struct Ring {
+        std::unique_ptr<Event[]> events{new Event[TRACE_BUFFER_EVENTS]};
+        std::atomic<uint64_t> head{0};
+        int tid;
+        std::string name;
+    };
+
+    inline static std::mutex mtx;                       // protects rings and the file
+    inline static std::vector<std::unique_ptr<Ring>> rings;
+    inline static std::atomic<bool> enabled{false};
+    inline static std::atomic<bool> flushRequested{false};
+    inline static std::string file, process;
+    inline static uint64_t start = 0;
+
+    // the buffers outlive their threads, they are flushed at the end
+    static Ring* ring() {
+        thread_local Ring* r = nullptr;
+        if (!r) {
+            std::unique_lock lk(mtx);
+            rings.emplace_back(new Ring);
+            r = rings.back().get();
+            r->tid  = (int)rings.size();
+            r->name = "thread-" + std::to_string(r->tid);
+        }
+        return r;
+    }
+
+    static void onSignal(int) { flushRequested = true; }
+
+    static void writeString(FILE* f, const char* s) {
+        std::fputc('"', f);
+        for(; *s; ++s) {
+            if (*s == '"' || *s == '\\') std::fputc('\\', f);
+            if ((unsigned char)*s >= 0x20) std::fputc(*s, f);
+        }
+        std::fputc('"', f);
+    }
+
+public:
+    /**
+     * @brief Enables the tracing, the events will be written to \b filename
+     * where %p is replaced by the process id and %a by the application name.
+     */
+    static void init(const std::string& filename, const std::string& appName) {
+        file = filename;
+        for(size_t p; (p = file.find("%p")) != std::string::npos; )
+            file.replace(p, 2, std::to_string(getpid()));
+        for(size_t p; (p = file.find("%a")) != std::string::npos; )
+            file.replace(p, 2, appName);
+        process = appName;
+        start   = trace_now();
+        std::signal(TRACE_FLUSH_SIGNAL, onSignal);
+        enabled = true;
+    }
+
+    static bool on() { return enabled.load(std::memory_order_relaxed); }
+
+    static void setThreadName(const std::string& name) {
+        if (!on()) return;
+        Ring* r = ring();
+        std::unique_lock lk(mtx);
+        r->name = name;
+    }
+
+    static void record(const char* op, const std::string& label, uint64_t begin, uint64_t end, int64_t bytes) {
+        Ring* r = ring();
+        uint64_t i = r->head.load(std::memory_order_relaxed);
+        Event& e = r->events[i % TRACE_BUFFER_EVENTS];
+        e.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        e.op.store(op, std::memory_order_relaxed);
+        e.begin.store(begin, std::memory_order_relaxed);
+        e.end.store(end, std::memory_order_relaxed);
+        e.bytes.store(bytes, std::memory_order_relaxed);
+        EventCopy c;
+        size_t n = std::min(label.size(), LABEL_SIZE - 1);
+        std::memcpy(c.label, label.data(), n);
+        std::memset(c.label + n, 0, LABEL_SIZE - n);
+        for(size_t w = 0; w < LABEL_SIZE / 8; ++w)
+            e.label[w].store(c.words[w], std::memory_order_relaxed);
+        e.seq.store(i + 1, std::memory_order_release);
+        r->head.store(i + 1, std::memory_order_release);
+    }
+
+    // copies the i-th event of the ring, false if it has been overwritten
+    static bool read(Ring* r, uint64_t i, EventCopy& c) {
+        const Event& e = r->events[i % TRACE_BUFFER_EVENTS];
+        if (e.seq.load(std::memory_order_acquire) != i + 1) return false;
+        c.op    = e.op.load(std::memory_order_relaxed);
+        c.begin = e.begin.load(std::memory_order_relaxed);
+        c.end   = e.end.load(std::memory_order_relaxed);
+        c.bytes = e.bytes.load(std::memory_order_relaxed);
+        for(size_t w = 0; w < LABEL_SIZE / 8; ++w)
+            c.words[w] = e.label[w].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return e.seq.load(std::memory_order_relaxed) == i + 1;
+    }
+
+    // called periodically by the IO thread (or by getNext with SINGLE_IO_THREAD)
+    static void poll() {
+        if (flushRequested.load(std::memory_order_relaxed) && flushRequested.exchange(false))
+            flush();
+    }
+
+    /**
+     * @brief Writes the events currently in the buffers to the trace file,
+     * overwriting it. The events recorded while flushing may be lost.
+     */
+    static int flush() {
+        if (!on()) return 0;
+        std::unique_lock lk(mtx);
+        FILE* f = std::fopen(file.c_str(), "w");
+        if (!f) {
+            MTCL_ERROR("[Trace]:\t", "cannot open the trace file %s, errno=%d\n", file.c_str(), errno);
+            return -1;
+        }
+        int pid = getpid();
+        std::fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        std::fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":", pid);
+        writeString(f, process.c_str());
+        std::fprintf(f, "}}");
+        for(auto& r : rings) {
+            std::fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", pid, r->tid);
+            writeString(f, r->name.c_str());
+            std::fprintf(f, "}}");
+            uint64_t head = r->head.load(std::memory_order_acquire);
+            uint64_t n = std::min<uint64_t>(head, TRACE_BUFFER_EVENTS);
+            EventCopy e;
+            for(uint64_t i = head - n; i < head; ++i) {
+                if (!read(r.get(), i, e)) continue;
+                std::string name = e.label[0] ? std::string(e.op) + " " + e.label : std::string(e.op);
+                std::fprintf(f, ",\n{\"name\":");
+                writeString(f, name.c_str());
+                std::fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"handle\":",
+                             e.op, pid, r->tid, (e.begin - start) / 1e3, (e.end - e.begin) / 1e3);
+                writeString(f, e.label);
+                if (e.bytes >= 0) std::fprintf(f, ",\"bytes\":%ld", (long)e.bytes);
+                std::fprintf(f, "}}");
+            }
+        }
+        std::fprintf(f, "\n]}\n");
+        std::fclose(f);
+        return 0;
+    }
+};
+
+/**
+ * @brief Records the lifetime of the object as an event named \b op, labeled
+ * with \b label (e.g., the handle name or the team id). Events shorter than
+ * \b minNs nanoseconds are not recorded.
+ */
+class TraceScope {
+    const char* op;
+    const std::string& label;
+    uint64_t minNs;
+    uint64_t begin = 0;
+    int64_t  bytes = -1;
+public:
+    TraceScope(const char* op, const std::string& label, uint64_t minNs=0) :
+        op(op), label(label), minNs(minNs) {
+        if (Trace::on()) begin = trace_now();
+    }
+    void setBytes(int64_t b) { bytes = b; }
+    // drops the event, e.g., a non-blocking probe that found nothing
+    void cancel() { begin = 0; }
+    ~TraceScope() {
+        if (!begin) return;
+        uint64_t end = trace_now();
+        if (end - begin >= minNs) Trace::record(op, label, begin, end, bytes);
+    }
+};
+
+#else  // the tracing compiles away
+
+class Trace {
+public:
+    static void init(const std::string&, const std::string&) {
+        MTCL_ERROR("[Trace]:\t", "MTCL_TRACE is ignored, the library is not compiled with MTCL_ENABLE_TRACE\n");
+    }
+    static bool on() { return false; }
+    static void setThreadName(const std::string&) {}
+    static void poll() {}
+    static int flush() { return 0; }
+};
+
+class TraceScope {
+public:
+    TraceScope(const char*, const std::string&, uint64_t=0) {}
+    void setBytes(int64_t) {}
+    void cancel() {}
+};
+
+#endif
+
+#endif
@@ -21,12 +21,27 @@
 #include <cstring>
 #include <thread>
 
+#include "log.hpp"
+
 extern int mtcl_verbose;
 
+// the prints with a level above MTCL_MAX_VERBOSE are removed at compile time
+#if !defined(MTCL_MAX_VERBOSE)
+#define MTCL_MAX_VERBOSE 2147483647
+#endif
+
+#if defined(MTCL_ENABLE_ASYNC_LOG)
+#define MTCL_LOG(stream, prefix, str, ...)								\
+	AsyncLog::log(stream, prefix, str, ##__VA_ARGS__)
+#else
+#define MTCL_LOG(stream, prefix, str, ...)								\
+	print_prefix(stream, str, prefix, ##__VA_ARGS__)
+#endif
+
 #define MTCL_PRINT(LEVEL, prefix, str, ...)								\
-	if (mtcl_verbose>=LEVEL) print_prefix(stdout, str, prefix, ##__VA_ARGS__)
+	if ((LEVEL)<=MTCL_MAX_VERBOSE && mtcl_verbose>=(LEVEL)) MTCL_LOG(stdout, prefix, str, ##__VA_ARGS__)
 #define MTCL_ERROR(prefix, str, ...)									\
-	print_prefix(stderr, str, prefix, ##__VA_ARGS__)
+	MTCL_LOG(stderr, prefix, str, ##__VA_ARGS__)
 #define MTCL_TCP_PRINT(LEVEL, str, ...) MTCL_PRINT(LEVEL, "[MTCL TCP]:\t",str, ##__VA_ARGS__)
 #define MTCL_SHM_PRINT(LEVEL, str, ...) MTCL_PRINT(LEVEL, "[MTCL SHM]:\t",str, ##__VA_ARGS__)
 #define MTCL_UCX_PRINT(LEVEL, str, ...) MTCL_PRINT(LEVEL, "[MTCL UCX]:\t",str, ##__VA_ARGS__)
@@ -42,19 +57,13 @@ extern int mtcl_verbose;
 
 static inline void print_prefix(FILE *stream, const char * str, const char *prefix, ...) {
     va_list argp;
-    char * p=(char *)malloc(strlen(str)+strlen(prefix)+1);
-    if (!p) {
-		perror("malloc");
-        fprintf(stderr,"FATAL ERROR in print_prefix\n");
-        return;
-    }
-    strcpy(p,prefix);
-    strcpy(p+strlen(prefix), str);
+    // no allocations, the lock keeps the prefix and the message together
+    flockfile(stream);
+    fputs(prefix, stream);
     va_start(argp, prefix);
-    vfprintf(stream, p, argp);
-	fflush(stream);
+    vfprintf(stream, str, argp);
     va_end(argp);
-    free(p);
+    funlockfile(stream);
 }
 
 
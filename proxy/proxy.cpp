@@ -3,6 +3,10 @@
 #include <string>
 #include <optional>
 #include <thread>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 #include "rapidjson/rapidjson.h"
 #include <rapidjson/istreamwrapper.h>
@@ -21,12 +25,27 @@
 #define PROXY_PORT 8002 // solo tra proxy
 #define MAX_DEST_STRING 60
 #define CHUNK_SIZE 1200
+#define PROXY_INITIAL_CREDITS 64 // max number of in-flight messages per virtual connection
+#define PROXY_LOOP_TIMEOUT 1000  // microseconds, max wait of the event loop in getNext
+#define PROXY_TEAM_CACHE 16      // max number of payloads of a team kept by the proxies to be relayed
+#define PROXY_WRITERS 8          // threads writing to the local components
+#define PROXY_WRITER_BATCH 16    // max messages written to a destination before serving the next one
 
-enum cmd_t : char {FWD = 0, CONN = 1, PRX = 2, ERR_CONN = 3, EOS = 4, CONN_COLL = 2};
+enum cmd_t : char {FWD = 0, CONN = 1, PRX = 2, ERR_CONN = 3, EOS = 4, CONN_COLL = 2, ACK = 5, CONN_UPG = 6, FWD_CACHE = 7, FWD_REF = 8};
 
 /**
  * PROXY <--> PROXY PROTOCOL
  *  | char CMD |  size_t IDENTIFIER |  ....... PAYLOAD ........ |
+ *
+ * Flow control: both ends of a virtual connection (connID) start with
+ * PROXY_INITIAL_CREDITS credits and spend one credit for each FWD sent.
+ * Credits are given back with an ACK command (PAYLOAD: size_t #credits)
+ * as soon as the messages have been delivered to the final destination.
+ *
+ * Team relay: the payload of a CONN_COLL is "connectionString\0teamID".
+ * A FWD_CACHE is a FWD whose payload is also kept by the receiving proxy,
+ * a FWD_REF (PAYLOAD: size_t seq) delivers the payload kept for the
+ * seq-th message of the team.
 */
 char headerBuffer[sizeof(char) + sizeof(size_t)];
 char chunkBuffer[CHUNK_SIZE];
@@ -39,6 +58,17 @@ using handleID_t = size_t;
 std::map<std::string, std::pair<std::vector<std::string>, std::vector<std::string>>> pools;
 // components: Name => [hostname, List(protocols), List(listen_endpoints)]
 std::map<std::string, std::tuple<std::string, std::vector<std::string>, std::vector<std::string>>> components;
+// proxy-links: (poolA, poolB) with poolA < poolB => protocol of the PROXY-2-PROXY link
+std::map<std::pair<std::string, std::string>, std::string> proxyLinks;
+
+// transports available for the PROXY-2-PROXY links, registered in the Manager as "P" + protocol;
+// UCX is not among them, the UCX link path has never been built nor tested
+std::set<std::string> linkTypes;
+#ifdef PROXYPROXYMQTT
+const std::string defaultLinkProtocol{"MQTT"};
+#else
+const std::string defaultLinkProtocol{"TCP"};
+#endif
 
 
 std::map<handleID_t, HandleUser> id2handle; // dato un handleID ritorna l'handle
@@ -50,6 +80,240 @@ std::map<connID_t, handleID_t> connID2loc;
 std::map<handleID_t, handleID_t> proc2proc; // associazioni handleID <-> handleID per connessioni tra processi mediante singolo proxy
 
 
+// --------------------------- flow control ---------------------------------
+// The event loop never sends (sends are blocking): the messages are queued
+// in the Outbox of the destination handle. The Outboxes of the local
+// components are written by a pool of PROXY_WRITERS threads, one thread at a
+// time for each Outbox (PROXY_WRITER_BATCH messages, then it serves the next
+// one), so a slow consumer blocks only its own queue and at most one writer.
+// Each PROXY-2-PROXY link has its own writer thread. Once it has an Outbox, a
+// handle is written (and closed) only by the writers, the event loop only
+// reads it. After the close marker the Outbox is no longer scheduled and the
+// event loop frees it when it processes the completion, thus it never waits
+// for a writer.
+// A sender that runs out of credits is not yielded back to the Manager until
+// new credits are available, so only its own flow is throttled.
+struct outMsg_t {
+    std::vector<char> data;
+    size_t offset;  // the payload starts at data[offset]
+    bool remote;    // true: id is a connID whose credits go back to a proxy, false: id is a local handleID
+    size_t id;
+    bool close;     // close marker, processed after all the previous messages
+};
+
+struct completion_t {
+    bool remote;
+    size_t id;
+    bool closed;
+    handleID_t dest;
+};
+
+struct Outbox {
+    HandleUser* h;
+    handleID_t dest;
+    std::deque<outMsg_t> q;
+    std::mutex m;
+    std::condition_variable cv;  // the writer of a link waits here
+    bool scheduled = false;      // in the runnable queue or being written (local components)
+    bool closing = false;        // the close marker has been queued
+};
+
+std::map<handleID_t, Outbox*> outboxes;      // local components
+std::map<handleID_t, Outbox*> links;         // PROXY-2-PROXY links
+
+std::mutex runnableMtx;
+std::condition_variable runnableCv;
+std::deque<Outbox*> runnable;               // Outboxes of local components waiting for a writer
+std::map<connID_t, size_t> credits;          // credits left to forward messages on a connID
+std::map<handleID_t, size_t> pending;        // messages queued but not delivered yet, per local sender (single hop)
+std::map<connID_t, HandleUser> throttledRemote; // senders waiting for an ACK from the remote proxy
+std::map<handleID_t, HandleUser> throttledLocal; // senders waiting for their Outbox to drain (single hop)
+
+std::mutex completionsMtx;
+std::vector<completion_t> completions;      // filled by Outbox threads, drained by the event loop
+
+// forwarding statistics, exported if MTCL_METRICS is set
+auto& forwardedMsgs   = Metrics::counter("mtcl_proxy_forwarded_messages_total", "Messages forwarded to a remote proxy.");
+auto& forwardedBytes  = Metrics::counter("mtcl_proxy_forwarded_bytes_total", "Payload bytes sent to a remote proxy, a relayed team payload only once.");
+auto& deliveredMsgs   = Metrics::counter("mtcl_proxy_delivered_messages_total", "Messages delivered to a local component.");
+auto& deliveredBytes  = Metrics::counter("mtcl_proxy_delivered_bytes_total", "Payload bytes delivered to a local component.");
+auto& virtualConns    = Metrics::gauge("mtcl_proxy_virtual_connections", "Connections forwarded through a remote proxy.");
+auto& throttledSenders = Metrics::gauge("mtcl_proxy_throttled_senders", "Senders not read until the destination catches up.");
+
+void schedule(Outbox* ob) {
+    {
+        std::unique_lock lk(runnableMtx);
+        runnable.push_back(ob);
+    }
+    runnableCv.notify_one();
+}
+
+// writes at most PROXY_WRITER_BATCH messages of a local component, the
+// Outbox may be freed as soon as the completion of the close is pushed
+void writeOutbox(Outbox* ob) {
+    for(int i = 0; i < PROXY_WRITER_BATCH; ++i) {
+        std::unique_lock lk(ob->m);
+        if (ob->q.empty()) {
+            ob->scheduled = false;
+            return;
+        }
+        outMsg_t msg = std::move(ob->q.front());
+        ob->q.pop_front();
+        lk.unlock();
+
+        if (msg.close)
+            ob->h->close();
+        else if (ob->h->send(msg.data.data() + msg.offset, msg.data.size() - msg.offset) < 0) {
+            MTCL_PRINT(0, "[PROXY][ERROR]", "Cannot deliver a message to a local component, errno=%d\n", errno);
+        } else {
+            deliveredMsgs.fetch_add(1, std::memory_order_relaxed);
+            deliveredBytes.fetch_add(msg.data.size() - msg.offset, std::memory_order_relaxed);
+        }
+
+        std::unique_lock clk(completionsMtx);
+        completions.push_back({msg.remote, msg.id, msg.close, ob->dest});
+        if (msg.close) return;
+    }
+    schedule(ob);
+}
+
+// one of the PROXY_WRITERS threads
+void outboxWriter() {
+    while(true) {
+        std::unique_lock lk(runnableMtx);
+        runnableCv.wait(lk, []{ return !runnable.empty(); });
+        Outbox* ob = runnable.front();
+        runnable.pop_front();
+        lk.unlock();
+        writeOutbox(ob);
+    }
+}
+
+// the writer of a PROXY-2-PROXY link, the links are never closed
+void linkWriter(Outbox* ob) {
+    while(true) {
+        std::unique_lock lk(ob->m);
+        ob->cv.wait(lk, [&]{ return !ob->q.empty(); });
+        outMsg_t msg = std::move(ob->q.front());
+        ob->q.pop_front();
+        lk.unlock();
+
+        if (ob->h->send(msg.data.data(), msg.data.size()) < 0)
+            MTCL_PRINT(0, "[PROXY][ERROR]", "Cannot send a message to a remote proxy, errno=%d\n", errno);
+    }
+}
+
+void addLink(HandleUser* h) {
+    Outbox* ob = new Outbox;
+    ob->h = h;
+    ob->dest = h->getID();
+    links.emplace(ob->dest, ob);
+    std::thread(linkWriter, ob).detach();
+}
+
+// queues a message for the proxy at the other end of the link
+void sendLink(handleID_t link, std::vector<char>&& buff) {
+    auto it = links.find(link);
+    if (it == links.end()) {
+        MTCL_PRINT(0, "[PROXY][ERROR]", "Message directed to an unknown proxy link, dropped\n");
+        return;
+    }
+    Outbox* ob = it->second;
+    {
+        std::unique_lock lk(ob->m);
+        ob->q.push_back({std::move(buff), 0, false, 0, false});
+    }
+    ob->cv.notify_one();
+}
+
+void enqueue(handleID_t dest, outMsg_t&& msg) {
+    auto it = outboxes.find(dest);
+    if (it == outboxes.end()) {
+        auto h = id2handle.find(dest);
+        if (h == id2handle.end()) {
+            MTCL_PRINT(0, "[PROXY][ERROR]", "Message directed to a closed local component, dropped\n");
+            return;
+        }
+        Outbox* ob = new Outbox;
+        ob->h = &h->second;
+        ob->dest = dest;
+        it = outboxes.emplace(dest, ob).first;
+    }
+    Outbox* ob = it->second;
+    bool wake;
+    {
+        std::unique_lock lk(ob->m);
+        if (ob->closing) {
+            MTCL_PRINT(0, "[PROXY][ERROR]", "Message directed to a closing local component, dropped\n");
+            return;
+        }
+        ob->closing = msg.close;
+        ob->q.push_back(std::move(msg));
+        wake = !ob->scheduled;
+        ob->scheduled = true;
+    }
+    if (wake) schedule(ob);
+}
+
+// give back credits to the proxy at the other end of the link
+void sendCredits(handleID_t link, connID_t identifier, size_t n) {
+    std::vector<char> buff(sizeof(cmd_t)+sizeof(connID_t)+sizeof(size_t));
+    buff[0] = cmd_t::ACK;
+    memcpy(buff.data()+sizeof(cmd_t), &identifier, sizeof(connID_t));
+    memcpy(buff.data()+sizeof(cmd_t)+sizeof(connID_t), &n, sizeof(size_t));
+    sendLink(link, std::move(buff));
+}
+
+// cleanup of a local handle closed on both sides, its Outbox (if any) must
+// have processed the close marker
+void handleClosed(handleID_t hID) {
+    auto it = id2handle.find(hID);
+    if (it == id2handle.end() || it->second.isClosed() != std::make_pair(true, true) || outboxes.count(hID)) return;
+    if (auto c = loc2connID.find(hID); c != loc2connID.end()) {
+        connID2loc.erase(c->second);
+        connid2proxy.erase(c->second);
+        credits.erase(c->second);
+        throttledRemote.erase(c->second);
+        loc2connID.erase(c);
+    }
+    if (auto src = proc2proc.find(hID); src != proc2proc.end()) {
+        pending.erase(src->second);
+        throttledLocal.erase(src->second);
+        proc2proc.erase(src);
+    }
+    id2handle.erase(it);
+}
+
+void processCompletions() {
+    std::vector<completion_t> done;
+    {
+        std::unique_lock lk(completionsMtx);
+        done.swap(completions);
+    }
+    std::map<connID_t, size_t> acks;
+    for(auto& c : done) {
+        if (c.closed) {
+            // the writer has exited
+            auto ob = outboxes.find(c.dest);
+            delete ob->second;
+            outboxes.erase(ob);
+            handleClosed(c.dest);
+            continue;
+        }
+        if (c.remote) {
+            acks[c.id]++;
+            continue;
+        }
+        auto p = pending.find(c.id);
+        if (p != pending.end() && --(p->second) < PROXY_INITIAL_CREDITS)
+            throttledLocal.erase(c.id); // the HandleUser destructor yields the sender back to the Manager
+    }
+    for(auto& [identifier, n] : acks)
+        if (auto it = connid2proxy.find(identifier); it != connid2proxy.end())
+            sendCredits(it->second->getID(), identifier, n);
+}
+
+
 // invia un messaggio ad un proxy formattato secondo il protocollo definito
 /*void sendHeaderProxy(HandleUser& h, cmd_t cmd, size_t identifier){
     headerBuffer[0] = cmd;
@@ -58,6 +322,108 @@ std::map<handleID_t, handleID_t> proc2proc; // associazioni handleID <-> handleI
 }*/
 
 
+// protocol used for the link between the proxies of the two pools
+const std::string& linkProtocol(const std::string& a, const std::string& b) {
+    auto it = proxyLinks.find(a < b ? std::make_pair(a, b) : std::make_pair(b, a));
+    return it == proxyLinks.end() ? defaultLinkProtocol : it->second;
+}
+
+template<typename T>
+void registerLinkType(const std::string& protocol) {
+    Manager::registerType<T>("P" + protocol);
+    linkTypes.insert("P" + protocol);
+}
+
+// --------------------------- team relay -----------------------------------
+// The connections of the members of a team that cross the same PROXY-2-PROXY
+// link are grouped. The proxy on the root side sends the payload of the n-th
+// message of a connection only once if it is equal to the n-th message of
+// another connection of the team (e.g., a broadcast), the other ones refer
+// to it and the proxy on the members' side fans it out. Both proxies count
+// the messages of each connection in the same order (the link is FIFO) and
+// drop a payload once all the connections of the team went past it.
+struct team_t {
+    std::pair<handleID_t, std::string> key;    // (link, teamID)
+    bool root;                                 // true if this is the proxy on the root side
+    std::map<connID_t, size_t> seq;            // messages relayed on each connection of the team
+    std::map<size_t, std::vector<char>> cache; // payloads that can be referenced, by seq
+};
+std::map<std::pair<handleID_t, std::string>, team_t> teams;
+std::map<connID_t, team_t*> conn2team;
+
+void joinTeam(handleID_t link, const std::string& teamID, connID_t id, bool root) {
+    auto& t = teams[std::make_pair(link, teamID)];
+    t.key = std::make_pair(link, teamID);
+    t.root = root;
+    t.seq[id] = 0;
+    conn2team[id] = &t;
+}
+
+void evictTeam(team_t& t) {
+    size_t min = std::numeric_limits<size_t>::max();
+    for(auto& [_, n] : t.seq) min = std::min(min, n);
+    t.cache.erase(t.cache.begin(), t.cache.lower_bound(min));
+}
+
+// the root side leaves when it sends the EOS, the other side when it receives it
+void leaveTeam(connID_t id, bool sending) {
+    auto it = conn2team.find(id);
+    if (it == conn2team.end() || it->second->root != sending) return;
+    team_t& t = *it->second;
+    conn2team.erase(it);
+    t.seq.erase(id);
+    if (t.seq.empty()) teams.erase(t.key);
+    else evictTeam(t);
+}
+
+// root side: turns the FWD in buffer into a FWD_CACHE or a FWD_REF
+void relayTeamMessage(team_t& t, connID_t id, std::vector<char>& buffer) {
+    const size_t hdr = sizeof(cmd_t)+sizeof(connID_t);
+    size_t n = t.seq[id]++;
+    auto c = t.cache.find(n);
+    if (c != t.cache.end()) {
+        if (c->second.size() == buffer.size()-hdr && std::equal(c->second.begin(), c->second.end(), buffer.begin()+hdr)) {
+            buffer.resize(hdr+sizeof(size_t));
+            buffer[0] = cmd_t::FWD_REF;
+            memcpy(buffer.data()+hdr, &n, sizeof(size_t));
+        }
+    } else if (t.seq.size() > 1 && t.cache.size() < PROXY_TEAM_CACHE) {
+        buffer[0] = cmd_t::FWD_CACHE;
+        t.cache.emplace(n, std::vector<char>(buffer.begin()+hdr, buffer.end()));
+    }
+    evictTeam(t);
+}
+
+// members' side: keeps the payload of a FWD_CACHE, replaces a FWD_REF with the payload it refers to
+bool receiveTeamMessage(cmd_t cmd, connID_t id, std::vector<char>& buffer) {
+    const size_t hdr = sizeof(cmd_t)+sizeof(connID_t);
+    auto it = conn2team.find(id);
+    // the messages from the members to the root are not relayed
+    if (it == conn2team.end() || it->second->root) return cmd != cmd_t::FWD_REF;
+    team_t& t = *it->second;
+    size_t n = t.seq[id]++;
+    if (cmd == cmd_t::FWD_CACHE)
+        t.cache[n] = std::vector<char>(buffer.begin()+hdr, buffer.end());
+    if (cmd == cmd_t::FWD_REF) {
+        size_t ref;
+        memcpy(&ref, buffer.data()+hdr, sizeof(size_t));
+        auto c = t.cache.find(ref);
+        if (ref != n || c == t.cache.end()) return false;
+        buffer.resize(hdr);
+        buffer.insert(buffer.end(), c->second.begin(), c->second.end());
+    }
+    evictTeam(t);
+    return true;
+}
+
+// reads a string of the handshake sent by a component
+bool receiveString(HandleUser& h, std::string& str) {
+    size_t sz;
+    if (h.probe(sz, true) <= 0 || sz > 1048576) return false;
+    str.resize(sz);
+    return h.receive(str.data(), sz) > 0;
+}
+
 HandleUser* toHeap(HandleUser h){
     return new HandleUser(std::move(h));
 }
@@ -110,21 +476,33 @@ int parseConfig(const std::string& f){
             } else
                     MTCL_ERROR("[Manager]:\t", "parseConfig: an object in components is not well defined. Skipping it.\n");
     }
+
+    if (doc.HasMember("proxy-links") && doc["proxy-links"].IsArray()){
+        // transport used between the proxies of two pools (default TCP)
+        for(auto& c : doc["proxy-links"].GetArray())
+            if (c.IsObject() && c.HasMember("pools") && c["pools"].IsArray() && c["pools"].Size() == 2 && c.HasMember("protocol") && c["protocol"].IsString()){
+                auto p = JSONArray2VectorString(c["pools"].GetArray());
+                if (p[0] > p[1]) std::swap(p[0], p[1]);
+                proxyLinks[std::make_pair(p[0], p[1])] = c["protocol"].GetString();
+            } else
+                MTCL_ERROR("[Manager]:\t", "parseConfig: an object in proxy-links is not well defined. Skipping it.\n");
+    }
     return 0;
 }
 
 int main(int argc, char** argv){
     if (argc < 3){
-        std::cerr << "Usage: " << argv[0] << " poolName  configFile" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " poolName  configFile [bindAddress]" << std::endl;
         return -1;
     }
 
     std::string pool(argv[1]);
+    // address of the TCP/UCX listening sockets (e.g., to run more proxies on the same host)
+    std::string bindAddress(argc > 3 ? argv[3] : "0.0.0.0");
 
+    registerLinkType<ConnTcp>("TCP");
 #ifdef PROXYPROXYMQTT
-    Manager::registerType<ConnMQTT>("P");
-#else
-    Manager::registerType<ConnTcp>("P");
+    registerLinkType<ConnMQTT>("MQTT");
 #endif
 
     Manager::init("PROXY-"+pool);
@@ -133,15 +511,15 @@ int main(int argc, char** argv){
     if (parseConfig(std::string(argv[2])) < 0)
         return -1;
 
-    Manager::listen("TCP:0.0.0.0:" + std::to_string(PROXY_CLIENT_PORT));
+    Manager::listen("TCP:" + bindAddress + ":" + std::to_string(PROXY_CLIENT_PORT));
     Manager::listen("MQTT:PROXY-" + pool);
     Manager::listen("MPIP2P:PROXY-" + pool);
-    Manager::listen("UCX:0.0.0.0:" + std::to_string(PROXY_CLIENT_PORT_UCX));
+    Manager::listen("UCX:" + bindAddress + ":" + std::to_string(PROXY_CLIENT_PORT_UCX));
 
+    // one listener for each transport available for the PROXY-2-PROXY links
+    Manager::listen("PTCP:" + bindAddress + ":" + std::to_string(PROXY_PORT));
 #ifdef PROXYPROXYMQTT
-    Manager::listen("P:PROXYPROXY-" + pool);
-#else
-    Manager::listen("P:0.0.0.0:" + std::to_string(PROXY_PORT));
+    Manager::listen("PMQTT:PROXYPROXY-" + pool);
 #endif
     // check if the passed pool as argument actually exists in the configuration file
     if (!pools.count(pool)){
@@ -153,17 +531,23 @@ int main(int argc, char** argv){
     std::map<std::string, HandleUser*> proxies;
     for(auto& [name, val] : pools)
         if (name > pool) {
+            const std::string& protocol = linkProtocol(pool, name);
+            if (!linkTypes.count("P" + protocol)) {
+                MTCL_PRINT(0, "[PROXY]","[ERROR] Protocol %s not available for the link with the PROXY of %s\n", protocol.c_str(), name.c_str());
+                continue;
+            }
             for(auto& addr : val.first){
                 ///if (add == mioaddr) continue; ## TODO!!
-                
-#ifdef PROXYPROXYMQTT
-                auto h = Manager::connect("P:PROXYPROXY-"+name);
-#else
-                // check if there is a ":", it means there is a port_; in this case do not add the default PROXY_PORT
-                auto h = Manager::connect("P:" + addr + (addr.find(":") == std::string::npos ? ":" + std::to_string(PROXY_PORT) : ""));
-#endif
+                std::string connectionString;
+                if (protocol == "MQTT")
+                    connectionString = "PMQTT:PROXYPROXY-" + name;
+                else
+                    // check if there is a ":", it means there is a port_; in this case do not add the default port
+                    connectionString = "P" + protocol + ":" + addr + (addr.find(":") == std::string::npos ? ":" + std::to_string(PROXY_PORT) : "");
+
+                auto h = Manager::connect(connectionString);
                 if (h.isValid()) {
-                    MTCL_PRINT(0, "[PROXY]"," Connected to PROXY of %s (connection string: %s)\n", name.c_str(), addr.c_str());
+                    MTCL_PRINT(0, "[PROXY]"," Connected to PROXY of %s (connection string: %s)\n", name.c_str(), connectionString.c_str());
                     
                     // send cmd: PRX - ID: 0 - Payload: {pool name} to the just connected proxy
                     char* buff = new char[sizeof(cmd_t) + sizeof(size_t) + pool.length()];
@@ -175,19 +559,29 @@ int main(int argc, char** argv){
                     h.yield();
                     // save the proxy handle to perform future writes
                     proxies[name] = toHeap(std::move(h));
+                    addLink(proxies[name]);
                     break;
                 } else {
-                    MTCL_PRINT(0, "[PROXY]","[ERROR] Cannot connect to PROXY of %s (connection string: %s)\n", name.c_str(), addr.c_str());
+                    MTCL_PRINT(0, "[PROXY]","[ERROR] Cannot connect to PROXY of %s (connection string: %s)\n", name.c_str(), connectionString.c_str());
                 }
             }
         }
 
+    for(int i = 0; i < PROXY_WRITERS; ++i)
+        std::thread(outboxWriter).detach();
+
     // this is kind of an event loop
     while(true){
-        auto h = Manager::getNext();
-        
+        auto h = Manager::getNext(std::chrono::microseconds(PROXY_LOOP_TIMEOUT));
+
+        // deliver credits and cleanup closed handles notified by the Outbox threads
+        processCompletions();
+        virtualConns.store(connid2proxy.size(), std::memory_order_relaxed);
+        throttledSenders.store(throttledRemote.size() + throttledLocal.size(), std::memory_order_relaxed);
+        if (!h.isValid()) continue;
+
         // the handle represent a PROXY-2-PROXY connection
-        if (Manager::getTypeOfHandle(h) == "P"){
+        if (linkTypes.count(Manager::getTypeOfHandle(h))){
             if (h.isNewConnection()){ // new incoming PROXY connection
                 MTCL_PRINT(0, "[PROXY]", "Received a new connection from proxy (before reading)\n");
 
@@ -205,6 +599,7 @@ int main(int argc, char** argv){
                 // yield the connection and save the handle to perform future writes
                 h.yield();
                 proxies[poolName] = toHeap(std::move(h));
+                addLink(proxies[poolName]);
                 delete [] buff;
                 MTCL_PRINT(0, "[PROXY]", "Received a new connection from proxy of pool: %s\n", poolName.c_str());
                 continue;
@@ -214,42 +609,56 @@ int main(int argc, char** argv){
             if (h.probe(sz) < 0){
                 MTCL_PRINT(0, "[PROXY][ERROR]", "Probe error on receive form proxy\n");
             };
-            char* buff = new char[sz];
-            h.receive(buff, sz);
+            std::vector<char> buff(sz);
+            h.receive(buff.data(), sz);
 
             // parse the PROXY-2-PROXY header fields
             cmd_t cmd = (cmd_t)buff[0];
-            connID_t identifier = *reinterpret_cast<connID_t*>(buff+sizeof(char));
-            char* payload = buff + sizeof(char) + sizeof(size_t);
+            connID_t identifier = *reinterpret_cast<connID_t*>(buff.data()+sizeof(char));
+            char* payload = buff.data() + sizeof(char) + sizeof(size_t);
             size_t size = sz - sizeof(char) - sizeof(size_t); // actual payload size
 
             if (cmd == cmd_t::EOS){
                 MTCL_PRINT(0, "[PROXY]", "Received a EOS from a remote peer\n");
 
-                if (connID2loc.count(identifier)){
-                    handleID_t hID_ = connID2loc.at(identifier);
-                    auto& h_ = id2handle.at(hID_);
-                    h_.close();
-                    if (h_.isClosed() == std::make_pair<bool, bool>(true, true)){
-                        id2handle.erase(hID_);
-
-                        connID2loc.erase(loc2connID[hID_]);
-                        loc2connID.erase(hID_);
-                    }
-                }
+                leaveTeam(identifier, false);
+                // the handle is closed (and cleaned up) after the pending messages have been delivered
+                if (connID2loc.count(identifier))
+                    enqueue(connID2loc.at(identifier), {{}, 0, true, identifier, true});
                 else
                     std::cerr << "Received a EOS message from a proxy but the identifier is unknown!\n";
             }
            
-           if (cmd == cmd_t::FWD){
-                if (connID2loc.count(identifier) && id2handle.count(connID2loc.at(identifier)))
-                    id2handle[connID2loc.at(identifier)].send(payload, size);
-                else
-                    std::cerr << "Received a forward message from a proxy but the identifier is unknown! Identifier: " << identifier << " - Payload: " << payload << std::endl;
+           if (cmd == cmd_t::FWD || cmd == cmd_t::FWD_CACHE || cmd == cmd_t::FWD_REF){
+                if (!receiveTeamMessage(cmd, identifier, buff))
+                    std::cerr << "Received a reference to an unknown team payload! Identifier: " << identifier << std::endl;
+                else if (connID2loc.count(identifier) && id2handle.count(connID2loc.at(identifier))) {
+                    enqueue(connID2loc.at(identifier), {std::move(buff), sizeof(char) + sizeof(size_t), true, identifier, false});
+                    continue;
+                } else
+                    std::cerr << "Received a forward message from a proxy but the identifier is unknown! Identifier: " << identifier << std::endl;
+                // the message is dropped, its credit goes back to the sender anyway
+                sendCredits(h.getID(), identifier, 1);
+           }
+
+           if (cmd == cmd_t::ACK){
+                size_t n;
+                memcpy(&n, payload, sizeof(size_t));
+                // a late ACK of a connection already cleaned up is ignored
+                if (auto c = credits.find(identifier); c != credits.end()) {
+                    c->second += n;
+                    // the HandleUser destructor yields the throttled sender (if any) back to the Manager
+                    throttledRemote.erase(identifier);
+                }
            }
 
-           if (cmd == cmd_t::CONN || cmd == cmd_t::CONN_COLL){
+           if (cmd == cmd_t::CONN || cmd == cmd_t::CONN_COLL || cmd == cmd_t::CONN_UPG){
                 std::string connectionString(payload, size); // something like: TCP:Appname, UCX:AppName
+                std::string teamID;
+                if (auto end = connectionString.find('\0'); end != std::string::npos) { // CONN_COLL: ...\0teamID
+                    teamID = connectionString.substr(end+1);
+                    connectionString.resize(end);
+                }
                 std::string protocol;
                 std::string componentName;
                 if (connectionString.find(":") != std::string::npos){
@@ -260,7 +669,7 @@ int main(int argc, char** argv){
                     componentName = connectionString;
                 }
 
-                MTCL_PRINT(0, "[PROXY]", "Received a %s connection directed to %s with protocol %s\n", (cmd == cmd_t::CONN_COLL ? "collective" : "p2p"), componentName.c_str(), protocol.c_str());
+                MTCL_PRINT(0, "[PROXY]", "Received a %s connection directed to %s with protocol %s\n", (cmd == cmd_t::CONN_COLL ? "collective" : (cmd == cmd_t::CONN_UPG ? "upgradable p2p" : "p2p")), componentName.c_str(), protocol.c_str());
                 // check that the component name actually exists in the configuration file
                 if (!components.count(componentName)){
                     std::cerr << "Component name ["<< componentName << "] not found in configuration file\n";
@@ -279,11 +688,13 @@ int main(int argc, char** argv){
                             loc2connID.insert(std::make_pair(newHandle.getID(), identifier));
                             connID2loc.insert(std::make_pair(identifier, newHandle.getID()));
                             /// ########
-                            int collective = cmd == cmd_t::CONN_COLL;
+                            int collective = cmd == cmd_t::CONN_COLL ? HANDSHAKE_COLLECTIVE : (cmd == cmd_t::CONN_UPG ? HANDSHAKE_UPGRADABLE : HANDSHAKE_P2P);
                             newHandle.send(&collective, sizeof(int)); // <== send the int for a collective
                             /// ########
                             newHandle.yield();
                             id2handle.emplace(newHandle.getID(), std::move(newHandle));
+                            credits[identifier] = PROXY_INITIAL_CREDITS;
+                            if (!teamID.empty()) joinTeam(h.getID(), teamID, identifier, true);
                             h.yield();
                             connid2proxy.emplace(identifier, toHeap(std::move(h)));
                             found = true;
@@ -296,8 +707,6 @@ int main(int argc, char** argv){
                     // TODO: manda indietro errore al proxy di orgine...
                 }
            }
-            
-            delete [] buff;
         
             continue;
         } else { // receive something from a component (NOT A PROXY!)
@@ -318,33 +727,15 @@ int main(int argc, char** argv){
                     MTCL_PRINT(0, "[PROXY][ERROR]", "Probe return 0 or -1 for a new connection not from a proxy\n");
                     continue;
                 }
-                char* teamID = nullptr;
-                size_t teamIDSize = 0;
-                if(collective) {
-                
-                    if (h.probe(teamIDSize, true) <= 0) {
-                        MTCL_PRINT(0, "[Manager]:\t", "addinQ handshProtocol specifiedake error in probe, teamID size, errno=%d\n", errno);
-                        teamID=nullptr;
-                        return -1;
-                    }
-                    // sanity check
-                    if (teamIDSize>1048576) {
-                        MTCL_PRINT(0, "[Manager]:\t", "addinQ handshake error in probe, teamID size TOO LARGE (size=%ld)\n", teamIDSize);
-                        teamID=nullptr;
-                        return -1;
-                    }
-                    
-                    teamID = new char[teamIDSize+1];
-                    assert(teamID);
-                    if (h.receive(teamID, teamIDSize) <=0) {
-                        MTCL_PRINT(0, "[Manager]:\t", "addinQ handshake error in probe, receiving teamID, errno=%d\n", errno);
-                        delete [] teamID;
-                        teamID=nullptr;
-                        return -1;
-                    }
-                    teamID[teamIDSize] = '\0';			
-                    MTCL_PRINT(100, "[PROXY]: \t", "received connection for team: %s\n", teamID);
-                }	
+                // collectives send their appName and the teamID, upgradable connections the upgrade token
+                std::string appName, teamID;
+                if ((collective == HANDSHAKE_COLLECTIVE && !receiveString(h, appName)) ||
+                    (collective != HANDSHAKE_P2P && !receiveString(h, teamID))) {
+                    MTCL_PRINT(0, "[PROXY][ERROR]", "Handshake error on a new connection not from a proxy, errno=%d\n", errno);
+                    continue;
+                }
+                if (collective == HANDSHAKE_COLLECTIVE)
+                    MTCL_PRINT(100, "[PROXY]: \t", "received connection for team: %s from %s\n", teamID.c_str(), appName.c_str());
 
                 std::string connectString(destComponentName, sz);
                 std::string componentName = connectString.substr(connectString.find(':')+1);
@@ -377,7 +768,8 @@ int main(int argc, char** argv){
                                 if (newHandle.isValid()){
                                     // ###########
                                     newHandle.send(&collective, sizeof(int));
-                                    if (collective) newHandle.send(teamID, teamIDSize); // send teamID if it is a collective
+                                    if (collective == HANDSHAKE_COLLECTIVE) newHandle.send(appName.c_str(), appName.length());
+                                    if (collective != HANDSHAKE_P2P) newHandle.send(teamID.c_str(), teamID.length());
                                     // ############
                                     proc2proc.emplace(h.getID(), newHandle.getID());
                                     proc2proc.emplace(newHandle.getID(), h.getID());
@@ -395,30 +787,37 @@ int main(int argc, char** argv){
                         }
                     }
                 } else { // pool of destination non-empty
-                    char* buff = new char[sizeof(cmd_t)+sizeof(handleID_t)+connectString.length()];
-                    buff[0] = collective ? cmd_t::CONN_COLL : cmd_t::CONN;
+                    // the CONN_COLL payload carries also the teamID, so that the remote proxy can relay the team
+                    std::string payload = connectString + (collective == HANDSHAKE_COLLECTIVE ? std::string(1, '\0') + teamID : "");
+                    std::vector<char> buff(sizeof(cmd_t)+sizeof(connID_t)+payload.length());
+                    buff[0] = collective == HANDSHAKE_UPGRADABLE ? cmd_t::CONN_UPG : (collective ? cmd_t::CONN_COLL : cmd_t::CONN);
                     connID_t identifier = std::hash<std::string>{}(connectString + pool + std::to_string(h.getID()));
-                    memcpy(buff+sizeof(cmd_t), &identifier, sizeof(connID_t));
-                    memcpy(buff+sizeof(cmd_t)+sizeof(connID_t), connectString.c_str(), connectString.length());
+                    memcpy(buff.data()+sizeof(cmd_t), &identifier, sizeof(connID_t));
+                    memcpy(buff.data()+sizeof(cmd_t)+sizeof(connID_t), payload.c_str(), payload.length());
                     if (!proxies.count(poolOfDestination)){
                         MTCL_PRINT(0, "[PROXY]", "Pool of destination [%s] not found in the list of available pools\n", poolOfDestination.c_str());
                         continue; // check if its enough to continue
                     }
-                    proxies[poolOfDestination]->send(buff, sizeof(cmd_t)+sizeof(handleID_t)+connectString.length());
-                    delete [] buff;
+                    sendLink(proxies[poolOfDestination]->getID(), std::move(buff));
                     loc2connID.insert(std::make_pair(h.getID(), identifier));
                     connID2loc.insert(std::make_pair(identifier, h.getID()));
                     connid2proxy.emplace(identifier, proxies[poolOfDestination]);
+                    credits[identifier] = PROXY_INITIAL_CREDITS;
+                    if (collective == HANDSHAKE_COLLECTIVE)
+                        joinTeam(proxies[poolOfDestination]->getID(), teamID, identifier, false);
                     sleep(1);
-                    // send the teamID if it is a collective
-                    if (collective){
-                        char* buff_ = new char[sizeof(cmd_t)+sizeof(handleID_t)+teamIDSize];
+                    // send the rest of the handshake: appName and teamID if it is a collective,
+                    // the upgrade token for upgradable connections
+                    auto forward = [&](const std::string& str) {
+                        credits[identifier]--;
+                        std::vector<char> buff_(sizeof(cmd_t)+sizeof(connID_t)+str.length());
                         buff_[0] = cmd_t::FWD;
-                        memcpy(buff_+sizeof(cmd_t), &identifier, sizeof(connID_t));
-                        memcpy(buff_+sizeof(cmd_t)+sizeof(connID_t), teamID, teamIDSize);
-                        proxies[poolOfDestination]->send(buff_, sizeof(cmd_t)+sizeof(handleID_t)+teamIDSize);
-                        delete [] buff_;
-                    }
+                        memcpy(buff_.data()+sizeof(cmd_t), &identifier, sizeof(connID_t));
+                        memcpy(buff_.data()+sizeof(cmd_t)+sizeof(connID_t), str.c_str(), str.length());
+                        sendLink(proxies[poolOfDestination]->getID(), std::move(buff_));
+                    };
+                    if (collective == HANDSHAKE_COLLECTIVE) forward(appName);
+                    if (collective != HANDSHAKE_P2P) forward(teamID);
                 }
 
                 h.yield();
@@ -435,54 +834,53 @@ int main(int argc, char** argv){
             };
             if (sz == 0){
                 if (loc2connID.count(connId)){ // if the connection is a multi hop send EOS cmd to the next proxy and cleanup 
-                    char buffer[sizeof(cmd_t)+sizeof(connID_t)];
+                    std::vector<char> buffer(sizeof(cmd_t)+sizeof(connID_t));
                     buffer[0] = cmd_t::EOS;
                     connID_t connectionID = loc2connID.at(connId);
-                    memcpy(buffer+sizeof(cmd_t), &connectionID, sizeof(connID_t));
-                    connid2proxy[connectionID]->send(buffer, sizeof(buffer));
-
-                    // if the connection is closed both side we can cleanup everything related to the connection
-                    if (h.isClosed() == std::make_pair(true, true)){
-                        connID2loc.erase(loc2connID[connId]);
-                        loc2connID.erase(connId);
-                        connid2proxy.erase(connectionID);
-                        id2handle.erase(connId);
-                    }
+                    memcpy(buffer.data()+sizeof(cmd_t), &connectionID, sizeof(connID_t));
+                    sendLink(connid2proxy.at(connectionID)->getID(), std::move(buffer));
+                    leaveTeam(connectionID, true);
+
+                    // if the connection is closed both side we can cleanup everything related to the
+                    // connection, otherwise it is done when the close marker has been processed
+                    handleClosed(connId);
                 } else { // the connection is a single hop 
                     const auto& dest = proc2proc.find(connId);
-                    if (dest != proc2proc.end()){
-                        id2handle[dest->second].close();
-
-                        if (id2handle[dest->second].isClosed() == std::make_pair(true, true)){
-                            proc2proc.erase(dest->second);
-                            id2handle.erase(dest->second);
-                        }
-                    }
+                    // the destination is closed (and cleaned up) after the pending messages have been delivered
+                    if (dest != proc2proc.end())
+                        enqueue(dest->second, {{}, 0, false, connId, true});
                 }
 
                 continue;
             }
 
-            char* buffer = new char[sizeof(cmd_t)+sizeof(connID_t)+sz];
-            h.receive(buffer+sizeof(cmd_t)+sizeof(connID_t), sz); // write on the right side of the buffer
+            std::vector<char> buffer(sizeof(cmd_t)+sizeof(connID_t)+sz);
+            h.receive(buffer.data()+sizeof(cmd_t)+sizeof(connID_t), sz); // write on the right side of the buffer
 
             if (loc2connID.count(connId)){
                 buffer[0] = cmd_t::FWD;
                 connID_t connectionID = loc2connID.at(connId);
-                memcpy(buffer+sizeof(cmd_t), &connectionID, sizeof(connID_t));
-                connid2proxy[connectionID]->send(buffer, sizeof(cmd_t)+sizeof(connID_t)+sz);
-                delete [] buffer;
+                memcpy(buffer.data()+sizeof(cmd_t), &connectionID, sizeof(connID_t));
+                if (auto t = conn2team.find(connectionID); t != conn2team.end() && t->second->root)
+                    relayTeamMessage(*t->second, connectionID, buffer);
+                forwardedMsgs.fetch_add(1, std::memory_order_relaxed);
+                forwardedBytes.fetch_add(buffer.size()-sizeof(cmd_t)-sizeof(connID_t), std::memory_order_relaxed);
+                sendLink(connid2proxy.at(connectionID)->getID(), std::move(buffer));
+                // out of credits, stop reading from this sender until the remote proxy sends an ACK
+                if (--credits[connectionID] == 0)
+                    throttledRemote.emplace(connectionID, std::move(h));
                 continue;
             }
             const auto& dest = proc2proc.find(connId);
             if (dest != proc2proc.end()){
-                id2handle[dest->second].send(buffer+sizeof(cmd_t)+sizeof(connID_t), sz);
-                delete [] buffer;
+                enqueue(dest->second, {std::move(buffer), sizeof(cmd_t)+sizeof(connID_t), false, connId, false});
+                // too many messages still queued for the destination, stop reading from this sender
+                if (++pending[connId] >= PROXY_INITIAL_CREDITS)
+                    throttledLocal.emplace(connId, std::move(h));
                 continue;
             }
 
             std::cerr << "Received something from a old connection that i cannot handle! :(\n";
-            delete [] buffer;
         }
     }
 
@@ -0,0 +1,53 @@
+#ifndef PROXY_TEST_HPP
+#define PROXY_TEST_HPP
+
+/*
+ * Two pools on one host: the proxy of pool1 on 127.0.0.1 and the one of
+ * pool2 on 127.0.0.2, linked by the given protocol. App0 is in pool1, the
+ * other components in pool2, each one listening on TCP.
+ */
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static void writeConfig(const std::string& file, const std::string& link, int ncomponents) {
+	std::ofstream f(file);
+	f << "{\n\"pools\" : [\n"
+	  << "  { \"name\" : \"pool1\", \"proxyIp\" : [\"127.0.0.1\"], \"nodes\" : [\"localhost\"] },\n"
+	  << "  { \"name\" : \"pool2\", \"proxyIp\" : [\"127.0.0.2\"], \"nodes\" : [\"localhost\"] }\n],\n"
+	  << "\"components\" : [\n";
+	for(int i=0;i<ncomponents;++i)
+		f << "  { \"name\" : \"App" << i << "\", \"host\" : \"" << (i ? "pool2" : "pool1") << ":localhost\", "
+		  << "\"protocols\" : [\"TCP\"], \"listen-endpoints\" : [\"TCP:127.0.0." << (i ? 2 : 1) << ":"
+		  << 14000 + i << "\"] }" << (i < ncomponents-1 ? ",\n" : "\n");
+	f << "],\n\"proxy-links\" : [ { \"pools\" : [\"pool1\", \"pool2\"], \"protocol\" : \"" << link << "\" } ]\n}\n";
+}
+
+// starts the proxies, pool2 first since the proxy of pool1 connects to it
+static std::vector<pid_t> launchProxies(const std::string& proxy, const std::string& config,
+										const std::string& metrics = "") {
+	std::vector<pid_t> pids;
+	for(int i : {2, 1}) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			if (i == 1 && !metrics.empty()) setenv("MTCL_METRICS", metrics.c_str(), 1);
+			std::string pool = "pool" + std::to_string(i), addr = "127.0.0." + std::to_string(i);
+			execl(proxy.c_str(), proxy.c_str(), pool.c_str(), config.c_str(), addr.c_str(), (char*)nullptr);
+			_exit(127);
+		}
+		pids.push_back(pid);
+		sleep(1);
+	}
+	return pids;
+}
+
+static void stopProxies(const std::vector<pid_t>& pids) {
+	for(auto pid : pids) kill(pid, SIGTERM);
+	for(auto pid : pids) waitpid(pid, nullptr, 0);
+}
+
+#endif
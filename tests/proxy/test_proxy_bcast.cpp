@@ -0,0 +1,68 @@
+// broadcast across two pools (proxy_test.hpp), each payload relayed once on the link: ./test_proxy_bcast ../../proxy/proxy [TCP|MQTT]
+#include <iostream>
+#include "../test_utils.hpp"
+#include "proxy_test.hpp"
+
+const int nmembers = 3;
+const int nmsgs    = 50;
+const size_t size  = 4096;
+const std::string config{"/tmp/test_proxy_bcast.json"};
+const std::string endpoint{"/tmp/test_proxy_bcast.sock"};
+const std::string participants{"App0:App1:App2:App3"};
+
+static void fill(std::vector<char>& buff, int i) {
+	for(size_t j=0;j<buff.size();++j) buff[j] = (char)(i + j);
+}
+
+int main(int argc, char** argv){
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " proxy [TCP|MQTT]\n";
+		return -1;
+	}
+	writeConfig(config, argc > 2 ? argv[2] : "TCP", nmembers + 1);
+	auto proxies = launchProxies(argv[1], config, "unix:" + endpoint);
+
+	std::vector<pid_t> members;
+	for(int m=1;m<=nmembers;++m) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			Manager::init("App" + std::to_string(m), config);
+			auto hg = Manager::createTeam(participants, "App0", MTCL_BROADCAST);
+			bool ok = check(hg.isValid(), "cannot create the team");
+			std::vector<char> buff(size), expected(size);
+			for(int i=0;i<nmsgs && ok;++i) {
+				fill(expected, i);
+				ok = check(hg.sendrecv(nullptr, 0, buff.data(), size) == (ssize_t)size && buff == expected,
+						   "wrong payload");
+			}
+			if (hg.isValid()) hg.close();
+			Manager::finalize(true);
+			return ok ? 0 : -1;
+		}
+		members.push_back(pid);
+	}
+
+	Manager::init("App0", config);
+	auto hg = Manager::createTeam(participants, "App0", MTCL_BROADCAST);
+	bool ok = check(hg.isValid(), "cannot create the team");
+	std::vector<char> buff(size);
+	for(int i=0;i<nmsgs && ok;++i) {
+		fill(buff, i);
+		ok = hg.sendrecv(buff.data(), size, buff.data(), size) == (ssize_t)size;
+	}
+	if (hg.isValid()) hg.close();
+	Manager::finalize(true);
+
+	for(auto pid : members) {
+		int status;
+		if (!ok) kill(pid, SIGTERM);
+		waitpid(pid, &status, 0);
+		ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+	double bytes = sampleValue(scrape(endpoint), "mtcl_proxy_forwarded_bytes_total");
+	ok = ok && check(bytes >= nmsgs * size && bytes < 2 * nmsgs * size, "payloads not relayed once");
+	stopProxies(proxies);
+	if (!ok) return -1;
+	MTCL_ERROR("[test_proxy_bcast]:\t", "OK!\n");
+	return 0;
+}
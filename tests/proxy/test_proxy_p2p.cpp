@@ -0,0 +1,65 @@
+// p2p connection across two pools (proxy_test.hpp), more messages than the credits: ./test_proxy_p2p ../../proxy/proxy [TCP|MQTT]
+#include <iostream>
+#include "../test_utils.hpp"
+#include "proxy_test.hpp"
+
+const int nmsgs = 200;
+const std::string config{"/tmp/test_proxy_p2p.json"};
+
+int main(int argc, char** argv){
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " proxy [TCP|MQTT]\n";
+		return -1;
+	}
+	writeConfig(config, argc > 2 ? argv[2] : "TCP", 2);
+	auto proxies = launchProxies(argv[1], config);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		Manager::init("App1", config);
+		bool ok = true;
+		char buff[nmsgs];
+		while(ok) {
+			auto h = Manager::getNext();
+			if (h.isNewConnection()) continue;
+			ssize_t r = h.receive(buff, sizeof(buff));
+			if (r == 0) {
+				h.close();
+				break;
+			}
+			ok = check(r > 0 && h.send(buff, r) == r, "echo error");
+		}
+		Manager::finalize(true);
+		return ok ? 0 : -1;
+	}
+
+	Manager::init("App0", config);
+	HandleUser h;
+	for(int j=0;j<10 && !h.isValid();++j) {
+		h = Manager::connect("TCP:App1");
+		if (!h.isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+	bool ok = check(h.isValid(), "cannot connect to App1");
+	char buff[nmsgs];
+	for(int i=1;i<=nmsgs && ok;++i) {
+		buff[i-1] = (char)i;
+		ok = h.send(buff, i) == i;
+	}
+	char rbuff[nmsgs];
+	for(int i=1;i<=nmsgs && ok;++i)
+		ok = check(h.receive(rbuff, i) == i && std::equal(buff, buff+i, rbuff), "wrong message");
+	if (h.isValid()) {
+		h.close();
+		size_t sz;
+		ok = ok && check(h.probe(sz) == 0, "missing EOS");
+	}
+	Manager::finalize(true);
+
+	int status;
+	if (!h.isValid()) kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	stopProxies(proxies);
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	MTCL_ERROR("[test_proxy_p2p]:\t", "OK!\n");
+	return 0;
+}
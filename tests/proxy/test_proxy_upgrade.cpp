@@ -0,0 +1,76 @@
+// p2p connection across two pools (proxy_test.hpp) upgraded to a direct one while in use, no loss or reordering: ./test_proxy_upgrade ../../proxy/proxy
+#include <iostream>
+#include "../test_utils.hpp"
+#include "proxy_test.hpp"
+
+const int nmsgs  = 1000;
+const int window = 10;  // messages in flight, some of them cross the switch
+const std::string config{"/tmp/test_proxy_upgrade.json"};
+const std::string endpoint{"/tmp/test_proxy_upgrade.sock"};
+
+int main(int argc, char** argv){
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " proxy\n";
+		return -1;
+	}
+	writeConfig(config, "TCP", 2);
+	auto proxies = launchProxies(argv[1], config, "unix:" + endpoint);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		Manager::init("App1", config);
+		bool ok = true;
+		int next = 0;
+		while(ok) {
+			auto h = Manager::getNext();
+			if (h.isNewConnection()) continue;
+			int i;
+			ssize_t r = h.receive(&i, sizeof(int));
+			if (r == 0) {
+				h.close();
+				break;
+			}
+			ok = check(r == sizeof(int) && i == next++, "message lost or out of order") &&
+				check(h.send(&i, sizeof(int)) == sizeof(int), "echo error");
+		}
+		ok = ok && check(next == nmsgs, "missing messages");
+		// the proxied connection and the direct one
+		ok = ok && check(Manager::getStats()["TCP"].connOpened == 2, "connection not upgraded");
+		Manager::finalize(true);
+		return ok ? 0 : -1;
+	}
+
+	Manager::init("App0", config);
+	HandleUser h;
+	for(int j=0;j<10 && !h.isValid();++j) {
+		h = Manager::connect("TCP:App1");
+		if (!h.isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+	bool ok = check(h.isValid(), "cannot connect to App1");
+	for(int i=0;i<nmsgs && ok;i+=window) {
+		for(int j=i;j<i+window && ok;++j)
+			ok = h.send(&j, sizeof(int)) == sizeof(int);
+		for(int j=i;j<i+window && ok;++j) {
+			int r;
+			ok = check(h.receive(&r, sizeof(int)) == sizeof(int) && r == j, "echo lost or out of order");
+		}
+	}
+	if (h.isValid()) {
+		h.close();
+		size_t sz;
+		ok = ok && check(h.probe(sz) == 0, "missing EOS");
+	}
+	ok = ok && check(Manager::getStats()["TCP"].connOpened == 2, "connection not upgraded");
+	Manager::finalize(true);
+
+	int status;
+	if (!h.isValid()) kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	// the first messages went through the proxies, the others on the direct connection
+	double forwarded = sampleValue(scrape(endpoint), "mtcl_proxy_forwarded_messages_total");
+	ok = ok && check(forwarded > 0 && forwarded < nmsgs, "the switch did not happen while in use");
+	stopProxies(proxies);
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	MTCL_ERROR("[test_proxy_upgrade]:\t", "OK!\n");
+	return 0;
+}
@@ -0,0 +1,111 @@
+// traffic capture (MTCL_CAPTURE) of two connections read back after finalize
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "test_utils.hpp"
+
+const int nmsgs = 100;
+const int nconn = 2;
+
+std::string address{"TCP:localhost:13000"};
+const std::string capfile{"/tmp/test_capture-%a.cap"};
+
+int main(int argc, char** argv){
+	if (argc>1) {
+		address=argv[1];
+	}
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		Manager::init("test_capture-server");
+		if (Manager::listen(address.c_str())==-1) {
+			MTCL_ERROR("[Server]:\t", "ERROR, cannot listen to %s, errno=%d\n", address.c_str(), errno);
+			Manager::finalize();
+			return -1;
+		}
+		int closed = 0;
+		char buff[nmsgs];
+		while(closed < nconn + 1) {
+			auto h = Manager::getNext();
+			if (h.isNewConnection()) continue;
+			ssize_t r = h.receive(buff, sizeof(buff));
+			if (r < 0) {
+				MTCL_ERROR("[Server]:\t", "ERROR receive: errno=%d\n", errno);
+				break;
+			}
+			if (r == 0) {
+				h.close();
+				closed++;
+			}
+		}
+		Manager::finalize(true);
+		return closed == nconn + 1 ? 0 : -1;
+	}
+
+	setenv("MTCL_CAPTURE", capfile.c_str(), 1);
+	Manager::init("test_capture-client");
+	// closed without sending, not described, its peer is not given to the
+	// next handles
+	std::string other = address;
+	if (auto p = other.find("localhost"); p != std::string::npos) other.replace(p, 9, "127.0.0.1");
+	for(int j=0;j<10;++j) {
+		auto h = Manager::connect(other);
+		if (!h.isValid()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			continue;
+		}
+		h.close();
+		break;
+	}
+	std::vector<HandleUser> handles;
+	for(int j=0;j<10 && (int)handles.size()<nconn;++j) {
+		auto h = Manager::connect(address.c_str());
+		if (!h.isValid()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			continue;
+		}
+		h.setName("conn" + std::to_string(handles.size()));
+		handles.push_back(std::move(h));
+	}
+	if ((int)handles.size() != nconn) {
+		MTCL_ERROR("[Client]:\t", "cannot connect to server, exit\n");
+		Manager::finalize();
+		return -1;
+	}
+	char buff[nmsgs]{};
+	for(int i=1;i<=nmsgs;++i)
+		for(auto& h : handles)
+			if (h.send(buff, i)<0) {
+				MTCL_ERROR("[Client]:\t", "ERROR sending errno=%d\n", errno);
+				break;
+			}
+	for(auto& h : handles) h.close();
+	Manager::finalize(true);
+
+	int status;
+	wait(&status);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+
+	const std::string filename{"/tmp/test_capture-test_capture-client.cap"};
+	capture::File f;
+	bool ok = check(f.load(filename), "cannot read the capture file") &&
+		check(f.app == "test_capture-client", "wrong application name") &&
+		check(f.handles.size() == nconn, "wrong number of handles") &&
+		check(f.sends.size() == nconn*nmsgs, "wrong number of sends");
+	for(auto& [id, h] : f.handles) {
+		if (!ok) break;
+		ok = check(h.peer == address, "wrong peer") &&
+			check(h.protocol == address.substr(0, address.find(':')), "wrong protocol") &&
+			check(h.name.rfind("conn", 0) == 0, "wrong handle name");
+		uint32_t expected = 1;
+		for(size_t i = 0; i < f.sends.size() && ok; ++i) {
+			if (i && f.sends[i].ns < f.sends[i-1].ns) ok = check(false, "sends not in time order");
+			if (f.sends[i].id == id) ok = check(f.sends[i].size == expected++, "wrong send size");
+		}
+	}
+	unlink(filename.c_str());
+	if (!ok) return -1;
+	MTCL_ERROR("[test_capture]:\t", "OK!\n");
+	return 0;
+}
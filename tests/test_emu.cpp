@@ -0,0 +1,118 @@
+// network emulation (EMU): delay, bandwidth, in-order jitter and no head-of-line blocking
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "test_utils.hpp"
+
+const int nping = 5;
+const int nbulk = 4;
+const int nseq  = 200;
+const int nblock = 32;  // messages of 1MB filling the socket buffers
+const size_t bulk = 1<<20;
+
+std::string address{"TCP:localhost:13000"};
+
+int main(int argc, char** argv){
+	if (argc>1) {
+		address=argv[1];
+	}
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		Manager::init("test_emu-server");
+		std::string uri = "EMU:" + address + "?lat=20ms";
+		if (Manager::listen(uri)==-1) {
+			MTCL_ERROR("[Server]:\t", "ERROR, cannot listen to %s, errno=%d\n", uri.c_str(), errno);
+			Manager::finalize();
+			return -1;
+		}
+		auto h = Manager::getNext();
+		std::vector<char> buff(bulk);
+		bool ok = true;
+		for(int i=0;i<nping && ok;++i)
+			ok = h.receive(buff.data(), 1) == 1 && h.send(buff.data(), 1) == 1;
+		for(int i=0;i<nbulk && ok;++i)
+			ok = h.receive(buff.data(), bulk) == (ssize_t)bulk;
+		if (ok) ok = h.send(buff.data(), 1) == 1;
+		for(int i=0;i<nseq && ok;++i) {
+			int v;
+			ok = check(h.receive(&v, sizeof(v)) == sizeof(v) && v == i, "message out of order");
+		}
+		HandleUser b;
+		if (ok) b = Manager::getNext();
+		for(int i=0;i<nping && ok;++i)
+			ok = h.receive(buff.data(), 1) == 1 && h.send(buff.data(), 1) == 1;
+		for(int i=0;i<nblock && ok;++i)
+			ok = b.receive(buff.data(), bulk) == (ssize_t)bulk;
+		if (ok) ok = check(b.receive(buff.data(), 1) == 0, "missing EOS");
+		if (ok) ok = check(h.receive(buff.data(), 1) == 0, "missing EOS");
+		// the message still in the delay line at the end is dropped, not the EOS
+		HandleUser d;
+		if (ok) d = Manager::getNext();
+		if (ok) ok = check(d.receive(buff.data(), 1) == 0, "missing EOS of the dropped message");
+		d.close();
+		b.close();
+		h.close();
+		Manager::finalize(true);
+		return ok ? 0 : -1;
+	}
+
+	Manager::init("test_emu-client");
+	std::string uri = "EMU:" + address + "?lat=30ms&bw=80M&jitter=10ms";
+	HandleUser h;
+	for(int j=0;j<10 && !h.isValid();++j) {
+		h = Manager::connect(uri);
+		if (!h.isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+	if (!h.isValid()) {
+		MTCL_ERROR("[Client]:\t", "cannot connect to server, exit\n");
+		Manager::finalize();
+		return -1;
+	}
+	std::vector<char> buff(bulk);
+	bool ok = true;
+	auto start = std::chrono::steady_clock::now();
+	for(int i=0;i<nping && ok;++i)
+		ok = h.send(buff.data(), 1) == 1 && h.receive(buff.data(), 1) == 1;
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	ok = ok && check(ms >= nping * (50 - 2*10), "round trip shorter than the emulated delay") &&
+		check(ms < nping * 500, "round trip too long");
+
+	start = std::chrono::steady_clock::now();
+	for(int i=0;i<nbulk && ok;++i)
+		ok = h.send(buff.data(), bulk) == (ssize_t)bulk;
+	ok = ok && h.receive(buff.data(), 1) == 1;
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	ok = ok && check(ms >= nbulk * 100, "transfer faster than the emulated rate") &&
+		check(ms < nbulk * 1000, "transfer too slow");
+
+	for(int i=0;i<nseq && ok;++i)
+		ok = h.send(&i, sizeof(i)) == sizeof(i);
+
+	auto b = Manager::connect("EMU:" + address + "?lat=1ms");
+	ok = ok && check(b.isValid(), "cannot open the second connection");
+	for(int i=0;i<nblock && ok;++i)
+		ok = b.send(buff.data(), bulk) == (ssize_t)bulk;
+	start = std::chrono::steady_clock::now();
+	for(int i=0;i<nping && ok;++i)
+		ok = h.send(buff.data(), 1) == 1 && h.receive(buff.data(), 1) == 1;
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	ok = ok && check(ms < nping * 500, "round trip delayed by another connection");
+	// the handshake goes through, the message would take 1000s
+	auto d = Manager::connect("EMU:" + address + "?bw=8k");
+	ok = ok && check(d.isValid(), "cannot open the third connection") && d.send(buff.data(), bulk) == (ssize_t)bulk;
+	d.close();
+	b.close();
+	h.close();
+	start = std::chrono::steady_clock::now();
+	Manager::finalize(true);
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	ok = ok && check(ms < EMU_END_TIMEOUT + 2000, "end not bounded");
+
+	int status;
+	wait(&status);
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	MTCL_ERROR("[test_emu]:\t", "OK!\n");
+	return 0;
+}
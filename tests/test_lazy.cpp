@@ -0,0 +1,69 @@
+// lazy initialization of the protocols at the first connect, the eager ones by init of the first runtime
+#include <iostream>
+#include "test_utils.hpp"
+
+template<bool Eager>
+class ConnCount : public ConnType {
+public:
+	inline static std::atomic<int> inits{0}, updates{0}, ends{0};
+
+	ConnCount() { eager = Eager; }
+
+	int init(std::string) {
+		inits++;
+		return 0;
+	}
+	int listen(std::string) { return 0; }
+	Handle* connect(const std::string&, int, unsigned) {
+		errno = ECONNREFUSED;
+		return nullptr;
+	}
+	void update() { updates++; }
+	void notify_yield(Handle*) {}
+	void notify_close(Handle*, bool, bool) {}
+	void end(bool) { ends++; }
+};
+
+using ConnLazy  = ConnCount<false>;
+using ConnEager = ConnCount<true>;
+
+int main(int argc, char** argv){
+	setenv("MTCL_PROTOCOLS", "TCP,COUNT,EAGER", 1);
+	Manager::registerType<ConnLazy>("COUNT");
+	Manager::registerType<ConnEager>("EAGER");
+	Manager::init("test_lazy");
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	Manager::getNext(std::chrono::milliseconds(10));  // polls with SINGLE_IO_THREAD
+
+	bool ok = check(ConnLazy::inits == 0, "protocol initialized by init") &&
+		check(ConnLazy::updates == 0, "protocol polled before its initialization") &&
+		check(ConnEager::inits == 1, "eager protocol not initialized by init");
+
+	// another runtime, on another thread, cannot initialize the eager protocol
+	std::thread([&]() {
+		MTCLRuntime rt;
+		rt.registerType<ConnEager>("EAGER");
+		rt.init("test_lazy-2");
+		ok = ok && check(rt.initProtocol("EAGER") == -1 && ConnEager::inits == 1,
+						 "eager protocol initialized by another runtime");
+		rt.finalize();
+	}).join();
+
+	auto h = Manager::connect("COUNT:peer", 1);
+	ok = ok && check(!h.isValid() && ConnLazy::inits == 1, "protocol not initialized by connect");
+	h = Manager::connect("COUNT:peer", 1);
+	ok = ok && check(ConnLazy::inits == 1 && Manager::initProtocol("COUNT") == 0 &&
+					 ConnLazy::inits == 1, "protocol initialized twice");
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	Manager::getNext(std::chrono::milliseconds(10));
+	ok = ok && check(ConnLazy::updates > 0, "protocol not polled after its initialization");
+
+	ok = ok && check(Manager::listen("SHM:/test_lazy") == -1 && Manager::initProtocol("SHM") == -1,
+					 "protocol not in MTCL_PROTOCOLS available");
+	ok = ok && check(Manager::initProtocol("TCP") == 0, "TCP not available");
+	Manager::finalize();
+	ok = ok && check(ConnLazy::ends == 1 && ConnEager::ends == 1, "protocol not ended");
+	if (!ok) return -1;
+	MTCL_ERROR("[test_lazy]:\t", "OK!\n");
+	return 0;
+}
@@ -0,0 +1,55 @@
+// asynchronous log (MTCL_ENABLE_ASYNC_LOG): order per thread, truncation marker, ring buffers reused by new threads
+#include <fstream>
+#include <iostream>
+#include <map>
+#include "test_utils.hpp"
+
+const int nthreads = 64;
+const std::string logfile{"/tmp/test_log.txt"};
+
+// resident set size in bytes
+static size_t rss() {
+	size_t pages = 0, resident = 0;
+	std::ifstream("/proc/self/statm") >> pages >> resident;
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char** argv){
+	if (!freopen(logfile.c_str(), "w", stdout)) return -1;
+
+	// each thread fills its ring buffer, then exits
+	size_t before = rss();
+	for(int t=0;t<nthreads;++t)
+		std::thread([t]() {
+			for(size_t i=0;i<LOG_BUFFER_RECORDS;++i)
+				MTCL_LOG(stdout, "[test_log]:\t", "thread %d message %lu\n", t, i);
+		}).join();
+	size_t grown = rss() - before;
+	std::string big(2*LOG_RECORD_SIZE, 'x');
+	MTCL_LOG(stdout, "[test_log]:\t", "long %s %d\n", big.c_str(), 1);
+	AsyncLog::flush();
+	fflush(stdout);
+
+	std::ifstream f(logfile);
+	std::map<int, size_t> next;
+	std::string line, truncated;
+	bool ok = true;
+	while(ok && std::getline(f, line)) {
+		int t;
+		size_t i;
+		if (std::sscanf(line.c_str(), "[test_log]:\tthread %d message %lu", &t, &i) == 2)
+			ok = check(i == next[t]++, "message lost or out of order");
+		else truncated = line;
+	}
+	for(int t=0;t<nthreads && ok;++t)
+		ok = check(next[t] == LOG_BUFFER_RECORDS, "missing messages");
+	ok = ok && check(truncated.rfind("[test_log]:\tlong xxx", 0) == 0 &&
+					 truncated.size() < LOG_RECORD_SIZE + 64 &&
+					 truncated.find(" (truncated)") == truncated.size() - 12, "wrong truncated message");
+	// one ring buffer for all the threads, not one each
+	ok = ok && check(grown < nthreads / 4 * LOG_BUFFER_RECORDS * LOG_RECORD_SIZE, "ring buffers not reused");
+	std::remove(logfile.c_str());
+	if (!ok) return -1;
+	MTCL_ERROR("[test_log]:\t", "OK!\n");
+	return 0;
+}
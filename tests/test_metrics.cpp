@@ -0,0 +1,91 @@
+// Prometheus exporter (MTCL_METRICS) scraped on a Unix socket
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "test_utils.hpp"
+
+const int nmsgs   = 100;
+const size_t size = 128;
+
+std::string address{"TCP:localhost:13000"};
+const std::string endpoint{"/tmp/test_metrics.sock"};
+
+int main(int argc, char** argv){
+	if (argc>1) {
+		address=argv[1];
+	}
+	std::string protocol = address.substr(0, address.find(':'));
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		setenv("MTCL_METRICS", ("unix:" + endpoint).c_str(), 1);
+		Manager::init("test_metrics-server");
+		if (Manager::listen(address.c_str())==-1) {
+			MTCL_ERROR("[Server]:\t", "ERROR, cannot listen to %s, errno=%d\n", address.c_str(), errno);
+			Manager::finalize();
+			return -1;
+		}
+		bool ok = true;
+		while(true) {
+			auto h = Manager::getNext();
+			if (h.isNewConnection()) continue;
+			char buff[size];
+			ssize_t r = h.receive(buff, sizeof(buff));
+			if (r < 0) {
+				MTCL_ERROR("[Server]:\t", "ERROR receive: errno=%d\n", errno);
+				ok = false;
+				break;
+			}
+			if (r == 0) {
+				std::string body = scrape(endpoint);
+				std::string l = "{app=\"test_metrics-server\",protocol=\"" + protocol + "\"}";
+				ok = body.rfind("HTTP/1.0 200 OK\r\n", 0) == 0 &&
+					checkSample(body, "mtcl_messages_received_total" + l + " " + std::to_string(nmsgs)) &&
+					checkSample(body, "mtcl_bytes_received_total" + l + " " + std::to_string(nmsgs*size)) &&
+					checkSample(body, "mtcl_connections" + l + " 1") &&
+					checkSample(body, "mtcl_receive_duration_seconds_count" + l + " " + std::to_string(nmsgs)) &&
+					checkSample(body, "mtcl_ready_queue_depth{app=\"test_metrics-server\"} 0");
+				h.close();
+				break;
+			}
+		}
+		Manager::finalize(true);
+		if (access(endpoint.c_str(), F_OK) == 0) {
+			MTCL_ERROR("[Server]:\t", "ERROR the exporter socket has not been removed\n");
+			ok = false;
+		}
+		return ok ? 0 : -1;
+	}
+
+	Manager::init("test_metrics-client");
+	HandleUser handle;
+	for(int j=0;j<10;++j) {
+		auto h = Manager::connect(address.c_str());
+		if (!h.isValid()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			continue;
+		}
+		handle = std::move(h);
+		break;
+	}
+	if (!handle.isValid()) {
+		MTCL_ERROR("[Client]:\t", "cannot connect to server, exit\n");
+		Manager::finalize();
+		return -1;
+	}
+	char buff[size]{};
+	for(int i=0;i<nmsgs;++i)
+		if (handle.send(buff, size)<0) {
+			MTCL_ERROR("[Client]:\t", "ERROR sending errno=%d\n", errno);
+			break;
+		}
+	handle.close();
+	Manager::finalize(true);
+
+	int status;
+	wait(&status);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	MTCL_ERROR("[test_metrics]:\t", "OK!\n");
+	return 0;
+}
@@ -0,0 +1,120 @@
+// repeated connect/close to the same destination reusing one pooled connection (MTCL_CONNECTION_POOL)
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "test_utils.hpp"
+
+const int nsessions = 10;
+
+std::string address{"TCP:localhost:13000"};
+
+// connections opened by the transport of address
+static uint64_t connections() {
+	return Manager::getStats()[address.substr(0, address.find(':'))].connOpened;
+}
+
+int main(int argc, char** argv){
+	if (argc>1) {
+		address=argv[1];
+	}
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		Manager::init("test_pool-server");
+		if (Manager::listen(address.c_str())==-1) {
+			MTCL_ERROR("[Server]:\t", "ERROR, cannot listen to %s, errno=%d\n", address.c_str(), errno);
+			Manager::finalize();
+			return -1;
+		}
+		int closed = 0;
+		bool ok = true;
+		while(closed < nsessions && ok) {
+			auto h = Manager::getNext();
+			char buff[64];
+			ssize_t r = h.receive(buff, sizeof(buff));
+			if (r < 0) {
+				MTCL_ERROR("[Server]:\t", "ERROR receive: errno=%d\n", errno);
+				ok = false;
+				break;
+			}
+			if (r == 0) { // EOS, end of the session
+				h.close();
+				++closed;
+				continue;
+			}
+			if (h.send(buff, r)<0) {
+				MTCL_ERROR("[Server]:\t", "ERROR sending errno=%d\n", errno);
+				ok = false;
+			}
+		}
+		if (ok && connections() != 1) {
+			MTCL_ERROR("[Server]:\t", "ERROR, %lu connections accepted instead of 1\n", connections());
+			ok = false;
+		}
+		Manager::finalize(true);
+		return ok ? 0 : -1;
+	}
+
+	setenv("MTCL_CONNECTION_POOL", "1", 1);
+	Manager::init("test_pool-client");
+	bool ok = true;
+	for(int i=0;i<nsessions && ok;++i) {
+		HandleUser handle;
+		for(int j=0;j<10;++j) {
+			auto h = Manager::connect(address.c_str());
+			if (!h.isValid()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(500));
+				continue;
+			}
+			handle = std::move(h);
+			break;
+		}
+		if (!handle.isValid()) {
+			MTCL_ERROR("[Client]:\t", "cannot connect to server, exit\n");
+			ok = false;
+			break;
+		}
+		std::string msg{"session " + std::to_string(i)};
+		char buff[64];
+		if (i == nsessions-1 && handle.send(msg.c_str(), msg.length()+1) > 0) {
+			// closed for writing, the reply is still reported by getNext
+			handle.close();
+			handle.yield();
+			auto r = Manager::getNext(std::chrono::seconds(5));
+			ok = check(r.isValid() && r.receive(buff, sizeof(buff)) > 0 && msg == buff,
+					   "[Client]:\t", "reply not reported after the close");
+			if (ok && r.receive(buff, sizeof(buff)) != 0) {
+				MTCL_ERROR("[Client]:\t", "ERROR, expected EOS in session %d\n", i);
+				ok = false;
+			}
+			break;
+		}
+		if (handle.send(msg.c_str(), msg.length()+1)<0 ||
+			handle.receive(buff, sizeof(buff))<=0 || msg != buff) {
+			MTCL_ERROR("[Client]:\t", "ERROR in session %d, errno=%d\n", i, errno);
+			ok = false;
+			break;
+		}
+		handle.close();
+		// waiting for the server to end the session before the next connect
+		if (handle.receive(buff, sizeof(buff)) != 0) {
+			MTCL_ERROR("[Client]:\t", "ERROR, expected EOS in session %d\n", i);
+			ok = false;
+		}
+	}
+	if (ok && connections() != 1) {
+		MTCL_ERROR("[Client]:\t", "ERROR, %lu connections opened instead of 1\n", connections());
+		ok = false;
+	}
+
+	Manager::finalize(true);
+
+	int status;
+	if (!ok) kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	MTCL_ERROR("[test_pool]:\t", "OK!\n");
+	return 0;
+}
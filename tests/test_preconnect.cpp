@@ -0,0 +1,79 @@
+// connections and teams established at init by the configuration file ("connect-to", "teams")
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fstream>
+#include <iostream>
+#include "test_utils.hpp"
+
+const size_t size = 64;
+const std::string config{"/tmp/test_preconnect.json"};
+const std::string participants{"App0:App1"};
+
+static uint64_t connections() {
+	return Manager::getStats()["TCP"].connOpened;
+}
+
+int main(int argc, char** argv){
+	{
+		std::ofstream f(config);
+		f << "{\n\"components\" : [\n"
+		  << "  { \"name\" : \"App0\", \"host\" : \"localhost\", \"protocols\" : [\"TCP\"], "
+		  << "\"listen-endpoints\" : [\"TCP:127.0.0.1:14100\"] },\n"
+		  << "  { \"name\" : \"App1\", \"host\" : \"localhost\", \"protocols\" : [\"TCP\"], "
+		  << "\"connect-to\" : [\"App0\", \"App0\"], \"teams\" : [ { \"participants\" : \""
+		  << participants << "\", \"root\" : \"App0\", \"type\" : \"MTCL_BROADCAST\" } ] }\n]\n}\n";
+	}
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		Manager::init("App0", config);
+		auto hg = Manager::createTeam(participants, "App0", MTCL_BROADCAST);
+		bool ok = check(hg.isValid(), "[App0]:\t", "cannot create the team");
+		char buff[size] = "broadcast";
+		ok = ok && check(hg.sendrecv(buff, size, buff, size) == (ssize_t)size, "[App0]:\t", "broadcast error");
+		if (hg.isValid()) hg.close();
+		// echoes the messages, both the connections from App1 must end with the EOS
+		int eos = 0;
+		while(ok && eos < 2) {
+			auto h = Manager::getNext();
+			if (h.isNewConnection()) continue;
+			ssize_t r = h.receive(buff, size);
+			if (r == 0) {
+				h.close();
+				++eos;
+				continue;
+			}
+			ok = check(r > 0 && h.send(buff, r) == r, "[App0]:\t", "echo error");
+		}
+		Manager::finalize(true);
+		return ok ? 0 : -1;
+	}
+
+	Manager::init("App1", config);
+	uint64_t opened = connections();
+	auto h = Manager::connect("App0");
+	bool ok = check(h.isValid(), "[App1]:\t", "cannot connect to App0") &&
+		check(connections() == opened, "[App1]:\t", "connect opened a new connection");
+	char msg[size] = "hello", buff[size];
+	ok = ok && check(h.send(msg, size) == (ssize_t)size && h.receive(buff, size) == (ssize_t)size &&
+					 std::string(buff) == msg, "[App1]:\t", "wrong echo");
+	if (h.isValid()) h.close();
+
+	auto hg = Manager::createTeam(participants, "App0", MTCL_BROADCAST);
+	ok = ok && check(hg.isValid(), "[App1]:\t", "cannot create the team") &&
+		check(connections() == opened, "[App1]:\t", "createTeam opened a new connection");
+	ok = ok && check(hg.sendrecv(nullptr, 0, buff, size) == (ssize_t)size && std::string(buff) == "broadcast",
+					 "[App1]:\t", "wrong broadcast");
+	if (hg.isValid()) hg.close();
+	// the second connection to App0 is closed by finalize
+	Manager::finalize(true);
+
+	int status;
+	if (!ok) kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	MTCL_ERROR("[test_preconnect]:\t", "OK!\n");
+	return 0;
+}
@@ -0,0 +1,98 @@
+// independent runtimes (MTCLRuntime), the addresses must be TCP ones
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "test_utils.hpp"
+
+const int nmsgs = 100;
+
+std::string address[2]{"TCP:localhost:13000", "TCP:localhost:13001"};
+const std::string endpoint{"/tmp/test_runtimes.sock"};
+
+// echoes the messages of one connection, that must be the ones sent to address[i]
+static bool serve(MTCLRuntime& rt, int i) {
+	rt.init("test_runtimes-server" + std::to_string(i));
+	if (rt.listen(address[i])==-1) {
+		MTCL_ERROR("[Server]:\t", "ERROR, cannot listen to %s, errno=%d\n", address[i].c_str(), errno);
+		rt.finalize();
+		return false;
+	}
+	bool ok = true;
+	std::vector<char> buff(address[i].size());
+	for(bool served = false; !served && ok; ) {
+		auto h = rt.getNext();
+		if (!h.isNewConnection()) continue;
+		ssize_t r;
+		while(ok && (r = h.receive(buff.data(), buff.size())) > 0)
+			ok = check(std::string(buff.data(), r) == address[i], "[Server]:\t", "connection of another runtime") &&
+				h.send(buff.data(), r) == r;
+		ok = ok && check(r == 0, "[Server]:\t", "receive error");
+		h.close();
+		served = true;
+	}
+	ok = ok && check(!rt.getNext(std::chrono::milliseconds(200)).isValid(), "[Server]:\t", "unexpected handle");
+	ok = ok && check(rt.getStats()["TCP"].msgReceived == (uint64_t)nmsgs * (i+1), "[Server]:\t", "wrong number of messages received");
+	rt.finalize(true);
+	return ok;
+}
+
+int main(int argc, char** argv){
+	if (argc>2) {
+		address[0]=argv[1];
+		address[1]=argv[2];
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		MTCLRuntime rt[2];
+		bool ok[2];
+		std::thread t([&]() { ok[1] = serve(rt[1], 1); });
+		ok[0] = serve(rt[0], 0);
+		t.join();
+		return ok[0] && ok[1] ? 0 : -1;
+	}
+
+	// the exporter, started by the first runtime, reports both of them
+	setenv("MTCL_METRICS", ("unix:" + endpoint).c_str(), 1);
+	MTCLRuntime rt[2];
+	HandleUser h[2];
+	bool ok = true;
+	for(int i=0;i<2;++i) {
+		rt[i].init("test_runtimes-client" + std::to_string(i));
+		for(int j=0;j<10 && !h[i].isValid();++j) {
+			h[i] = rt[i].connect(address[i]);
+			if (!h[i].isValid()) std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		}
+		if (!h[i].isValid()) {
+			MTCL_ERROR("[Client]:\t", "cannot connect to %s, exit\n", address[i].c_str());
+			return -1;
+		}
+	}
+	for(int i=0;i<2;++i) {
+		std::vector<char> buff(address[i].size());
+		for(int j=0;j<nmsgs*(i+1) && ok;++j)
+			ok = h[i].send(address[i].c_str(), address[i].size()) == (ssize_t)address[i].size() &&
+				check(h[i].receive(buff.data(), buff.size()) == (ssize_t)buff.size() &&
+					  std::string(buff.data(), buff.size()) == address[i], "[Client]:\t", "wrong message");
+		h[i].close();
+		size_t sz;
+		ok = ok && check(h[i].probe(sz) == 0, "[Client]:\t", "missing EOS");
+		ok = ok && check(rt[i].getStats()["TCP"].msgSent == (uint64_t)nmsgs * (i+1), "[Client]:\t", "wrong number of messages sent");
+	}
+	std::string body = scrape(endpoint);
+	for(int i=0;i<2;++i)
+		ok = ok && checkSample(body, "mtcl_messages_sent_total{app=\"test_runtimes-client" + std::to_string(i) +
+							   "\",protocol=\"TCP\"} " + std::to_string(nmsgs * (i+1)));
+	rt[0].finalize(true);
+	body = scrape(endpoint);
+	ok = ok && checkSample(body, "mtcl_ready_queue_depth{app=\"test_runtimes-client1\"} 0") &&
+		check(body.find("test_runtimes-client0") == std::string::npos, "[Client]:\t", "finalized runtime still exported");
+	rt[1].finalize(true);
+	ok = ok && check(access(endpoint.c_str(), F_OK) != 0, "[Client]:\t", "the exporter has not been stopped");
+
+	int status;
+	wait(&status);
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	MTCL_ERROR("[test_runtimes]:\t", "OK!\n");
+	return 0;
+}
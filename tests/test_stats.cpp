@@ -0,0 +1,101 @@
+// handle and transport statistics (MTCL_ENABLE_STATS), also after a reset
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "test_utils.hpp"
+
+const int nmsgs   = 100;
+const size_t size = 128;
+
+std::string address{"TCP:localhost:13000"};
+
+int main(int argc, char** argv){
+	if (argc>1) {
+		address=argv[1];
+	}
+	std::string protocol = address.substr(0, address.find(':'));
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		Manager::init("test_stats-server");
+		if (Manager::listen(address.c_str())==-1) {
+			MTCL_ERROR("[Server]:\t", "ERROR, cannot listen to %s, errno=%d\n", address.c_str(), errno);
+			Manager::finalize();
+			return -1;
+		}
+		bool ok = true;
+		int received = 0;
+		while(true) {
+			auto h = Manager::getNext();
+			if (h.isNewConnection()) continue;
+			char buff[size];
+			ssize_t r = h.receive(buff, sizeof(buff));
+			if (r < 0) {
+				MTCL_ERROR("[Server]:\t", "ERROR receive: errno=%d\n", errno);
+				ok = false;
+				break;
+			}
+			if (r == 0) {
+				auto s = h.getStats();
+				ok = check("[Server]:\t", "msgReceived", s.msgReceived, nmsgs) &&
+					check("[Server]:\t", "bytesReceived", s.bytesReceived, nmsgs*size) &&
+					check("[Server]:\t", "probes", s.probes, nmsgs+1);
+				// yielded for the new connection and each message, ready also for the EOS
+				ok = ok && check("[Server]:\t", "yields", s.yields, nmsgs+1) &&
+					check("[Server]:\t", "readyCount", s.readyCount, nmsgs+2);
+				h.close();
+				break;
+			}
+			++received;
+		}
+		auto l = Manager::getLoopStats();
+		if (l.iterations == 0 || l.dispatched < (uint64_t)received ||
+			Manager::getStats()[protocol].updateCalls == 0) {
+			MTCL_ERROR("[Server]:\t", "ERROR IO loop statistics not updated\n");
+			ok = false;
+		}
+		auto s = Manager::getStats(true)[protocol];
+		ok = ok && check("[Server]:\t", "transport msgReceived", s.msgReceived, received) &&
+			check("[Server]:\t", "transport msgReceived after reset",
+				  Manager::getStats()[protocol].msgReceived, 0);
+		Manager::finalize(true);
+		return ok ? 0 : -1;
+	}
+
+	Manager::init("test_stats-client");
+	HandleUser handle;
+	for(int j=0;j<10;++j) {
+		auto h = Manager::connect(address.c_str());
+		if (!h.isValid()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			continue;
+		}
+		handle = std::move(h);
+		break;
+	}
+	if (!handle.isValid()) {
+		MTCL_ERROR("[Client]:\t", "cannot connect to server, exit\n");
+		Manager::finalize();
+		return -1;
+	}
+	char buff[size]{};
+	for(int i=0;i<nmsgs;++i)
+		if (handle.send(buff, size)<0) {
+			MTCL_ERROR("[Client]:\t", "ERROR sending errno=%d\n", errno);
+			break;
+		}
+	auto s = handle.getStats(true);
+	bool ok = check("[Client]:\t", "msgSent", s.msgSent, nmsgs) &&
+		check("[Client]:\t", "bytesSent", s.bytesSent, nmsgs*size) &&
+		check("[Client]:\t", "msgSent after reset", handle.getStats().msgSent, 0) &&
+		check("[Client]:\t", "transport msgSent", Manager::getStats()[protocol].msgSent, nmsgs);
+	handle.close();
+	Manager::finalize(true);
+
+	int status;
+	wait(&status);
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	MTCL_ERROR("[test_stats]:\t", "OK!\n");
+	return 0;
+}
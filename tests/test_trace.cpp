@@ -0,0 +1,110 @@
+// tracing (MTCL_ENABLE_TRACE): the Chrome trace written while the threads record events and by finalize is valid JSON
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "test_utils.hpp"
+
+const int nmsgs = 10000;
+const std::string address{"TCP:localhost:13000"};
+const std::string tracefile{"/tmp/test_trace.json"};
+
+// minimal JSON validator, true if the whole text is one value
+struct Json {
+	const std::string& t;
+	size_t p = 0;
+	void ws() { while (p < t.size() && std::isspace((unsigned char)t[p])) ++p; }
+	bool lit(const char* l) { size_t n = std::strlen(l); if (t.compare(p, n, l)) return false; p += n; return true; }
+	bool str() {
+		if (t[p++] != '"') return false;
+		while (p < t.size() && t[p] != '"') {
+			if ((unsigned char)t[p] < 0x20) return false;
+			if (t[p] == '\\') ++p;
+			++p;
+		}
+		return p++ < t.size();
+	}
+	bool num() {
+		size_t s = p;
+		while (p < t.size() && std::strchr("+-0123456789.eE", t[p])) ++p;
+		return p > s;
+	}
+	template<typename F> bool list(char close, F item) {
+		++p; ws();
+		if (p < t.size() && t[p] == close) { ++p; return true; }
+		while (true) {
+			if (!item()) return false;
+			ws();
+			if (p >= t.size()) return false;
+			if (t[p] == close) { ++p; return true; }
+			if (t[p++] != ',') return false;
+			ws();
+		}
+	}
+	bool value() {
+		ws();
+		if (p >= t.size()) return false;
+		switch (t[p]) {
+		case '{': return list('}', [&]{ ws(); if (!str()) return false; ws(); return p < t.size() && t[p++] == ':' && value(); });
+		case '[': return list(']', [&]{ return value(); });
+		case '"': return str();
+		case 't': return lit("true");
+		case 'f': return lit("false");
+		case 'n': return lit("null");
+		default:  return num();
+		}
+	}
+	bool valid() { bool ok = value(); ws(); return ok && p == t.size(); }
+};
+
+static std::string readTrace() {
+	std::ifstream f(tracefile);
+	std::stringstream ss;
+	ss << f.rdbuf();
+	return ss.str();
+}
+
+int main(int argc, char** argv){
+	setenv("MTCL_TRACE", tracefile.c_str(), 1);
+	Manager::init("test_trace");
+	if (Manager::listen(address) == -1) {
+		MTCL_ERROR("[test_trace]:\t", "ERROR, cannot listen to %s, errno=%d\n", address.c_str(), errno);
+		return -1;
+	}
+	auto h = Manager::connect(address);
+	bool ok = check(h.isValid(), "cannot connect");
+	h.setName("client");
+
+	// the messages are traced while the buffers are written to the file
+	std::atomic<bool> done{false};
+	std::thread flusher([&]() {
+		while(!done) Trace::flush();
+	});
+	bool sent = ok;
+	std::thread sender([&]() {
+		for(int i=0;i<nmsgs && sent;++i) sent = h.send(&i, sizeof(int)) == sizeof(int);
+		h.close();
+	});
+	auto s = Manager::getNext();
+	bool received = check(s.isNewConnection(), "connection not accepted");
+	s.setName("server");
+	int i, r = 0;
+	for(ssize_t n; (n = s.receive(&i, sizeof(int))) > 0; ++r)
+		received = received && check(n == sizeof(int) && i == r, "wrong message");
+	s.close();
+	sender.join();
+	done = true;
+	flusher.join();
+	ok = ok && check(sent, "send error");
+	ok = ok && received && check(r == nmsgs, "missing messages");
+	ok = ok && check(Json{readTrace()}.valid(), "invalid trace written while recording");
+
+	Manager::finalize(true);
+	std::string trace = readTrace();
+	ok = ok && check(Json{trace}.valid(), "invalid trace written by finalize") &&
+		check(trace.find("\"name\":\"send client\"") != std::string::npos &&
+			  trace.find("\"name\":\"receive server\"") != std::string::npos, "missing events");
+	std::remove(tracefile.c_str());
+	if (!ok) return -1;
+	MTCL_ERROR("[test_trace]:\t", "OK!\n");
+	return 0;
+}
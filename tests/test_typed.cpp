@@ -0,0 +1,84 @@
+// typed handles (TypedHandle), the address must be a TCP or SHM one
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <iostream>
+#include "test_utils.hpp"
+
+const int nmsgs = 1000;
+
+std::string address{"TCP:localhost:13000"};
+
+template<typename T, typename Other>
+int run() {
+	pid_t pid = fork();
+	if (pid == 0) {
+		Manager::init("test_typed-server");
+		if (Manager::listen(address)==-1) {
+			MTCL_ERROR("[Server]:\t", "ERROR, cannot listen to %s, errno=%d\n", address.c_str(), errno);
+			Manager::finalize();
+			return -1;
+		}
+		bool ok = true;
+		std::vector<char> buff(nmsgs);
+		for(int served = 0; served < 2 && ok; ) {
+			auto h = Manager::getNext();
+			if (!h.isNewConnection()) continue;
+			TypedHandle<Other> w(std::move(h));
+			ok = check(!w.isValid() && h.isValid(), "handle typed with the wrong transport");
+			TypedHandle<T> t(std::move(h));
+			ok = ok && check(t.isValid() && !h.isValid(), "cannot type the handle");
+			ssize_t r;
+			while(ok && (r = t.receive(buff.data(), buff.size())) > 0)
+				ok = t.send(buff.data(), r) == r;
+			ok = ok && check(r == 0, "receive error");
+			t.close();
+			served++;
+		}
+		Manager::finalize(true);
+		return ok ? 0 : -1;
+	}
+
+	Manager::init("test_typed-client");
+	bool ok = true;
+	for(int j=0;j<10;++j) {
+		auto w = Manager::connect<Other>(address);
+		if (w.isValid() || errno == EPROTOTYPE) {
+			ok = check(!w.isValid(), "connected with the wrong transport");
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+	auto h = Manager::connect<T>(address);
+	if (!h.isValid()) {
+		MTCL_ERROR("[Client]:\t", "cannot connect to server, exit\n");
+		Manager::finalize();
+		return -1;
+	}
+	std::vector<char> sbuff(nmsgs), rbuff(nmsgs);
+	for(int i=1;i<=nmsgs && ok;++i) {
+		sbuff[i-1] = (char)i;
+		size_t sz;
+		ok = h.send(sbuff.data(), i) == i &&
+			check(h.probe(sz) > 0 && sz == (size_t)i, "wrong probed size") &&
+			check(h.receive(rbuff.data(), i) == i && rbuff[i-1] == (char)i, "wrong message");
+	}
+	h.close();
+	size_t sz;
+	ok = ok && check(h.probe(sz) == 0 && h.isClosed().first, "missing EOS");
+	Manager::finalize(true);
+
+	int status;
+	wait(&status);
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	MTCL_ERROR("[test_typed]:\t", "OK!\n");
+	return 0;
+}
+
+int main(int argc, char** argv){
+	if (argc>1) {
+		address=argv[1];
+	}
+	if (address.rfind("SHM:", 0) == 0) return run<ConnSHM, ConnTcp>();
+	return run<ConnTcp, ConnSHM>();
+}
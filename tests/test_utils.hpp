@@ -0,0 +1,57 @@
+#ifndef TEST_UTILS_HPP
+#define TEST_UTILS_HPP
+
+// helpers shared by the tests, a failed check prints what with the prefix who
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "mtcl.hpp"
+
+inline bool check(bool cond, const char* who, const char* what) {
+	if (!cond) MTCL_ERROR(who, "ERROR %s\n", what);
+	return cond;
+}
+
+// the prefix is the name of the test
+inline bool check(bool cond, const char* what) {
+	if (!cond) MTCL_ERROR(("[" + std::string(program_invocation_short_name) + "]:\t").c_str(), "ERROR %s\n", what);
+	return cond;
+}
+
+inline bool check(const char* who, const char* what, uint64_t value, uint64_t expected) {
+	if (value != expected) MTCL_ERROR(who, "ERROR %s is %lu, expected %lu\n", what, value, expected);
+	return value == expected;
+}
+
+// response of the metrics exporter listening on the Unix socket endpoint, empty on error
+inline std::string scrape(const std::string& endpoint) {
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un sa{};
+	sa.sun_family = AF_UNIX;
+	std::strncpy(sa.sun_path, endpoint.c_str(), sizeof(sa.sun_path) - 1);
+	const char req[] = "GET /metrics HTTP/1.0\r\n\r\n";
+	std::string resp;
+	if (connect(fd, (sockaddr*)&sa, sizeof(sa)) == 0 && write(fd, req, sizeof(req) - 1) > 0) {
+		char buff[4096];
+		for(ssize_t r; (r = read(fd, buff, sizeof(buff))) > 0; ) resp.append(buff, r);
+	}
+	close(fd);
+	return resp;
+}
+
+// the response must have the sample line
+inline bool checkSample(const std::string& resp, const std::string& line) {
+	return check(resp.find(line + "\n") != std::string::npos, ("missing sample " + line).c_str());
+}
+
+// value of the first sample of the metric name in a response, -1 if not found
+inline double sampleValue(const std::string& resp, const std::string& name) {
+	auto pos = resp.find("\n" + name + "{");
+	if (pos == std::string::npos) return -1;
+	return std::stod(resp.substr(resp.find("} ", pos) + 2));
+}
+
+#endif